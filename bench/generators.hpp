@@ -0,0 +1,128 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace reduse::bench {
+
+    /** @brief Draws keys in [0, num_keys) from a Zipf distribution. Key 0 is the most frequent */
+    class ZipfDistribution {
+    private:
+
+        std::vector<double> cdf; // Cumulative probability of every key
+
+    public:
+
+        /** @brief Constructor for the ZipfDistribution
+         * @param num_keys Number of distinct keys
+         * @param skew Exponent of the distribution. 0 is uniform, around 1 is typical for natural text
+         */
+        ZipfDistribution(const std::size_t num_keys, const double skew): cdf(num_keys > 0 ? num_keys : 1) {
+            double sum = 0;
+            for(std::size_t i = 0; i < cdf.size(); i++) {
+                sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+                cdf[i] = sum;
+            }
+            for(auto &it: cdf)
+                it /= sum;
+        }
+
+        /** @brief Draws a key */
+        template<typename Engine>
+        std::uint64_t operator()(Engine& engine) {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+            auto it = std::lower_bound(cdf.begin(), cdf.end(), u);
+            return static_cast<std::uint64_t>(std::min<std::size_t>(it - cdf.begin(), cdf.size() - 1));
+        }
+    };
+
+    /** @brief Opens a generated input file for writing */
+    inline std::ofstream openInput(const std::string& filename) {
+        std::ofstream output(filename, std::ios::out | std::ios::trunc);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open benchmark input file: " + filename);
+        return output;
+    }
+
+    /** @brief Writes lines of words drawn from a Zipf distributed vocabulary. Returns the number of words
+     * @param filename File to write
+     * @param num_lines Number of lines
+     * @param words_per_line Number of words on a line
+     * @param vocabulary Number of distinct words
+     * @param seed Seed of the generator
+     */
+    inline std::size_t generateWords(
+        const std::string& filename,
+        const std::size_t num_lines,
+        const std::size_t words_per_line,
+        const std::size_t vocabulary,
+        const std::uint64_t seed
+    ) {
+        std::mt19937_64 engine(seed);
+        ZipfDistribution words(vocabulary, 1.0);
+        auto output = openInput(filename);
+        for(std::size_t line = 0; line < num_lines; line++) {
+            for(std::size_t i = 0; i < words_per_line; i++)
+                output << (i > 0 ? " w" : "w") << words(engine);
+            output << '\n';
+        }
+        return num_lines * words_per_line;
+    }
+
+    /** @brief Writes "key value" lines with integer keys and values. Returns the number of lines
+     * @param filename File to write
+     * @param num_lines Number of lines
+     * @param num_keys Number of distinct keys
+     * @param skew Zipf exponent of the keys. 0 for uniform keys
+     * @param seed Seed of the generator
+     */
+    inline std::size_t generatePairs(
+        const std::string& filename,
+        const std::size_t num_lines,
+        const std::size_t num_keys,
+        const double skew,
+        const std::uint64_t seed
+    ) {
+        std::mt19937_64 engine(seed);
+        ZipfDistribution keys(num_keys, skew);
+        std::uniform_int_distribution<std::uint64_t> uniform_keys(0, num_keys > 0 ? num_keys - 1 : 0);
+        std::uniform_int_distribution<std::uint64_t> values(0, 1000);
+        auto output = openInput(filename);
+        for(std::size_t line = 0; line < num_lines; line++)
+            output << (skew > 0 ? keys(engine) : uniform_keys(engine)) << ' ' << values(engine) << '\n';
+        return num_lines;
+    }
+
+    /** @brief Writes "key value" lines with integer keys and wide printable values. Returns the number of lines
+     * @param filename File to write
+     * @param num_lines Number of lines
+     * @param num_keys Number of distinct keys
+     * @param value_width Number of characters of a value
+     * @param seed Seed of the generator
+     */
+    inline std::size_t generateWide(
+        const std::string& filename,
+        const std::size_t num_lines,
+        const std::size_t num_keys,
+        const std::size_t value_width,
+        const std::uint64_t seed
+    ) {
+        std::mt19937_64 engine(seed);
+        std::uniform_int_distribution<std::uint64_t> keys(0, num_keys > 0 ? num_keys - 1 : 0);
+        std::uniform_int_distribution<int> letters('a', 'z');
+        std::string value(value_width, 'a');
+        auto output = openInput(filename);
+        for(std::size_t line = 0; line < num_lines; line++) {
+            for(auto &it: value)
+                it = static_cast<char>(letters(engine));
+            output << keys(engine) << ' ' << value << '\n';
+        }
+        return num_lines;
+    }
+}
@@ -0,0 +1,364 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <reduse/mapper.hpp>
+#include <reduse/reducer.hpp>
+#include "generators.hpp"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock; // Clock of every measurement
+
+    /** @brief Command line configuration of a benchmark run */
+    struct Config {
+        std::vector<std::string> workloads = {"wordcount", "uniform", "zipf", "wide", "groups"}; // Workloads to run
+        std::size_t records = 1000000; // Number of input lines of every workload
+        std::size_t keys = 100000; // Number of distinct keys of the uniform, zipf and wide workloads
+        double skew = 1.1; // Zipf exponent of the zipf workload
+        std::size_t value_width = 256; // Characters of a value of the wide workload
+        std::vector<int> mappers = {1, 2, 4}; // Mapper counts to sweep
+        std::vector<int> reducers = {1, 2, 4}; // Reducer counts to sweep
+        int repetitions = 1; // Runs of every configuration
+        std::uint64_t seed = 42; // Seed of the workload generators
+        std::string format = "json"; // Report format: json or csv
+        std::string output; // Report file. Standard output if empty
+        std::string label; // Free-form label of the run, e.g. a commit hash
+        std::string work_dir = "."; // Directory of the generated inputs and outputs
+        reduse::Options options; // Tuning options of every job
+    };
+
+    /** @brief Wall time of the phases of a single job */
+    struct PhaseTimes {
+        double map_seconds = 0; // Map phase, including the shuffle
+        double reduce_seconds = 0; // Reduce phase, including the merge
+    };
+
+    /** @brief One row of the report */
+    struct Result {
+        std::string workload; // Workload name
+        int mappers; // Number of mapper workers
+        int reducers; // Number of reducer workers
+        int repetition; // Repetition number
+        std::size_t records; // Input lines
+        std::size_t input_bytes; // Input file size
+        PhaseTimes times; // Phase wall times
+    };
+
+    /** @brief Returns the seconds elapsed since start */
+    double secondsSince(const Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /** @brief Parses an unsigned integer at the start of text, moving text past it and one separator */
+    std::uint64_t parseNumber(std::string_view& text) {
+        std::uint64_t number = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        text.remove_prefix(std::min<std::size_t>(end - text.data() + 1, text.size()));
+        return number;
+    }
+
+    /** @brief Runs a job the way reduse::reduse does, timing the map and reduce phases separately */
+    template<typename key, typename value, typename reduce_value, typename MapFn, typename ReduceFn>
+    PhaseTimes runJob(
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<value(const key&, std::vector<value>&)>& COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const reduse::Options& options
+    ) {
+        PhaseTimes times;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<key, value>>(
+            input_filename + "_map_output.txt",
+            reduse::sortBufferBudget(options, num_mappers),
+            num_reducers,
+            options.spill_format,
+            options.io_backend
+        );
+
+        auto start = Clock::now();
+        reduse::Mapper<key, value> mapper(input_filename, shuffle, MAP, num_mappers, false, options);
+        if (COMBINE)
+            mapper.setCombiner(COMBINE);
+        mapper.run();
+        times.map_seconds = secondsSince(start);
+
+        start = Clock::now();
+        reduse::Reducer<key, value, reduce_value> reducer(shuffle, output_filename, REDUCE, num_reducers, false, options);
+        reducer.run();
+        times.reduce_seconds = secondsSince(start);
+        return times;
+    }
+
+    /** @brief Sums the values of a key group */
+    std::uint64_t sumReduce(const std::uint64_t&, std::vector<std::uint64_t>& values) {
+        std::uint64_t sum = 0;
+        for(auto &it: values)
+            sum += it;
+        return sum;
+    }
+
+    /** @brief Maps a "key value" line of integers */
+    std::pair<std::uint64_t, std::uint64_t> pairMap(std::string_view line) {
+        std::uint64_t curr_key = parseNumber(line);
+        return {curr_key, parseNumber(line)};
+    }
+
+    /** @brief A benchmark workload: how to generate its input and how to run it */
+    struct Workload {
+        std::string name; // Workload name
+        std::function<std::size_t(const std::string&, const Config&)> generate; // Writes the input file, returns its number of lines
+        std::function<PhaseTimes(const std::string&, const std::string&, int, int, const reduse::Options&)> run; // Runs the job
+    };
+
+    /** @brief Returns every known workload */
+    std::vector<Workload> workloads() {
+        std::vector<Workload> all;
+
+        // Word count over Zipf distributed words, with the combiner enabled
+        all.push_back({"wordcount",
+            [](const std::string& filename, const Config& config) {
+                reduse::bench::generateWords(filename, config.records, 8, 50000, config.seed);
+                return config.records;
+            },
+            [](const std::string& input, const std::string& output, int num_mappers, int num_reducers, const reduse::Options& options) {
+                auto MAP = [](std::string_view line, reduse::Emitter<std::string, std::uint64_t>& emitter) {
+                    while (!line.empty()) {
+                        auto end = std::min(line.find(' '), line.size());
+                        if (end > 0)
+                            emitter.emplace(std::string(line.substr(0, end)), 1);
+                        line.remove_prefix(std::min(end + 1, line.size()));
+                    }
+                };
+                auto REDUCE = [](const std::string&, std::vector<std::uint64_t>& values) {
+                    std::uint64_t sum = 0;
+                    for(auto &it: values)
+                        sum += it;
+                    return sum;
+                };
+                return runJob<std::string, std::uint64_t, std::uint64_t>(input, output, MAP, REDUCE, REDUCE, num_mappers, num_reducers, options);
+            }
+        });
+
+        // Integer pairs with uniform keys, skewed keys and many tiny groups
+        auto pairJob = [](const std::string& input, const std::string& output, int num_mappers, int num_reducers, const reduse::Options& options) {
+            return runJob<std::uint64_t, std::uint64_t, std::uint64_t>(input, output, pairMap, sumReduce, nullptr, num_mappers, num_reducers, options);
+        };
+        all.push_back({"uniform",
+            [](const std::string& filename, const Config& config) {
+                return reduse::bench::generatePairs(filename, config.records, config.keys, 0, config.seed);
+            },
+            pairJob
+        });
+        all.push_back({"zipf",
+            [](const std::string& filename, const Config& config) {
+                return reduse::bench::generatePairs(filename, config.records, config.keys, config.skew, config.seed);
+            },
+            pairJob
+        });
+        all.push_back({"groups",
+            [](const std::string& filename, const Config& config) {
+                return reduse::bench::generatePairs(filename, config.records, config.records / 2 + 1, 0, config.seed);
+            },
+            pairJob
+        });
+
+        // Wide string values
+        all.push_back({"wide",
+            [](const std::string& filename, const Config& config) {
+                return reduse::bench::generateWide(filename, config.records, config.keys, config.value_width, config.seed);
+            },
+            [](const std::string& input, const std::string& output, int num_mappers, int num_reducers, const reduse::Options& options) {
+                auto MAP = [](std::string_view line) {
+                    std::uint64_t curr_key = parseNumber(line);
+                    return std::pair<std::uint64_t, std::string>(curr_key, std::string(line));
+                };
+                auto REDUCE = [](const std::uint64_t&, std::vector<std::string>& values) {
+                    std::uint64_t length = 0;
+                    for(auto &it: values)
+                        length += it.size();
+                    return length;
+                };
+                return runJob<std::uint64_t, std::string, std::uint64_t>(input, output, MAP, REDUCE, nullptr, num_mappers, num_reducers, options);
+            }
+        });
+        return all;
+    }
+
+    /** @brief Splits a comma separated list */
+    std::vector<std::string> splitList(const std::string& list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+            if (!item.empty())
+                items.push_back(item);
+        return items;
+    }
+
+    /** @brief Splits a comma separated list of integers */
+    std::vector<int> splitIntList(const std::string& list) {
+        std::vector<int> items;
+        for(auto &it: splitList(list))
+            items.push_back(std::stoi(it));
+        return items;
+    }
+
+    void printUsage() {
+        std::cerr <<
+            "Usage: reduse_bench [options]\n"
+            "  --workloads LIST    Comma separated workloads: wordcount,uniform,zipf,wide,groups (default: all)\n"
+            "  --records N         Input lines of every workload (default: 1000000)\n"
+            "  --keys N            Distinct keys of the uniform, zipf and wide workloads (default: 100000)\n"
+            "  --skew S            Zipf exponent of the zipf workload (default: 1.1)\n"
+            "  --value-width N     Characters of a value of the wide workload (default: 256)\n"
+            "  --mappers LIST      Comma separated mapper counts to sweep (default: 1,2,4)\n"
+            "  --reducers LIST     Comma separated reducer counts to sweep (default: 1,2,4)\n"
+            "  --repetitions N     Runs of every configuration (default: 1)\n"
+            "  --seed N            Seed of the generators (default: 42)\n"
+            "  --input-mode MODE   stream or mmap (default: stream)\n"
+            "  --sort-budget BYTES Sort memory budget of the map phase (default: 256 MiB)\n"
+            "  --format json|csv   Report format (default: json)\n"
+            "  --output FILE       Report file (default: standard output)\n"
+            "  --label TEXT        Label written to every row, e.g. a commit hash\n"
+            "  --work-dir DIR      Directory of the generated files (default: .)\n";
+    }
+
+    /** @brief Parses the command line. Throws std::invalid_argument on unknown options */
+    Config parseArgs(int argc, char** argv) {
+        Config config;
+        for(int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                printUsage();
+                std::exit(0);
+            }
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            std::string val = argv[++i];
+            if (arg == "--workloads") config.workloads = splitList(val);
+            else if (arg == "--records") config.records = std::stoull(val);
+            else if (arg == "--keys") config.keys = std::stoull(val);
+            else if (arg == "--skew") config.skew = std::stod(val);
+            else if (arg == "--value-width") config.value_width = std::stoull(val);
+            else if (arg == "--mappers") config.mappers = splitIntList(val);
+            else if (arg == "--reducers") config.reducers = splitIntList(val);
+            else if (arg == "--repetitions") config.repetitions = std::stoi(val);
+            else if (arg == "--seed") config.seed = std::stoull(val);
+            else if (arg == "--input-mode") config.options.input_mode = val == "mmap" ? reduse::InputMode::MMAP : reduse::InputMode::STREAM;
+            else if (arg == "--sort-budget") config.options.sort_memory_budget = std::stoull(val);
+            else if (arg == "--format") config.format = val;
+            else if (arg == "--output") config.output = val;
+            else if (arg == "--label") config.label = val;
+            else if (arg == "--work-dir") config.work_dir = val;
+            else throw std::invalid_argument("Unknown option " + arg);
+        }
+        if (config.format != "json" && config.format != "csv")
+            throw std::invalid_argument("Unknown format " + config.format);
+        return config;
+    }
+
+    /** @brief Escapes a string for a JSON string literal */
+    std::string jsonEscape(const std::string& text) {
+        std::string escaped;
+        for(char c: text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    /** @brief Writes the report */
+    void writeReport(std::ostream& out, const Config& config, const std::vector<Result>& results) {
+        auto rate = [](double amount, double seconds) { return seconds > 0 ? amount / seconds : 0.0; };
+        if (config.format == "csv") {
+            out << "label,workload,records,input_bytes,mappers,reducers,repetition,map_seconds,reduce_seconds,total_seconds,records_per_second,bytes_per_second\n";
+            for(auto &it: results) {
+                double total = it.times.map_seconds + it.times.reduce_seconds;
+                out << config.label << ',' << it.workload << ',' << it.records << ',' << it.input_bytes << ','
+                    << it.mappers << ',' << it.reducers << ',' << it.repetition << ','
+                    << it.times.map_seconds << ',' << it.times.reduce_seconds << ',' << total << ','
+                    << rate(it.records, total) << ',' << rate(it.input_bytes, total) << '\n';
+            }
+            return;
+        }
+        out << "[\n";
+        for(std::size_t i = 0; i < results.size(); i++) {
+            auto &it = results[i];
+            double total = it.times.map_seconds + it.times.reduce_seconds;
+            out << "  {\"label\": \"" << jsonEscape(config.label) << "\", \"workload\": \"" << it.workload
+                << "\", \"records\": " << it.records << ", \"input_bytes\": " << it.input_bytes
+                << ", \"mappers\": " << it.mappers << ", \"reducers\": " << it.reducers << ", \"repetition\": " << it.repetition
+                << ", \"map_seconds\": " << it.times.map_seconds << ", \"reduce_seconds\": " << it.times.reduce_seconds
+                << ", \"total_seconds\": " << total << ", \"records_per_second\": " << rate(it.records, total)
+                << ", \"bytes_per_second\": " << rate(it.input_bytes, total) << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        Config config = parseArgs(argc, argv);
+        auto all = workloads();
+        std::vector<Result> results;
+
+        for(auto &name: config.workloads) {
+            auto workload = std::find_if(all.begin(), all.end(), [&](const Workload& w) { return w.name == name; });
+            if (workload == all.end())
+                throw std::invalid_argument("Unknown workload " + name);
+
+            // Generate the input once per workload; it is deterministic for a given seed
+            std::string input_filename = config.work_dir + "/reduse_bench_" + name + "_input.txt";
+            std::string output_filename = config.work_dir + "/reduse_bench_" + name + "_output.txt";
+            std::cerr << "Generating " << name << "..." << std::endl;
+            std::size_t records = workload->generate(input_filename, config);
+            std::size_t input_bytes;
+            {
+                std::ifstream input(input_filename, std::ios::in | std::ios::binary | std::ios::ate);
+                input_bytes = static_cast<std::size_t>(input.tellg());
+            }
+
+            for(auto num_mappers: config.mappers)
+                for(auto num_reducers: config.reducers)
+                    for(int repetition = 0; repetition < config.repetitions; repetition++) {
+                        std::cerr << name << ": " << num_mappers << " mappers, " << num_reducers << " reducers" << std::endl;
+                        auto times = workload->run(input_filename, output_filename, num_mappers, num_reducers, config.options);
+                        results.push_back({name, num_mappers, num_reducers, repetition, records, input_bytes, times});
+                    }
+
+            std::remove(input_filename.c_str());
+            std::remove(output_filename.c_str());
+        }
+
+        if (config.output.empty()) {
+            writeReport(std::cout, config, results);
+        } else {
+            std::ofstream out(config.output, std::ios::out | std::ios::trunc);
+            if (!out.is_open())
+                throw std::runtime_error("Cannot open report file: " + config.output);
+            writeReport(out, config, results);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage();
+        return 1;
+    }
+    return 0;
+}
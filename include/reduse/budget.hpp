@@ -0,0 +1,142 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+
+namespace reduse {
+
+    const double MEMORY_HEADROOM_SHARE = 0.25; // Fraction of a MemoryBudget kept free of spillable memory, for the records in flight between workers
+    const std::size_t MEMORY_RESERVE_STEP = 1 << 16; // Bytes a growing buffer reserves from a MemoryBudget at once, so the budget is not locked for every record
+
+    /** @brief Job-wide account of the memory held by its buffers, against a single limit. Memory comes in two kinds.
+     * Spillable memory, held by sort buffers, combine tables and collected key groups, is only granted while it fits
+     * below the limit less a headroom, and its holder spills or flushes it when a request fails. Memory in flight,
+     * held by batches of records handed from a producer to the workers, may use the headroom too, and a request for it
+     * blocks until the workers give enough back. Since in-flight memory always goes back once its batch is processed,
+     * a blocked producer is never left waiting on memory nobody will release. Thread safe
+     */
+    class MemoryBudget {
+    private:
+
+        const std::size_t limit; // Bytes the job may hold at once
+        const std::size_t spill_limit; // Bytes spillable memory may take up
+        std::size_t used; // Bytes held by spillable memory and memory in flight together
+        std::size_t in_flight; // Bytes held by memory in flight
+        std::size_t peak; // Most bytes held at once since the last resetPeak
+        double wait_seconds; // Time spent blocked in acquire since the last resetPeak
+        std::mutex budget_mutex; // Mutex over the counters
+        std::condition_variable released; // Signalled whenever memory in flight is released
+
+    public:
+
+        /** @brief Constructor for the MemoryBudget
+         * @param _limit Bytes the job may hold at once
+         */
+        explicit MemoryBudget(const std::size_t _limit):
+            limit(_limit),
+            spill_limit(static_cast<std::size_t>(static_cast<double>(_limit) * (1 - MEMORY_HEADROOM_SHARE))),
+            used(0),
+            in_flight(0),
+            peak(0),
+            wait_seconds(0) {}
+
+        /** @brief Returns the number of bytes the job may hold at once */
+        std::size_t limitBytes() const { return limit; }
+
+        /** @brief Returns the number of bytes spillable memory may take up: the limit less the headroom */
+        std::size_t spillLimitBytes() const { return spill_limit; }
+
+        /** @brief Reserves spillable memory if it fits below the limit less the headroom. Never blocks
+         * @param bytes Bytes to reserve
+         * @return False if the memory is not granted, in which case the caller should spill what it holds
+         */
+        bool tryAcquire(const std::size_t bytes);
+
+        /** @brief Reserves memory in flight, blocking while it does not fit into the headroom or below the limit.
+         * Granted at once if no other memory is in flight, so a single batch larger than the headroom still gets through
+         * @param bytes Bytes to reserve
+         */
+        void acquire(const std::size_t bytes);
+
+        /** @brief Gives back spillable memory reserved by tryAcquire */
+        void release(const std::size_t bytes);
+
+        /** @brief Gives back memory in flight reserved by acquire, waking up blocked producers */
+        void releaseInFlight(const std::size_t bytes);
+
+        /** @brief Returns the number of bytes held right now */
+        std::size_t bytesUsed();
+
+        /** @brief Returns the most bytes held at once since the last resetPeak */
+        std::size_t peakBytes();
+
+        /** @brief Returns the time producers spent blocked in acquire since the last resetPeak */
+        double waitSeconds();
+
+        /** @brief Starts measuring the peak and the time blocked anew, e.g. at the start of a phase */
+        void resetPeak();
+    };
+
+    // ----- Definitions ------
+
+    inline bool MemoryBudget::tryAcquire(const std::size_t bytes) {
+        std::scoped_lock budget_lock{budget_mutex};
+        if (used - in_flight + bytes > spill_limit || used + bytes > limit)
+            return false;
+        used += bytes;
+        peak = std::max(peak, used);
+        return true;
+    }
+
+    inline void MemoryBudget::acquire(const std::size_t bytes) {
+        std::unique_lock budget_lock{budget_mutex};
+        // Memory in flight keeps to the headroom, so it never crowds out spillable memory
+        auto fits = [&]() { return (used + bytes <= limit && in_flight + bytes <= limit - spill_limit) || in_flight == 0; };
+        if (!fits()) {
+            const auto wait_start = std::chrono::steady_clock::now();
+            released.wait(budget_lock, fits);
+            wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+        }
+        used += bytes;
+        in_flight += bytes;
+        peak = std::max(peak, used);
+    }
+
+    inline void MemoryBudget::release(const std::size_t bytes) {
+        std::scoped_lock budget_lock{budget_mutex};
+        used -= std::min(bytes, used - in_flight);
+    }
+
+    inline void MemoryBudget::releaseInFlight(const std::size_t bytes) {
+        {
+            std::scoped_lock budget_lock{budget_mutex};
+            const std::size_t released_bytes = std::min(bytes, in_flight);
+            used -= released_bytes;
+            in_flight -= released_bytes;
+        }
+        released.notify_all();
+    }
+
+    inline std::size_t MemoryBudget::bytesUsed() {
+        std::scoped_lock budget_lock{budget_mutex};
+        return used;
+    }
+
+    inline std::size_t MemoryBudget::peakBytes() {
+        std::scoped_lock budget_lock{budget_mutex};
+        return peak;
+    }
+
+    inline double MemoryBudget::waitSeconds() {
+        std::scoped_lock budget_lock{budget_mutex};
+        return wait_seconds;
+    }
+
+    inline void MemoryBudget::resetPeak() {
+        std::scoped_lock budget_lock{budget_mutex};
+        peak = used;
+        wait_seconds = 0;
+    }
+}
@@ -0,0 +1,314 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <functional>
+#include <fstream>
+#include <ostream>
+#include <filesystem>
+#include <algorithm>
+#include <iterator>
+#include <typeinfo>
+#include <utility>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <reduse/options.hpp>
+#include <reduse/records.hpp>
+#include <reduse/run.hpp>
+#include <reduse/io.hpp>
+#include <reduse/serialization.hpp>
+
+namespace reduse {
+
+    const std::uint64_t CHUNK_HASH_SEED = 0x9E3779B97F4A7C15ull; // Hash of an empty byte range, and of an empty chain of chunks
+
+    /** @brief Returns a 64-bit hash of a byte range, taking 8 bytes at a time. Not cryptographic
+     * @param bytes Bytes to hash
+     * @param seed Starting value. Hashing a range with the hash of another as seed chains the two
+     */
+    inline std::uint64_t hashBytes(std::string_view bytes, std::uint64_t seed = CHUNK_HASH_SEED);
+
+    /** @brief Record aligned slice of an input whose map output is cached on its own */
+    struct InputChunk {
+        std::size_t offset; // Offset of the chunk in the input
+        std::size_t length; // Bytes of the chunk
+        std::uint64_t hash; // Hash of the chunk's contents
+        bool complete; // The chunk ends before the input does, so it stays the same as long as the input only grows
+    };
+
+    /** @brief Directory of sorted map output cached per input chunk, for incremental reruns over a growing input. A
+     * chunk is named after its job, offset, length and content hash, so a chunk that changed is never mistaken for its
+     * old contents. The job hashes the input name, Options::cache_tag, the record format and the key and value types,
+     * so several jobs and inputs may share a directory without reusing or pruning each other's runs. Every cached run is stored as a binary run file along with its sparse index, and becomes a spilled
+     * SortedRun again on a rerun. A base run folds the map output of a prefix of the input into one record per key
+     * @param key Data type of the key of a record
+     * @param value Data type of the value of a record
+     */
+    template<typename key, typename value>
+    class ChunkCache {
+    public:
+
+        using run_type = SortedRun<key, value>; // A single sorted run
+
+    private:
+
+        const std::string directory; // Directory holding the cached runs
+        const RecordScanner scanner; // Finds the record boundaries of the input
+        const std::size_t chunk_size; // Bytes an input chunk covers at least, up to the next record boundary
+        const IoBackend io_backend; // How the cached runs are written
+        const std::string job; // Hash of the job definition and input, prefixing the names of its runs
+
+        /** @brief Returns the hash identifying the runs of a job over an input */
+        static std::string jobHash(const std::string& input_name, const Options& options);
+
+        /** @brief Returns the path of a file of the cache */
+        std::string path(const std::string& filename) const { return directory + "/" + filename; }
+
+    public:
+
+        /** @brief Constructor for the ChunkCache. Creates the directory if needed
+         * @param _directory Directory holding the cached runs
+         * @param options Tuning options holding the record format, the chunk size and the cache tag. See reduse::Options
+         * @param input_name Name of the input whose chunks are cached, e.g. its absolute path
+         */
+        ChunkCache(const std::string& _directory, const Options& options, const std::string& input_name = "");
+
+        /** @brief Splits an input into record aligned chunks of about Options::cache_chunk_size bytes and hashes them.
+         * The chunks of an input that only grew since the last run keep their boundaries, except for the last one
+         * @param input Whole input
+         */
+        std::vector<InputChunk> split(std::string_view input) const;
+
+        /** @brief Returns the name of the cached run of a chunk */
+        std::string chunkName(const InputChunk& chunk) const;
+
+        /** @brief Returns the name of the base run folding the first num_chunks chunks of an input
+         * @param num_chunks Number of chunks covered
+         * @param chain Hashes of the chunks covered, chained by hashBytes
+         */
+        std::string baseName(const std::size_t num_chunks, const std::uint64_t chain) const;
+
+        /** @brief Returns a cached run, or nothing if it is not in the cache
+         * @param name Name of the run
+         */
+        std::optional<run_type> load(const std::string& name) const;
+
+        /** @brief Merges runs into a new cached run and returns it. The run only becomes visible to load once it has
+         * been written whole
+         * @param name Name of the run
+         * @param runs Runs to merge
+         * @param fold Folds the values of a key into a single one, so the run holds one record per key. Every value is
+         * kept if unset
+         */
+        run_type store(
+            const std::string& name,
+            std::vector<run_type>& runs,
+            const std::function<value(const key&, std::vector<value>&)>& fold = nullptr
+        ) const;
+
+        /** @brief Removes every cached run of this job that is not named in live, e.g. the runs of chunks that changed.
+         * The runs of other jobs are left alone
+         */
+        void prune(const std::vector<std::string>& live) const;
+    };
+
+    // ----- Definitions ------
+
+    inline std::uint64_t hashBytes(std::string_view bytes, std::uint64_t seed) {
+        const std::uint64_t prime = 0x100000001B3ull;
+        std::uint64_t hash = seed ^ (bytes.size() * prime);
+        std::size_t i = 0;
+        for(; i + sizeof(std::uint64_t) <= bytes.size(); i += sizeof(std::uint64_t)) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 29;
+        }
+        for(; i < bytes.size(); i++)
+            hash = (hash ^ static_cast<unsigned char>(bytes[i])) * prime;
+        return hash ^ (hash >> 32);
+    }
+
+    template<typename key, typename value>
+    std::string ChunkCache<key, value>::jobHash(const std::string& input_name, const Options& options) {
+        // Every part is length-prefixed by hashBytes, so neighbouring parts cannot run into each other
+        std::uint64_t hash = hashBytes(input_name);
+        hash = hashBytes(options.cache_tag, hash);
+        hash = hashBytes(typeid(key).name(), hash);
+        hash = hashBytes(typeid(value).name(), hash);
+        const std::uint64_t format[] = {
+            static_cast<std::uint64_t>(options.record_format),
+            static_cast<std::uint64_t>(static_cast<unsigned char>(options.record_delimiter)),
+            options.record_width,
+            static_cast<std::uint64_t>(static_cast<unsigned char>(options.csv_separator))
+        };
+        hash = hashBytes(std::string_view(reinterpret_cast<const char*>(format), sizeof(format)), hash);
+        hash = hashBytes(std::string_view(reinterpret_cast<const char*>(options.csv_fields.data()), options.csv_fields.size() * sizeof(std::size_t)), hash);
+        char job[17];
+        std::snprintf(job, sizeof(job), "%016llx", static_cast<unsigned long long>(hash));
+        return job;
+    }
+
+    template<typename key, typename value>
+    ChunkCache<key, value>::ChunkCache(const std::string& _directory, const Options& options, const std::string& input_name):
+        directory(_directory),
+        scanner(options),
+        chunk_size(options.cache_chunk_size > 0 ? options.cache_chunk_size : DEFAULT_CACHE_CHUNK_SIZE),
+        io_backend(options.io_backend),
+        job(jobHash(input_name, options)) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (!std::filesystem::is_directory(directory))
+            throw std::runtime_error("Cannot create cache directory: " + directory);
+    }
+
+    template<typename key, typename value>
+    std::vector<InputChunk> ChunkCache<key, value>::split(std::string_view input) const {
+        // Every boundary is searched from the previous one, so earlier chunks never move when the input grows
+        std::vector<InputChunk> chunks;
+        std::size_t begin = 0;
+        while(begin < input.size()) {
+            const std::string_view rest = input.substr(begin);
+            const std::size_t length = scanner.nextBoundary(rest, std::min(chunk_size, rest.size()));
+            chunks.push_back({begin, length, hashBytes(rest.substr(0, length)), length < rest.size()});
+            begin += length;
+        }
+        return chunks;
+    }
+
+    template<typename key, typename value>
+    std::string ChunkCache<key, value>::chunkName(const InputChunk& chunk) const {
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(chunk.hash));
+        return "chunk_" + job + "_" + std::to_string(chunk.offset) + "_" + std::to_string(chunk.length) + "_" + hash;
+    }
+
+    template<typename key, typename value>
+    std::string ChunkCache<key, value>::baseName(const std::size_t num_chunks, const std::uint64_t chain) const {
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(chain));
+        return "base_" + job + "_" + std::to_string(num_chunks) + "_" + hash;
+    }
+
+    template<typename key, typename value>
+    std::optional<typename ChunkCache<key, value>::run_type> ChunkCache<key, value>::load(const std::string& name) const {
+        // The index is written last, so a run without one was never finished
+        std::ifstream index_file(path(name + ".index"), std::ios::in | std::ios::binary);
+        if (!index_file.is_open() || !std::filesystem::exists(path(name + ".run")))
+            return std::nullopt;
+        BinaryReader reader(index_file);
+        run_type run;
+        run.filename = path(name + ".run");
+        run.format = Format::BINARY;
+        std::uint64_t size, entries;
+        if (!reader.read(&size, sizeof(size)) || !reader.read(&entries, sizeof(entries)))
+            return std::nullopt;
+        run.size = size;
+        run.index.resize(entries);
+        for(auto &entry: run.index) {
+            std::int64_t offset;
+            std::uint64_t position;
+            if (!Serializer<key>::read(reader, entry.first) || !reader.read(&offset, sizeof(offset)) || !reader.read(&position, sizeof(position)))
+                return std::nullopt;
+            entry.offset = offset;
+            entry.position = position;
+        }
+        return run;
+    }
+
+    template<typename key, typename value>
+    typename ChunkCache<key, value>::run_type ChunkCache<key, value>::store(
+        const std::string& name,
+        std::vector<run_type>& runs,
+        const std::function<value(const key&, std::vector<value>&)>& fold
+    ) const {
+        run_type run;
+        run.filename = path(name + ".run");
+        run.format = Format::BINARY;
+
+        // Write the merged records, indexing every RUN_INDEX_INTERVAL-th one
+        {
+            FileWriteBuffer run_buffer(run.filename + ".tmp", io_backend);
+            std::ostream output(&run_buffer);
+            RecordWriter<key, value> writer(output, Format::BINARY);
+            auto write = [&](const std::pair<key, value>& record) {
+                if (run.size % RUN_INDEX_INTERVAL == 0)
+                    run.index.push_back({record.first, writer.offset(), run.size});
+                writer.write(record);
+                run.size++;
+            };
+            if (fold) {
+                // The values of a key arrive together, so a group ends as soon as the key changes
+                std::optional<key> curr_key;
+                std::vector<value> curr_values;
+                auto flush = [&]() {
+                    if (curr_values.size() == 1)
+                        write({*curr_key, std::move(curr_values.front())});
+                    else
+                        write({*curr_key, fold(*curr_key, curr_values)});
+                    curr_values.clear();
+                };
+                mergeRuns(runs, std::optional<key>(), std::optional<key>(), [&](std::pair<key, value>& record) {
+                    if (curr_key && !(record.first == *curr_key))
+                        flush();
+                    if (curr_values.empty())
+                        curr_key = record.first;
+                    curr_values.push_back(std::move(record.second));
+                });
+                if (!curr_values.empty())
+                    flush();
+            } else {
+                mergeRuns(runs, std::optional<key>(), std::optional<key>(), write);
+            }
+            writer.flush();
+            if (!output)
+                throw std::runtime_error("Cannot write cached run: " + run.filename);
+            run_buffer.close();
+        }
+
+        // Write the index, then move both files in place
+        {
+            std::ofstream index_file(path(name + ".index.tmp"), std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!index_file.is_open())
+                throw std::runtime_error("Cannot open cached run index: " + path(name + ".index.tmp"));
+            BinaryWriter writer(index_file);
+            const std::uint64_t size = run.size, entries = run.index.size();
+            writer.write(&size, sizeof(size));
+            writer.write(&entries, sizeof(entries));
+            for(auto &entry: run.index) {
+                const std::int64_t offset = entry.offset;
+                const std::uint64_t position = entry.position;
+                Serializer<key>::write(writer, entry.first);
+                writer.write(&offset, sizeof(offset));
+                writer.write(&position, sizeof(position));
+            }
+            writer.flush();
+            if (!index_file)
+                throw std::runtime_error("Cannot write cached run index: " + path(name + ".index.tmp"));
+        }
+        std::filesystem::rename(run.filename + ".tmp", run.filename);
+        std::filesystem::rename(path(name + ".index.tmp"), path(name + ".index"));
+        return run;
+    }
+
+    template<typename key, typename value>
+    void ChunkCache<key, value>::prune(const std::vector<std::string>& live) const {
+        std::vector<std::filesystem::path> stale;
+        for(auto &entry: std::filesystem::directory_iterator(directory)) {
+            const std::string filename = entry.path().filename().string();
+            const std::string name = filename.substr(0, filename.find('.'));
+            if (name.rfind("chunk_" + job + "_", 0) != 0 && name.rfind("base_" + job + "_", 0) != 0)
+                continue;
+            if (std::find(live.begin(), live.end(), name) == live.end())
+                stale.push_back(entry.path());
+        }
+        for(auto &stale_path: stale) {
+            std::error_code error;
+            std::filesystem::remove(stale_path, error);
+        }
+    }
+}
@@ -0,0 +1,558 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <exception>
+#include <reduse/options.hpp>
+#include <reduse/partitioner.hpp>
+#include <reduse/emitter.hpp>
+#include <reduse/sorter.hpp>
+#include <reduse/combiner.hpp>
+#include <reduse/mapper.hpp>
+#include <reduse/reducer.hpp>
+#include <reduse/stats.hpp>
+#include <reduse/thread_pool.hpp>
+#include <reduse/budget.hpp>
+#include <reduse/reduse.hpp>
+
+namespace reduse {
+
+    /** @brief Indicates if MapFn can be used as the MAP of a chained stage: either returning a std::pair<key, value> for
+     * a result of the stage before, taken as its key and value, or emitting pairs for it into an Emitter<key, value>
+     */
+    template<typename MapFn, typename in_key, typename in_value, typename key, typename value>
+    inline constexpr bool is_chain_map_v =
+        std::is_invocable_v<MapFn&, const in_key&, const in_value&, Emitter<key, value>&> ||
+        std::is_invocable_r_v<std::pair<key, value>, MapFn&, const in_key&, const in_value&>;
+
+    /** @brief A MapReduce stage of a Chain, producing one result of type value per key of type key. Running a stage runs
+     * every stage before it, each feeding its results straight into the MAP of the next
+     * @param key Data type of the key of a result
+     * @param value Data type of a result
+     */
+    template<typename key, typename value>
+    class Stage {
+    public:
+
+        using sink_factory = std::function<std::unique_ptr<ResultSink<key, value>>()>; // Creates the sink of a reducer worker
+
+    protected:
+
+        std::string materialize_filename; // File the results are written to when they feed another stage. None if empty
+
+    public:
+
+        virtual ~Stage() = default;
+
+        /** @brief Also writes the results of the stage to a file of "key result" lines when they feed another stage */
+        void materialize(const std::string& filename) { materialize_filename = filename; }
+
+        /** @brief Returns the file the results are written to when they feed another stage. Empty if they are not */
+        const std::string& materialized() const { return materialize_filename; }
+
+        /** @brief Returns the number of reducer workers, which feed the next stage concurrently */
+        virtual int workerCount() const = 0;
+
+        /** @brief Returns the name the spill files of the stage start with. Every run adds a suffix of its own to it */
+        virtual std::string spillPrefix() const = 0;
+
+        /** @brief Returns the smallest Options::memory_budget of this stage and the stages before it. 0 if none is set */
+        virtual std::size_t memoryBudget() const = 0;
+
+        /** @brief Runs every stage up to this one on a pool
+         * @param pool Pool running the workers of every stage
+         * @param memory_budget Budget shared by every stage, as the map phase of a stage overlaps the reduce phase of
+         * the stage before. None if null
+         * @param make_sink Creates the sink of every reducer worker. Results only go to output_filename if unset
+         * @param output_filename File the results are written to. None if empty
+         * @param verbose Set true if you want the a verbose output. Useful for debugging
+         * @param stats Receives the statistics of every stage, the first stage first
+         */
+        virtual void run(
+            const std::shared_ptr<ThreadPool>& pool,
+            const std::shared_ptr<MemoryBudget>& memory_budget,
+            const sink_factory& make_sink,
+            const std::string& output_filename,
+            const bool verbose,
+            std::vector<JobStats>& stats
+        ) = 0;
+    };
+
+    /** @brief Reduces the shuffle of a stage into sinks or an output file. A stage feeding another one neither sorts
+     * its output nor cuts its partitions into key ranges, as the next stage groups the results anew
+     */
+    template<typename map_key, typename map_value, typename reduce_value, typename ReduceFn>
+    PhaseStats runStageReducer(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::shared_ptr<ExternalSorter<map_key, map_value>>& shuffle,
+        const std::shared_ptr<MemoryBudget>& memory_budget,
+        ReduceFn& REDUCE,
+        const typename Stage<map_key, reduce_value>::sink_factory& make_sink,
+        const std::string& output_filename,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
+    ) {
+        Options stage_options = options;
+        if (make_sink)
+            stage_options.sorted_output = false;
+        Reducer<map_key, map_value, reduce_value> reducer(shuffle, output_filename, REDUCE, num_reducers, verbose, stage_options);
+        reducer.setPool(pool);
+        reducer.setMemoryBudget(memory_budget);
+        reducer.setResultSink(make_sink);
+        return reducer.run();
+    }
+
+    /** @brief Returns the number of partitions of the shuffle of a stage. Only the last stage may sort its output */
+    inline std::size_t stagePartitions(const int num_reducers, const bool feeds_stage, const Options& options) {
+        return num_reducers > 0 && (feeds_stage || !options.sorted_output) ? num_reducers : 1;
+    }
+
+    /** @brief First stage of a Chain, mapping the records of an input file like reduse::reduse */
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    class InputStage final: public Stage<map_key, reduce_value> {
+    private:
+
+        const std::string input_filename; // Input filename
+        MapFn MAP; // The mapper function
+        ReduceFn REDUCE; // The reducer function
+        const int num_mappers; // Number of mapper workers
+        const int num_reducers; // Number of reducer workers
+        const Options options; // Tuning options
+        std::function<map_value(const map_key&, std::vector<map_value>&)> COMBINE; // REDUCE as the combiner with Options::associative_reduce. Empty otherwise
+
+    public:
+
+        /** @brief Constructor for the InputStage. See Chain::source */
+        InputStage(
+            const std::string& _input_filename,
+            MapFn _MAP,
+            ReduceFn _REDUCE,
+            const int _num_mappers,
+            const int _num_reducers,
+            const Options& _options
+        ):  input_filename(_input_filename),
+            MAP(std::move(_MAP)),
+            REDUCE(std::move(_REDUCE)),
+            num_mappers(_num_mappers),
+            num_reducers(_num_reducers),
+            options(_options),
+            COMBINE(associativeCombiner<map_key, map_value, reduce_value>(REDUCE, _options)) {}
+
+        int workerCount() const override { return num_reducers; }
+
+        std::string spillPrefix() const override { return input_filename + "_map_output.txt"; }
+
+        std::size_t memoryBudget() const override { return options.memory_budget; }
+
+        void run(
+            const std::shared_ptr<ThreadPool>& pool,
+            const std::shared_ptr<MemoryBudget>& memory_budget,
+            const typename Stage<map_key, reduce_value>::sink_factory& make_sink,
+            const std::string& output_filename,
+            const bool verbose,
+            std::vector<JobStats>& stats
+        ) override;
+    };
+
+    /** @brief Stage of a Chain mapping the results of the stage before it. The reducer workers of the stage before
+     * run MAP over their results and route the emitted pairs into this stage's shuffle, so the results never pass
+     * through text. Pairs beyond the sort memory budget are spilled in Options::spill_format
+     */
+    template<
+        typename in_key,
+        typename in_value,
+        typename map_key,
+        typename map_value,
+        typename reduce_value,
+        typename Partitioner,
+        typename MapFn,
+        typename ReduceFn
+    >
+    class ChainedStage final: public Stage<map_key, reduce_value> {
+    private:
+
+        const std::shared_ptr<Stage<in_key, in_value>> upstream; // Stage whose results are mapped
+        MapFn MAP; // The mapper function, taking a result of the stage before
+        ReduceFn REDUCE; // The reducer function
+        const int num_reducers; // Number of reducer workers
+        const Options options; // Tuning options
+        std::function<map_value(const map_key&, std::vector<map_value>&)> COMBINE; // REDUCE as the combiner with Options::associative_reduce. Empty otherwise
+        Partitioner partitioner; // Assigns every mapped pair to a partition of the shuffle
+
+        /** @brief Routes the pairs mapped by a single upstream worker into the shuffle, through an optional combine table */
+        class Router final: public Emitter<map_key, map_value> {
+        private:
+
+            ChainedStage& stage; // Stage owning the shuffle
+            ExternalSorter<map_key, map_value>& shuffle; // Shuffle receiving the pairs
+            SortBuffer<map_key, map_value> sort_buffer; // Worker's sort buffer
+            std::optional<CombineTable<map_key, map_value>> combine_table; // Worker's combine table. Empty without COMBINE
+
+            /** @brief Hands a pair to the sort buffer of its partition */
+            void route(std::pair<map_key, map_value>&& new_pair);
+
+        protected:
+
+            void push(std::pair<map_key, map_value>&& new_pair) override;
+
+        public:
+
+            std::size_t routed; // Number of pairs handed to the shuffle
+
+            /** @brief Constructor for the Router
+             * @param _stage Stage owning the shuffle
+             * @param _shuffle Shuffle receiving the pairs
+             * @param memory_budget Job-wide budget of the combine table. None if null
+             */
+            Router(ChainedStage& _stage, ExternalSorter<map_key, map_value>& _shuffle, MemoryBudget* memory_budget);
+
+            /** @brief Flushes the combine table and hands the remaining pairs over as in-memory runs */
+            void close();
+        };
+
+        /** @brief Sink of a reducer worker of the stage before. Maps every result as it is reduced */
+        class ShuffleSink final: public ResultSink<in_key, in_value> {
+        private:
+
+            ChainedStage& stage; // Stage whose MAP is applied
+            Router router; // Routes the mapped pairs into the shuffle
+            std::size_t results; // Number of results mapped
+            PhaseStats& stats; // Map statistics of the stage
+            std::mutex& stats_mutex; // Mutex over stats
+
+        protected:
+
+            void push(std::pair<in_key, in_value>&& result) override;
+
+        public:
+
+            /** @brief Constructor for the ShuffleSink
+             * @param _stage Stage whose MAP is applied
+             * @param shuffle Shuffle receiving the mapped pairs
+             * @param memory_budget Job-wide budget of the combine table. None if null
+             * @param _stats Map statistics of the stage
+             * @param _stats_mutex Mutex over _stats
+             */
+            ShuffleSink(
+                ChainedStage& _stage,
+                ExternalSorter<map_key, map_value>& shuffle,
+                MemoryBudget* memory_budget,
+                PhaseStats& _stats,
+                std::mutex& _stats_mutex
+            ):  stage(_stage),
+                router(_stage, shuffle, memory_budget),
+                results(0),
+                stats(_stats),
+                stats_mutex(_stats_mutex) {}
+
+            void close() override;
+        };
+
+    public:
+
+        /** @brief Constructor for the ChainedStage. See Chain::then */
+        ChainedStage(
+            const std::shared_ptr<Stage<in_key, in_value>>& _upstream,
+            MapFn _MAP,
+            ReduceFn _REDUCE,
+            const int _num_reducers,
+            const Options& _options
+        ):  upstream(_upstream),
+            MAP(std::move(_MAP)),
+            REDUCE(std::move(_REDUCE)),
+            num_reducers(_num_reducers),
+            options(_options),
+            COMBINE(associativeCombiner<map_key, map_value, reduce_value>(REDUCE, _options)) {}
+
+        int workerCount() const override { return num_reducers; }
+
+        std::string spillPrefix() const override { return upstream->spillPrefix() + "_next"; }
+
+        std::size_t memoryBudget() const override {
+            const std::size_t upstream_budget = upstream->memoryBudget();
+            if (options.memory_budget == 0 || upstream_budget == 0)
+                return std::max(options.memory_budget, upstream_budget);
+            return std::min(options.memory_budget, upstream_budget);
+        }
+
+        void run(
+            const std::shared_ptr<ThreadPool>& pool,
+            const std::shared_ptr<MemoryBudget>& memory_budget,
+            const typename Stage<map_key, reduce_value>::sink_factory& make_sink,
+            const std::string& output_filename,
+            const bool verbose,
+            std::vector<JobStats>& stats
+        ) override;
+    };
+
+    /** @brief Builds and runs multi-stage jobs, where every stage maps the (key, result) pairs of the stage before it
+     * instead of lines of text. The results of a stage are handed to the MAP of the next one as they are reduced, and
+     * the next shuffle keeps them in memory or spills them in the binary run format, so intermediate results are only
+     * written as text when a stage is materialized. Owns a thread pool shared by the workers of every stage, and of
+     * every chain run through it. Options::encode_keys, cache_directory and pipelined do not apply to stages
+     */
+    class Chain {
+    private:
+
+        const std::shared_ptr<ThreadPool> pool; // Pool running the workers of every stage
+
+    public:
+
+        /** @brief Constructor for the Chain. Starts the worker threads
+         * @param num_threads Number of worker threads. Set to the number of hardware threads by default
+         */
+        explicit Chain(const int num_threads = static_cast<int>(std::thread::hardware_concurrency())):
+            pool(std::make_shared<ThreadPool>(num_threads)) {}
+
+        /** @brief Returns the number of worker threads */
+        int threadCount() const { return pool->size(); }
+
+        /** @brief Returns the first stage of a chain, mapping the records of an input file. Takes the same arguments as
+         * reduse::reduse, but for the output filename
+         */
+        template<
+            typename map_key,
+            typename map_value,
+            typename reduce_value,
+            typename Partitioner = HashPartitioner<map_key>,
+            typename MapFn,
+            typename ReduceFn,
+            typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+        >
+        std::shared_ptr<Stage<map_key, reduce_value>> source(
+            const std::string& input_filename,
+            MapFn&& MAP,
+            ReduceFn&& REDUCE,
+            const int num_mappers = DEFAULT_NUM_MAPPERS,
+            const int num_reducers = DEFAULT_NUM_REDUCERS,
+            const Options& options = Options()
+        ) {
+            return std::make_shared<InputStage<map_key, map_value, reduce_value, Partitioner, std::decay_t<MapFn>, std::decay_t<ReduceFn>>>(
+                input_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), num_mappers, num_reducers, options
+            );
+        }
+
+        /** @brief Returns a stage mapping the results of another stage
+         * @param upstream Stage whose results are mapped
+         * @param MAP The mapper function, callable as std::pair<map_key, map_value>(const in_key&, const in_value&) or
+         * void(const in_key&, const in_value&, reduse::Emitter<map_key, map_value>&). Called concurrently by the reducer
+         * workers of upstream
+         * @param REDUCE The reducer function. See reduse::reduse
+         * @param num_reducers Number of reducer workers. Set to 1 by default
+         * @param options Tuning options of the stage. See reduse::Options
+         */
+        template<
+            typename map_key,
+            typename map_value,
+            typename reduce_value,
+            typename Partitioner = HashPartitioner<map_key>,
+            typename in_key,
+            typename in_value,
+            typename MapFn,
+            typename ReduceFn,
+            typename = std::enable_if_t<is_chain_map_v<MapFn, in_key, in_value, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+        >
+        std::shared_ptr<Stage<map_key, reduce_value>> then(
+            const std::shared_ptr<Stage<in_key, in_value>>& upstream,
+            MapFn&& MAP,
+            ReduceFn&& REDUCE,
+            const int num_reducers = DEFAULT_NUM_REDUCERS,
+            const Options& options = Options()
+        ) {
+            return std::make_shared<ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, std::decay_t<MapFn>, std::decay_t<ReduceFn>>>(
+                upstream, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), num_reducers, options
+            );
+        }
+
+        /** @brief Runs a stage and every stage before it on the chain's workers. Returns the statistics of every stage,
+         * the first stage first. The map phase of a chained stage runs within the reduce phase of the stage before, so
+         * every stage holds its memory under a single budget: the smallest Options::memory_budget of the stages
+         * @param last Stage whose results are written to output_filename, the same way reduse::reduse writes them
+         * @param output_filename Output file
+         * @param verbose Set true if you want the a verbose output. Useful for debugging
+         */
+        template<typename key, typename value>
+        std::vector<JobStats> run(const std::shared_ptr<Stage<key, value>>& last, const std::string& output_filename, const bool verbose = false) {
+            std::vector<JobStats> stats;
+            std::shared_ptr<MemoryBudget> memory_budget;
+            if (last->memoryBudget() > 0)
+                memory_budget = std::make_shared<MemoryBudget>(last->memoryBudget());
+            last->run(pool, memory_budget, nullptr, output_filename, verbose, stats);
+            return stats;
+        }
+    };
+
+    // ----- Definitions ------
+
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void InputStage<map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::run(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::shared_ptr<MemoryBudget>& memory_budget,
+        const typename Stage<map_key, reduce_value>::sink_factory& make_sink,
+        const std::string& output_filename,
+        const bool verbose,
+        std::vector<JobStats>& stats
+    ) {
+        auto shuffle = std::make_shared<ExternalSorter<map_key, map_value>>(
+            jobSpillPrefix(spillPrefix()),
+            sortBufferBudget(options, num_mappers),
+            stagePartitions(num_reducers, static_cast<bool>(make_sink), options),
+            options.spill_format,
+            options.io_backend
+        );
+        if (memory_budget && options.shuffle_mode == ShuffleMode::AUTO)
+            shuffle->setMemoryBudget(memory_budget);
+        JobStats job;
+        PhaseTimer timer;
+        try {
+            Mapper<map_key, map_value, Partitioner> mapper(input_filename, shuffle, MAP, num_mappers, verbose, options);
+            if (COMBINE)
+                mapper.setCombiner(COMBINE);
+            mapper.setPool(pool);
+            mapper.setMemoryBudget(memory_budget);
+            job.map = mapper.run();
+            job.reduce = runStageReducer<map_key, map_value, reduce_value>(
+                pool, shuffle, memory_budget, REDUCE, make_sink, output_filename, num_reducers, verbose, options
+            );
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            shuffle->clear();
+            std::terminate();
+        }
+        PhaseStats total;
+        timer.stop(total);
+        job.wall_seconds = total.wall_seconds;
+        if (verbose) {
+            std::cout << "Stage " << stats.size() << " map phase: " << job.map << std::endl;
+            std::cout << "Stage " << stats.size() << " reduce phase: " << job.reduce << std::endl;
+        }
+        stats.push_back(job);
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::run(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::shared_ptr<MemoryBudget>& memory_budget,
+        const typename Stage<map_key, reduce_value>::sink_factory& make_sink,
+        const std::string& output_filename,
+        const bool verbose,
+        std::vector<JobStats>& stats
+    ) {
+        // Every reducer worker of the stage before fills a sort buffer of its own
+        auto shuffle = std::make_shared<ExternalSorter<map_key, map_value>>(
+            jobSpillPrefix(spillPrefix()),
+            sortBufferBudget(options, upstream->workerCount()),
+            stagePartitions(num_reducers, static_cast<bool>(make_sink), options),
+            options.spill_format,
+            options.io_backend
+        );
+        if (memory_budget && options.shuffle_mode == ShuffleMode::AUTO)
+            shuffle->setMemoryBudget(memory_budget);
+        JobStats job;
+        PhaseTimer timer;
+
+        // The stage before maps its results into the shuffle while it reduces them
+        std::mutex map_mutex;
+        upstream->run(
+            pool,
+            memory_budget,
+            [&]() -> std::unique_ptr<ResultSink<in_key, in_value>> {
+                return std::make_unique<ShuffleSink>(*this, *shuffle, memory_budget.get(), job.map, map_mutex);
+            },
+            upstream->materialized(),
+            verbose,
+            stats
+        );
+        job.map.wall_seconds = stats.back().reduce.wall_seconds;
+        job.map.cpu_seconds = stats.back().reduce.cpu_seconds;
+        job.map.peak_memory = stats.back().reduce.peak_memory;
+        job.map.spill_files = shuffle->spillCount();
+        job.map.bytes_out = shuffle->spilledBytes();
+
+        try {
+            job.reduce = runStageReducer<map_key, map_value, reduce_value>(
+                pool, shuffle, memory_budget, REDUCE, make_sink, output_filename, num_reducers, verbose, options
+            );
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            shuffle->clear();
+            std::terminate();
+        }
+        PhaseStats total;
+        timer.stop(total);
+        job.wall_seconds = total.wall_seconds;
+        if (verbose) {
+            std::cout << "Stage " << stats.size() << " map phase: " << job.map << std::endl;
+            std::cout << "Stage " << stats.size() << " reduce phase: " << job.reduce << std::endl;
+        }
+        stats.push_back(job);
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::Router::Router(
+        ChainedStage& _stage,
+        ExternalSorter<map_key, map_value>& _shuffle,
+        MemoryBudget* memory_budget
+    ):  stage(_stage),
+        shuffle(_shuffle),
+        sort_buffer(_shuffle),
+        routed(0) {
+        const std::size_t combine_budget = stage.options.memory_budget > 0
+            ? std::min(stage.options.combine_memory_budget, stage.options.memory_budget)
+            : stage.options.combine_memory_budget;
+        if (stage.COMBINE && combine_budget > 0)
+            combine_table.emplace(
+                stage.COMBINE,
+                combine_budget / (stage.upstream->workerCount() > 0 ? stage.upstream->workerCount() : 1),
+                memory_budget
+            );
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::Router::route(std::pair<map_key, map_value>&& new_pair) {
+        const std::size_t num_partitions = shuffle.partitionCount();
+        sort_buffer.push(num_partitions > 1 ? stage.partitioner(new_pair.first, num_partitions) : 0, std::move(new_pair));
+        routed++;
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::Router::push(std::pair<map_key, map_value>&& new_pair) {
+        if (combine_table)
+            combine_table->add(std::move(new_pair), [&](std::pair<map_key, map_value>&& partial) { route(std::move(partial)); });
+        else
+            route(std::move(new_pair));
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::Router::close() {
+        if (combine_table)
+            combine_table->flush([&](std::pair<map_key, map_value>&& partial) { route(std::move(partial)); });
+        sort_buffer.close();
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::ShuffleSink::push(std::pair<in_key, in_value>&& result) {
+        results++;
+        if constexpr (std::is_invocable_v<MapFn&, const in_key&, const in_value&, Emitter<map_key, map_value>&>)
+            stage.MAP(std::as_const(result.first), std::as_const(result.second), router);
+        else
+            router.emplace(stage.MAP(std::as_const(result.first), std::as_const(result.second)));
+    }
+
+    template<typename in_key, typename in_value, typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    void ChainedStage<in_key, in_value, map_key, map_value, reduce_value, Partitioner, MapFn, ReduceFn>::ShuffleSink::close() {
+        router.close();
+        std::scoped_lock stats_lock{stats_mutex};
+        stats.records_in += results;
+        stats.records_out += router.routed;
+    }
+}
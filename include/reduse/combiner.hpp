@@ -0,0 +1,135 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <reduse/memory.hpp>
+#include <reduse/budget.hpp>
+
+namespace reduse {
+
+    const std::size_t COMBINE_BATCH_SIZE = 32; // Number of pending values of a key that are folded by COMBINE at once
+    const std::size_t COMBINE_ENTRY_OVERHEAD = 64; // Approximate bytes a combine table spends on bookkeeping per key
+
+    /** @brief Indicates if std::hash is enabled for T */
+    template<typename T>
+    inline constexpr bool is_hashable_v = std::is_default_constructible_v<std::hash<T>>;
+
+    /** @brief Per-worker table folding map output by key before it is spilled (map-side pre-aggregation).
+     * Uses a hash table when std::hash is enabled for the key and an ordered map otherwise
+     * @param key Data type of the key of a record
+     * @param value Data type of the value of a record
+     */
+    template<typename key, typename value>
+    class CombineTable {
+    public:
+
+        using record_type = std::pair<key, value>; // A single record
+        using combine_type = std::function<value(const key&, std::vector<value>&)>; // Folds values of a key into one
+
+    private:
+
+        using table_type = std::conditional_t<
+            is_hashable_v<key>,
+            std::unordered_map<key, std::vector<value>>,
+            std::map<key, std::vector<value>>
+        >;
+
+        const combine_type& COMBINE; // Combiner routine
+        const std::size_t memory_budget; // Bytes the table may hold before it is flushed
+        MemoryBudget* const job_budget; // Job-wide budget the table reserves its memory from. None if null
+        table_type table; // Pending values of every key
+        std::size_t bytes; // Approximate memory held by table
+        std::size_t reserved; // Bytes reserved from job_budget
+
+        /** @brief Folds the pending values of a key into a single value */
+        void fold(const key& curr_key, std::vector<value>& curr_values);
+
+    public:
+
+        /** @brief Constructor for the CombineTable
+         * @param _COMBINE The combiner function. Must outlive the table
+         * @param _memory_budget Bytes the table may hold before all of its partial results are flushed
+         * @param _job_budget Job-wide budget the table reserves its memory from. The table is also flushed whenever the
+         * job budget runs short. Set to nullptr by default
+         */
+        CombineTable(const combine_type& _COMBINE, const std::size_t _memory_budget, MemoryBudget* const _job_budget = nullptr):
+            COMBINE(_COMBINE),
+            memory_budget(_memory_budget),
+            job_budget(_job_budget),
+            bytes(0),
+            reserved(0) {}
+
+        /** @brief Folds a record into the table, flushing the whole table once it outgrows its budget
+         * @param record Record to add
+         * @param emit Callable taking a std::pair<key, value>&& for every flushed partial result
+         */
+        template<typename Emit>
+        void add(record_type&& record, Emit&& emit);
+
+        /** @brief Emits one partial result per key and empties the table
+         * @param emit Callable taking a std::pair<key, value>&& for every partial result
+         */
+        template<typename Emit>
+        void flush(Emit&& emit);
+    };
+
+    // ----- Definitions ------
+
+    template<typename key, typename value>
+    void CombineTable<key, value>::fold(const key& curr_key, std::vector<value>& curr_values) {
+        for(auto &it: curr_values)
+            bytes -= memoryFootprint(it);
+        value combined = COMBINE(curr_key, curr_values);
+        bytes += memoryFootprint(combined);
+        curr_values.clear();
+        curr_values.push_back(std::move(combined));
+    }
+
+    template<typename key, typename value>
+    template<typename Emit>
+    void CombineTable<key, value>::add(record_type&& record, Emit&& emit) {
+        auto entry = table.find(record.first);
+        if (entry == table.end()) {
+            bytes += memoryFootprint(record.first) + COMBINE_ENTRY_OVERHEAD;
+            entry = table.emplace(std::move(record.first), std::vector<value>()).first;
+        }
+        bytes += memoryFootprint(record.second);
+        entry->second.push_back(std::move(record.second));
+
+        // Fold eagerly, so that a hot key only ever holds a handful of values
+        if (entry->second.size() >= COMBINE_BATCH_SIZE)
+            fold(entry->first, entry->second);
+
+        // Growth is reserved from the job budget in steps, and the table is flushed once the budget runs short
+        if (job_budget && bytes > reserved) {
+            const std::size_t step = std::max(bytes - reserved, COMBINE_BATCH_SIZE * COMBINE_ENTRY_OVERHEAD);
+            if (!job_budget->tryAcquire(step)) {
+                flush(emit);
+                return;
+            }
+            reserved += step;
+        }
+        if (bytes >= memory_budget)
+            flush(emit);
+    }
+
+    template<typename key, typename value>
+    template<typename Emit>
+    void CombineTable<key, value>::flush(Emit&& emit) {
+        for(auto &[curr_key, curr_values]: table) {
+            if (curr_values.size() > 1)
+                fold(curr_key, curr_values);
+            emit(record_type(curr_key, std::move(curr_values.front())));
+        }
+        table.clear();
+        bytes = 0;
+        if (job_budget)
+            job_budget->release(reserved);
+        reserved = 0;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <limits>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <reduse/combiner.hpp>
+#include <reduse/emitter.hpp>
+
+namespace reduse {
+
+    using KeyId = std::uint32_t; // Integer standing in for a key interned into a KeyDictionary
+
+    const std::size_t DICTIONARY_SHARDS = 64; // Least number of independently locked shards of a KeyDictionary
+
+    /** @brief Concurrent dictionary giving every distinct key a compact integer ID. The ID of a key carries the
+     * partition the key belongs to, so a KeyIdPartitioner places IDs exactly where Partitioner places their keys.
+     * Keys stay in the dictionary until it is destroyed. Thread safe
+     * @param key Data type of the keys
+     * @param Partitioner Function object assigning a key to a partition. See reduse::HashPartitioner
+     */
+    template<typename key, typename Partitioner>
+    class KeyDictionary {
+    private:
+
+        using index_type = std::conditional_t<is_hashable_v<key>, std::unordered_map<key, KeyId>, std::map<key, KeyId>>;
+
+        /** @brief Independently locked part of the dictionary */
+        struct Shard {
+            index_type ids; // ID of every key of the shard
+            std::deque<key> keys; // Keys of the shard by their local index. A deque never moves its elements
+            std::mutex shard_mutex; // Mutex over ids and keys
+        };
+
+        const std::size_t num_partitions; // Number of partitions the keys are spread over
+        const std::size_t shards_per_partition; // Number of shards holding the keys of a single partition
+        std::vector<std::unique_ptr<Shard>> shards; // Shards. Shard s holds keys of partition s % num_partitions
+        Partitioner partitioner; // Assigns a key to its partition
+
+    public:
+
+        /** @brief Constructor for the KeyDictionary
+         * @param _num_partitions Number of partitions the keys are spread over
+         */
+        explicit KeyDictionary(const std::size_t _num_partitions);
+
+        /** @brief Returns the ID of a key, interning the key if it is new */
+        KeyId encode(const key& item);
+
+        /** @brief Returns the key of an ID handed out by encode. The reference stays valid as long as the dictionary */
+        const key& decode(const KeyId id);
+
+        /** @brief Returns the number of distinct keys interned so far */
+        std::size_t size();
+    };
+
+    /** @brief Partitioner of the IDs of a KeyDictionary, matching the partitioner of their keys */
+    struct KeyIdPartitioner {
+        std::size_t operator()(const KeyId id, const std::size_t num_partitions) const { return id % num_partitions; }
+    };
+
+    /** @brief Emitter handed to an emitting MAP in place of the Mapper's own. Interns the key of every pair and emits
+     * its ID instead
+     */
+    template<typename key, typename value, typename Partitioner>
+    class EncodingEmitter final: public Emitter<key, value> {
+    private:
+
+        KeyDictionary<key, Partitioner>& dictionary; // Dictionary interning the keys
+        Emitter<KeyId, value>& output; // Emitter receiving the encoded pairs
+
+    protected:
+
+        void push(std::pair<key, value>&& new_pair) override { output.emplace(dictionary.encode(new_pair.first), std::move(new_pair.second)); }
+
+    public:
+
+        /** @brief Constructor for the EncodingEmitter
+         * @param _dictionary Dictionary interning the keys
+         * @param _output Emitter receiving the encoded pairs
+         */
+        EncodingEmitter(KeyDictionary<key, Partitioner>& _dictionary, Emitter<KeyId, value>& _output):
+            dictionary(_dictionary),
+            output(_output) {}
+    };
+
+    // ----- Definitions ------
+
+    template<typename key, typename Partitioner>
+    KeyDictionary<key, Partitioner>::KeyDictionary(const std::size_t _num_partitions):
+        num_partitions(_num_partitions > 0 ? _num_partitions : 1),
+        shards_per_partition((DICTIONARY_SHARDS + num_partitions - 1) / num_partitions) {
+        for(std::size_t i = 0; i < num_partitions * shards_per_partition; i++)
+            shards.push_back(std::make_unique<Shard>());
+    }
+
+    template<typename key, typename Partitioner>
+    KeyId KeyDictionary<key, Partitioner>::encode(const key& item) {
+        // Among the shards of its partition, a key goes to the one picked by its hash
+        std::size_t shard_index = partitioner(item, num_partitions);
+        if constexpr (is_hashable_v<key>)
+            shard_index += num_partitions * (std::hash<key>{}(item) % shards_per_partition);
+        Shard& shard = *shards[shard_index];
+
+        std::scoped_lock shard_lock{shard.shard_mutex};
+        auto found = shard.ids.find(item);
+        if (found != shard.ids.end())
+            return found->second;
+
+        // IDs interleave the shards, so the shard, and with it the partition, is the ID modulo the number of shards
+        const std::uint64_t id = static_cast<std::uint64_t>(shard.keys.size()) * shards.size() + shard_index;
+        if (id > std::numeric_limits<KeyId>::max())
+            throw std::runtime_error("Key dictionary ran out of IDs");
+        shard.keys.push_back(item);
+        shard.ids.emplace(item, static_cast<KeyId>(id));
+        return static_cast<KeyId>(id);
+    }
+
+    template<typename key, typename Partitioner>
+    const key& KeyDictionary<key, Partitioner>::decode(const KeyId id) {
+        Shard& shard = *shards[id % shards.size()];
+        std::scoped_lock shard_lock{shard.shard_mutex};
+        return shard.keys[id / shards.size()];
+    }
+
+    template<typename key, typename Partitioner>
+    std::size_t KeyDictionary<key, Partitioner>::size() {
+        std::size_t total = 0;
+        for(auto &shard: shards) {
+            std::scoped_lock shard_lock{shard->shard_mutex};
+            total += shard->keys.size();
+        }
+        return total;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <utility>
+
+namespace reduse {
+
+    /** @brief Receives the pairs of an emitting MAP. A MAP callable as void(std::string_view, Emitter<key, value>&)
+     * may emit any number of pairs per input line, including none
+     * @param key Data type of the key of an emitted pair
+     * @param value Data type of the value of an emitted pair
+     */
+    template<typename key, typename value>
+    class Emitter {
+    public:
+
+        virtual ~Emitter() = default;
+
+        /** @brief Emits a pair
+         * @param new_key Key of the pair
+         * @param new_value Value of the pair
+         */
+        void emit(key new_key, value new_value) { push(std::pair<key, value>(std::move(new_key), std::move(new_value))); }
+
+        /** @brief Emits a pair constructed in place from args, the same way std::pair<key, value>(args...) would be */
+        template<typename... Args>
+        void emplace(Args&&... args) { push(std::pair<key, value>(std::forward<Args>(args)...)); }
+
+    protected:
+
+        /** @brief Takes an emitted pair */
+        virtual void push(std::pair<key, value>&& new_pair) = 0;
+    };
+
+    /** @brief Receives the results of a single Reducer worker in place of the output file, e.g. to feed them into the
+     * next stage of a Chain. Every result is emitted as a pair of its key and the value REDUCE returned
+     * @param key Data type of the key of a result
+     * @param value Data type of the value of a result
+     */
+    template<typename key, typename value>
+    class ResultSink: public Emitter<key, value> {
+    public:
+
+        /** @brief Called once the worker has emitted its last result */
+        virtual void close() {}
+    };
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <iterator>
+#include <type_traits>
+#include <cstddef>
+#include <reduse/combiner.hpp>
+
+namespace reduse {
+
+    const std::size_t HOT_KEY_SAMPLE_INTERVAL = 64; // Number of routed pairs between two samples taken by a mapper worker
+    const std::size_t HOT_KEY_COUNTERS = 256; // Number of keys the detector tracks at once
+    const std::size_t HOT_KEY_MIN_SAMPLES = 64; // Number of samples taken before any key is declared hot
+
+    /** @brief Set of keys. A hash set when std::hash is enabled for the key and an ordered set otherwise */
+    template<typename key>
+    using key_set = std::conditional_t<is_hashable_v<key>, std::unordered_set<key>, std::set<key>>;
+
+    /** @brief Finds the keys holding an oversized share of the map output from a sample of the routed pairs.
+     * Counts the samples with the Misra-Gries heavy hitters algorithm, so memory stays bounded however many distinct
+     * keys there are. A key is hot once its share of the samples exceeds hot_key_share times the share of a single
+     * partition. Keys never stop being hot until the detector is cleared. Thread safe
+     * @param key Data type of the key of a record
+     */
+    template<typename key>
+    class HotKeyDetector {
+    private:
+
+        const std::size_t num_partitions; // Number of partitions the keys are spread over
+        const double hot_key_share; // Fraction of a partition's share of the samples that makes a key hot
+        std::map<key, std::size_t> counters; // Misra-Gries counters of the tracked keys
+        std::size_t num_samples; // Number of samples taken
+        key_set<key> hot; // Keys found hot so far
+        std::atomic<std::size_t> hot_version; // Incremented whenever a key is found hot
+        mutable std::mutex detector_mutex; // Mutex over counters, num_samples and hot
+
+    public:
+
+        /** @brief Constructor for the HotKeyDetector
+         * @param _num_partitions Number of partitions the keys are spread over
+         * @param _hot_key_share Fraction of a partition's share of the samples that makes a key hot
+         */
+        HotKeyDetector(const std::size_t _num_partitions, const double _hot_key_share):
+            num_partitions(_num_partitions > 0 ? _num_partitions : 1),
+            hot_key_share(_hot_key_share),
+            num_samples(0),
+            hot_version(0) {}
+
+        /** @brief Counts a sampled key */
+        void sample(const key& item);
+
+        /** @brief Returns a number that changes whenever a key is found hot. Lock free */
+        std::size_t version() const { return hot_version.load(std::memory_order_acquire); }
+
+        /** @brief Returns a copy of the keys found hot so far */
+        key_set<key> hotKeys() const {
+            std::scoped_lock detector_lock{detector_mutex};
+            return hot;
+        }
+
+        /** @brief Forgets every sample and hot key */
+        void clear();
+    };
+
+    // ----- Definitions ------
+
+    template<typename key>
+    void HotKeyDetector<key>::sample(const key& item) {
+        std::scoped_lock detector_lock{detector_mutex};
+        num_samples++;
+        if (hot.count(item) > 0)
+            return;
+
+        auto counter = counters.find(item);
+        if (counter == counters.end()) {
+            if (counters.size() < HOT_KEY_COUNTERS) {
+                counter = counters.emplace(item, 0).first;
+            } else {
+                // Every counter loses one sample instead, which bounds the undercount of any key
+                for(auto it = counters.begin(); it != counters.end();)
+                    it = --it->second == 0 ? counters.erase(it) : std::next(it);
+                return;
+            }
+        }
+        counter->second++;
+
+        if (num_samples >= HOT_KEY_MIN_SAMPLES && counter->second * num_partitions >= hot_key_share * num_samples) {
+            hot.insert(item);
+            counters.erase(counter);
+            hot_version.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    template<typename key>
+    void HotKeyDetector<key>::clear() {
+        std::scoped_lock detector_lock{detector_mutex};
+        counters.clear();
+        num_samples = 0;
+        hot.clear();
+        hot_version.fetch_add(1, std::memory_order_release);
+    }
+}
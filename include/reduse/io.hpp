@@ -0,0 +1,668 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <streambuf>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <exception>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <reduse/options.hpp>
+
+// The io_uring backend talks to the kernel through raw system calls, so it needs no library. Define
+// REDUSE_NO_IO_URING to leave it out
+#if defined(__linux__) && !defined(REDUSE_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define REDUSE_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace reduse {
+
+    const std::size_t IO_BLOCK_SIZE = 1 << 20; // Bytes moved by a single read or write request
+    const std::size_t IO_MIN_BLOCK_SIZE = 1 << 12; // Bytes of the first block of a FileWriteBuffer, and of the blocks of a FileReader over a small file
+    const std::size_t IO_QUEUE_DEPTH = 2; // Requests a FileReader or FileWriter keeps in flight
+
+    /** @brief Queue of positional reads and writes. Requests run in the background where the backend allows it and
+     * are completed in the order they were submitted. Not thread safe
+     */
+    class IoQueue {
+    public:
+
+        virtual ~IoQueue() = default;
+
+        /** @brief Queues a read of up to size bytes at offset into data. data must stay valid until the read completes */
+        virtual void submitRead(const int fd, char* data, const std::size_t size, const std::uint64_t offset) = 0;
+
+        /** @brief Queues a write of size bytes at offset from data. data must stay valid until the write completes */
+        virtual void submitWrite(const int fd, const char* data, const std::size_t size, const std::uint64_t offset) = 0;
+
+        /** @brief Waits for the oldest pending request and returns the bytes it moved. Reads only come up short at the
+         * end of the file. Raises a std::runtime_error if the request failed
+         */
+        virtual std::size_t complete() = 0;
+
+        /** @brief Returns the number of requests not completed yet */
+        virtual std::size_t pending() const = 0;
+    };
+
+    /** @brief IoQueue running every request right away with pread and pwrite */
+    class PosixIoQueue final: public IoQueue {
+    private:
+
+        std::deque<std::pair<std::size_t, int>> results; // Bytes moved and errno of every request not completed yet
+
+    public:
+
+        void submitRead(const int fd, char* data, const std::size_t size, const std::uint64_t offset) override;
+        void submitWrite(const int fd, const char* data, const std::size_t size, const std::uint64_t offset) override;
+        std::size_t complete() override;
+        std::size_t pending() const override { return results.size(); }
+    };
+
+#ifdef REDUSE_HAVE_IO_URING
+    /** @brief IoQueue handing the requests to the kernel through an io_uring, so they run while the caller computes */
+    class UringIoQueue final: public IoQueue {
+    private:
+
+        /** @brief A submitted read or write. Short transfers are resubmitted for the rest */
+        struct Request {
+            int fd; // File descriptor
+            bool write; // Indicates a write
+            iovec buffer; // Bytes not transferred yet
+            std::uint64_t offset; // File offset of buffer
+            std::size_t done; // Bytes transferred so far
+            bool finished; // Indicates that the request completed
+            int error; // errno of a failed request. 0 on success
+        };
+
+        int ring_fd; // File descriptor of the ring
+        unsigned entries; // Number of submission queue entries
+        void* sq_ring; // Mapping of the submission queue ring
+        std::size_t sq_ring_size; // Bytes of sq_ring
+        void* cq_ring; // Mapping of the completion queue ring. Same as sq_ring if the kernel maps both at once
+        std::size_t cq_ring_size; // Bytes of cq_ring
+        io_uring_sqe* sqes; // Mapping of the submission queue entries
+        std::size_t sqes_size; // Bytes of sqes
+        unsigned* sq_tail; // Tail of the submission queue, advanced by us
+        unsigned* sq_mask; // Index mask of the submission queue
+        unsigned* sq_array; // Submission queue, holding indices into sqes
+        unsigned* cq_head; // Head of the completion queue, advanced by us
+        unsigned* cq_tail; // Tail of the completion queue, advanced by the kernel
+        unsigned* cq_mask; // Index mask of the completion queue
+        io_uring_cqe* cqes; // Completion queue entries
+        std::deque<Request> requests; // Requests not completed yet, in submission order
+        std::uint64_t first_id; // Identifier of the front of requests
+        std::size_t in_flight; // Number of requests in the hands of the kernel
+
+        /** @brief Hands the rest of a request to the kernel */
+        void push(Request& request, const std::uint64_t id);
+
+        /** @brief Waits for at least one completion and applies every completion available */
+        void reap();
+
+        /** @brief Unmaps the rings and closes the ring file descriptor */
+        void release();
+
+    public:
+
+        /** @brief Sets up the ring. Raises a std::runtime_error if the kernel refuses it
+         * @param _entries Number of requests the ring holds
+         */
+        explicit UringIoQueue(const unsigned _entries);
+
+        UringIoQueue(const UringIoQueue&) = delete;
+        UringIoQueue& operator=(const UringIoQueue&) = delete;
+
+        /** @brief Destructor. Waits for the requests still in the hands of the kernel and tears the ring down */
+        ~UringIoQueue() override;
+
+        void submitRead(const int fd, char* data, const std::size_t size, const std::uint64_t offset) override;
+        void submitWrite(const int fd, const char* data, const std::size_t size, const std::uint64_t offset) override;
+        std::size_t complete() override;
+        std::size_t pending() const override { return requests.size(); }
+    };
+#endif
+
+    /** @brief Returns an IoQueue of the chosen backend. IoBackend::AUTO picks io_uring if the kernel supports it and
+     * pread/pwrite otherwise. Raises a std::runtime_error if IoBackend::IO_URING is not available
+     * @param backend Backend of the queue
+     * @param depth Number of requests the queue keeps in flight
+     */
+    std::unique_ptr<IoQueue> makeIoQueue(const IoBackend backend, const std::size_t depth = IO_QUEUE_DEPTH);
+
+    /** @brief Sequential reader of a whole file. Keeps the next blocks of the file in flight while the caller works on
+     * the current one. Not thread safe
+     */
+    class FileReader {
+    private:
+
+        std::string filename; // Name of the open file
+        int fd; // File descriptor
+        std::unique_ptr<IoQueue> queue; // Queue running the reads
+        std::size_t block_size; // Bytes of every block. Smaller than IO_BLOCK_SIZE for small files
+        std::deque<std::vector<char>> blocks; // Blocks in flight, then the current block at the front once completed
+        std::size_t current_size; // Bytes read into the current block. 0 until it is completed
+        std::size_t current_used; // Bytes of the current block handed to the caller
+        bool current_ready; // Indicates that the front block completed
+        std::uint64_t next_offset; // File offset of the next block to submit
+        bool end_of_file; // Indicates that a read came up short, so no more blocks are submitted
+
+    public:
+
+        /** @brief Opens the file and starts reading it
+         * @param _filename Relative or absolute path to the file
+         * @param backend Backend running the reads
+         */
+        FileReader(const std::string& _filename, const IoBackend backend);
+
+        FileReader(const FileReader&) = delete;
+        FileReader& operator=(const FileReader&) = delete;
+
+        ~FileReader();
+
+        /** @brief Copies the next bytes of the file into data
+         * @return Bytes copied. Fewer than size only at the end of the file
+         */
+        std::size_t read(char* data, const std::size_t size);
+    };
+
+    /** @brief Writer appending whole buffers to a new file. Every buffer is written in the background while the caller
+     * fills the next one; at most IO_QUEUE_DEPTH writes are in flight. Not thread safe
+     */
+    class FileWriter {
+    private:
+
+        std::string filename; // Name of the open file
+        int fd; // File descriptor. -1 once closed
+        std::unique_ptr<IoQueue> queue; // Queue running the writes
+        std::deque<std::string> in_flight; // Buffers being written, oldest first
+        std::vector<std::string> spare; // Written buffers kept for their capacity
+        std::uint64_t written; // Bytes appended so far
+        std::exception_ptr error; // First failed write
+
+        /** @brief Completes the oldest write and keeps its buffer as a spare */
+        void completeOne();
+
+    public:
+
+        /** @brief Creates (or truncates) the file
+         * @param _filename Relative or absolute path to the file
+         * @param backend Backend running the writes
+         */
+        FileWriter(const std::string& _filename, const IoBackend backend);
+
+        FileWriter(const FileWriter&) = delete;
+        FileWriter& operator=(const FileWriter&) = delete;
+
+        /** @brief Destructor. Waits for the writes in flight, discarding their errors */
+        ~FileWriter();
+
+        /** @brief Appends a buffer to the file. Takes the contents of data and leaves it empty, with the capacity of an
+         * earlier buffer if there is one to recycle
+         */
+        void append(std::string& data);
+
+        /** @brief Returns the number of bytes appended so far */
+        std::uint64_t size() const { return written; }
+
+        /** @brief Waits for every write and closes the file. Raises a std::runtime_error if any write failed */
+        void close();
+    };
+
+    /** @brief Output stream buffer collecting blocks of IO_BLOCK_SIZE bytes for a FileWriter, so any std::ostream can
+     * write a file in the background
+     */
+    class FileWriteBuffer final: public std::streambuf {
+    private:
+
+        FileWriter writer; // Writer of the file
+        std::string block; // Block being filled
+
+        /** @brief Hands the filled part of the block to the writer */
+        void commit();
+
+    protected:
+
+        int_type overflow(int_type item) override;
+        int sync() override;
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+
+    public:
+
+        /** @brief Creates (or truncates) the file
+         * @param filename Relative or absolute path to the file
+         * @param backend Backend running the writes
+         */
+        FileWriteBuffer(const std::string& filename, const IoBackend backend);
+
+        FileWriteBuffer(const FileWriteBuffer&) = delete;
+        FileWriteBuffer& operator=(const FileWriteBuffer&) = delete;
+
+        /** @brief Destructor. Writes the remaining bytes, discarding any error */
+        ~FileWriteBuffer() override;
+
+        /** @brief Writes the remaining bytes and closes the file. Raises a std::runtime_error if any write failed */
+        void close();
+    };
+
+    // ----- Definitions ------
+
+    inline void PosixIoQueue::submitRead(const int fd, char* data, const std::size_t size, const std::uint64_t offset) {
+        std::size_t done = 0;
+        while(done < size) {
+            ssize_t count = pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0) {
+                results.emplace_back(done, errno);
+                return;
+            }
+            if (count == 0)
+                break;
+            done += static_cast<std::size_t>(count);
+        }
+        results.emplace_back(done, 0);
+    }
+
+    inline void PosixIoQueue::submitWrite(const int fd, const char* data, const std::size_t size, const std::uint64_t offset) {
+        std::size_t done = 0;
+        while(done < size) {
+            ssize_t count = pwrite(fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0) {
+                results.emplace_back(done, count < 0 ? errno : EIO);
+                return;
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        results.emplace_back(done, 0);
+    }
+
+    inline std::size_t PosixIoQueue::complete() {
+        auto [done, error] = results.front();
+        results.pop_front();
+        if (error != 0)
+            throw std::runtime_error(std::string("I/O request failed: ") + std::strerror(error));
+        return done;
+    }
+
+#ifdef REDUSE_HAVE_IO_URING
+    inline UringIoQueue::UringIoQueue(const unsigned _entries):
+        ring_fd(-1),
+        entries(0),
+        sq_ring(MAP_FAILED),
+        sq_ring_size(0),
+        cq_ring(MAP_FAILED),
+        cq_ring_size(0),
+        sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sqes_size(0),
+        first_id(0),
+        in_flight(0) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, _entries > 0 ? _entries : 1, &params));
+        if (ring_fd < 0)
+            throw std::runtime_error(std::string("Cannot set up an io_uring: ") + std::strerror(errno));
+        entries = params.sq_entries;
+
+        // Map the rings. Recent kernels map both rings at once
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring != MAP_FAILED)
+            cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        if (cq_ring != MAP_FAILED)
+            sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            const int map_error = errno;
+            release();
+            throw std::runtime_error(std::string("Cannot map an io_uring: ") + std::strerror(map_error));
+        }
+
+        auto sq_base = static_cast<char*>(sq_ring);
+        auto cq_base = static_cast<char*>(cq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+    }
+
+    inline UringIoQueue::~UringIoQueue() {
+        // The kernel may still write into the buffers of the requests in flight
+        try {
+            while(in_flight > 0)
+                reap();
+        } catch (...) {}
+        release();
+    }
+
+    inline void UringIoQueue::release() {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+        sq_ring = cq_ring = MAP_FAILED;
+        sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        ring_fd = -1;
+    }
+
+    inline void UringIoQueue::push(Request& request, const std::uint64_t id) {
+        while(in_flight >= entries)
+            reap();
+
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = request.fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&request.buffer);
+        sqe.len = 1;
+        sqe.off = request.offset;
+        sqe.user_data = id;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while(syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                throw std::runtime_error(std::string("Cannot submit to an io_uring: ") + std::strerror(errno));
+
+            // Completions free kernel resources. With nothing in flight there are none to wait for, so retry
+            if (in_flight > 0)
+                reap();
+            else if (errno != EINTR)
+                std::this_thread::yield();
+        }
+        in_flight++;
+    }
+
+    inline void UringIoQueue::reap() {
+        unsigned head = *cq_head;
+        while(head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("Cannot wait on an io_uring: ") + std::strerror(errno));
+        }
+
+        std::vector<std::pair<Request*, std::uint64_t>> resubmit;
+        for(; head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE); head++) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            in_flight--;
+            Request& request = requests[static_cast<std::size_t>(cqe.user_data - first_id)];
+            if (cqe.res < 0) {
+                request.error = -cqe.res;
+                request.finished = true;
+                continue;
+            }
+
+            // A short transfer continues where it stopped. A read stops short only at the end of the file
+            const std::size_t count = static_cast<std::size_t>(cqe.res);
+            request.done += count;
+            request.offset += count;
+            request.buffer.iov_base = static_cast<char*>(request.buffer.iov_base) + count;
+            request.buffer.iov_len -= count;
+            if (request.buffer.iov_len == 0 || (count == 0 && !request.write))
+                request.finished = true;
+            else if (count == 0)
+                request.error = EIO, request.finished = true;
+            else
+                resubmit.emplace_back(&request, cqe.user_data);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+        for(auto &[request, id]: resubmit)
+            push(*request, id);
+    }
+
+    inline void UringIoQueue::submitRead(const int fd, char* data, const std::size_t size, const std::uint64_t offset) {
+        requests.push_back({fd, false, {data, size}, offset, 0, size == 0, 0});
+        if (size > 0)
+            push(requests.back(), first_id + requests.size() - 1);
+    }
+
+    inline void UringIoQueue::submitWrite(const int fd, const char* data, const std::size_t size, const std::uint64_t offset) {
+        requests.push_back({fd, true, {const_cast<char*>(data), size}, offset, 0, size == 0, 0});
+        if (size > 0)
+            push(requests.back(), first_id + requests.size() - 1);
+    }
+
+    inline std::size_t UringIoQueue::complete() {
+        while(!requests.front().finished)
+            reap();
+        Request request = requests.front();
+        requests.pop_front();
+        first_id++;
+        if (request.error != 0)
+            throw std::runtime_error(std::string("I/O request failed: ") + std::strerror(request.error));
+        return request.done;
+    }
+#endif
+
+    inline std::unique_ptr<IoQueue> makeIoQueue(const IoBackend backend, const std::size_t depth) {
+#ifdef REDUSE_HAVE_IO_URING
+        if (backend != IoBackend::POSIX) {
+            try {
+                return std::make_unique<UringIoQueue>(static_cast<unsigned>(depth));
+            } catch (const std::runtime_error&) {
+                if (backend == IoBackend::IO_URING)
+                    throw;
+            }
+        }
+#else
+        if (backend == IoBackend::IO_URING)
+            throw std::runtime_error("reduse was built without io_uring support");
+#endif
+        return std::make_unique<PosixIoQueue>();
+    }
+
+    inline FileReader::FileReader(const std::string& _filename, const IoBackend backend):
+        filename(_filename),
+        fd(-1),
+        block_size(IO_BLOCK_SIZE),
+        current_size(0),
+        current_used(0),
+        current_ready(false),
+        next_offset(0),
+        end_of_file(false) {
+        queue = makeIoQueue(backend);
+        fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open input file: " + filename);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // A small file is read in small blocks, so no large buffer is cleared for it
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0)
+            block_size = std::clamp(static_cast<std::size_t>(file_stat.st_size) + 1, IO_MIN_BLOCK_SIZE, IO_BLOCK_SIZE);
+
+        // Put the first blocks in flight
+        for(std::size_t i = 0; i < IO_QUEUE_DEPTH; i++) {
+            blocks.emplace_back(block_size);
+            queue->submitRead(fd, blocks.back().data(), block_size, next_offset);
+            next_offset += block_size;
+        }
+    }
+
+    inline FileReader::~FileReader() {
+        // The reads in flight must finish before their blocks are freed
+        queue.reset();
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    inline std::size_t FileReader::read(char* data, const std::size_t size) {
+        std::size_t copied = 0;
+        while(copied < size) {
+            if (!current_ready) {
+                if (blocks.empty())
+                    break;
+                try {
+                    current_size = queue->complete();
+                } catch (const std::runtime_error& e) {
+                    throw std::runtime_error("Cannot read input file: " + filename + " (" + e.what() + ")");
+                }
+                current_used = 0;
+                current_ready = true;
+                if (current_size < block_size)
+                    end_of_file = true;
+            }
+
+            const std::size_t count = std::min(size - copied, current_size - current_used);
+            std::memcpy(data + copied, blocks.front().data() + current_used, count);
+            copied += count;
+            current_used += count;
+
+            // Recycle a drained block for the next read, unless the file already ended
+            if (current_used == current_size) {
+                auto block = std::move(blocks.front());
+                blocks.pop_front();
+                current_ready = false;
+                if (!end_of_file) {
+                    blocks.push_back(std::move(block));
+                    queue->submitRead(fd, blocks.back().data(), block_size, next_offset);
+                    next_offset += block_size;
+                } else {
+                    // The blocks still in flight read past the end of the file
+                    while(!blocks.empty()) {
+                        queue->complete();
+                        blocks.pop_front();
+                    }
+                }
+            }
+        }
+        return copied;
+    }
+
+    inline FileWriter::FileWriter(const std::string& _filename, const IoBackend backend):
+        filename(_filename),
+        fd(-1),
+        written(0) {
+        queue = makeIoQueue(backend);
+        fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open output file: " + filename);
+    }
+
+    inline FileWriter::~FileWriter() {
+        try {
+            close();
+        } catch (...) {}
+    }
+
+    inline void FileWriter::completeOne() {
+        try {
+            queue->complete();
+        } catch (const std::runtime_error& e) {
+            if (!error)
+                error = std::make_exception_ptr(std::runtime_error("Cannot write output file: " + filename + " (" + e.what() + ")"));
+        }
+        spare.push_back(std::move(in_flight.front()));
+        spare.back().clear();
+        in_flight.pop_front();
+    }
+
+    inline void FileWriter::append(std::string& data) {
+        if (data.empty())
+            return;
+        if (in_flight.size() >= IO_QUEUE_DEPTH)
+            completeOne();
+
+        // The buffer moves into the queue, so its address stays put until the write completes
+        in_flight.push_back(std::move(data));
+        queue->submitWrite(fd, in_flight.back().data(), in_flight.back().size(), written);
+        written += in_flight.back().size();
+        data.clear();
+        if (!spare.empty()) {
+            data.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+
+    inline void FileWriter::close() {
+        while(!in_flight.empty())
+            completeOne();
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+
+    inline FileWriteBuffer::FileWriteBuffer(const std::string& filename, const IoBackend backend): writer(filename, backend) {
+        block.resize(IO_MIN_BLOCK_SIZE);
+        setp(block.data(), block.data() + block.size());
+    }
+
+    inline FileWriteBuffer::~FileWriteBuffer() {
+        try {
+            close();
+        } catch (...) {}
+    }
+
+    inline void FileWriteBuffer::commit() {
+        block.resize(static_cast<std::size_t>(pptr() - pbase()));
+        writer.append(block);
+        block.resize(IO_BLOCK_SIZE);
+        setp(block.data(), block.data() + block.size());
+    }
+
+    inline FileWriteBuffer::int_type FileWriteBuffer::overflow(int_type item) {
+        // The block starts small and doubles up to IO_BLOCK_SIZE, so small files never clear a large buffer
+        if (block.size() < IO_BLOCK_SIZE) {
+            const auto used = pptr() - pbase();
+            block.resize(std::min(block.size() * 2, IO_BLOCK_SIZE));
+            setp(block.data(), block.data() + block.size());
+            pbump(static_cast<int>(used));
+        } else {
+            commit();
+        }
+        if (!traits_type::eq_int_type(item, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(item);
+            pbump(1);
+        }
+        return traits_type::not_eof(item);
+    }
+
+    inline int FileWriteBuffer::sync() {
+        return 0;
+    }
+
+    inline FileWriteBuffer::pos_type FileWriteBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) {
+        // Only the current position can be asked for
+        if (offset != 0 || direction != std::ios_base::cur || (mode & std::ios_base::out) == 0)
+            return pos_type(off_type(-1));
+        return pos_type(static_cast<off_type>(writer.size()) + (pptr() - pbase()));
+    }
+
+    inline void FileWriteBuffer::close() {
+        block.resize(static_cast<std::size_t>(pptr() - pbase()));
+        setp(nullptr, nullptr);
+        writer.append(block);
+        writer.close();
+    }
+}
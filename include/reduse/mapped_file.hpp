@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace reduse {
+
+    /** @brief Read-only memory mapping of an entire file. The mapping lives as long as the object */
+    class MappedFile {
+    private:
+
+        const char* data; // Start of the mapping. nullptr for empty files
+        std::size_t length; // Size of the mapping in bytes
+
+    public:
+
+        /** @brief Maps the file read-only into memory
+         * @param filename Relative or absolute path to the file to map
+         */
+        explicit MappedFile(const std::string& filename);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile();
+
+        /** @brief Returns a view over the whole mapping */
+        std::string_view view() const { return {data, length}; }
+    };
+
+    // ----- Definitions ------
+
+    inline MappedFile::MappedFile(const std::string& filename): data(nullptr), length(0) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open mapper input file: " + filename);
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat mapper input file: " + filename);
+        }
+
+        // mmap refuses zero length mappings, so an empty file is simply an empty view
+        length = static_cast<std::size_t>(file_stat.st_size);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Cannot memory map mapper input file: " + filename);
+            }
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapping);
+        }
+        close(fd);
+    }
+
+    inline MappedFile::~MappedFile() {
+        if (data != nullptr)
+            munmap(const_cast<char*>(data), length);
+    }
+}
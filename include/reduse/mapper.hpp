@@ -1,222 +1,656 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <cstring>
+#include <algorithm>
 #include <exception>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <unistd.h>
+#include <reduse/options.hpp>
+#include <reduse/ring_buffer.hpp>
+#include <reduse/mapped_file.hpp>
+#include <reduse/records.hpp>
+#include <reduse/io.hpp>
+#include <reduse/scheduler.hpp>
+#include <reduse/sorter.hpp>
+#include <reduse/partitioner.hpp>
+#include <reduse/combiner.hpp>
+#include <reduse/emitter.hpp>
+#include <reduse/stats.hpp>
+#include <reduse/thread_pool.hpp>
+#include <reduse/hot_keys.hpp>
+#include <reduse/budget.hpp>
+#include <reduse/memory.hpp>
 
 namespace reduse {
 
     const int DEFAULT_NUM_MAPPERS = 1; // Default number of mapper workers
 
+    /** @brief Indicates if MapFn can be used as a MAP emitting pairs into an Emitter<key, value> */
+    template<typename MapFn, typename key, typename value>
+    inline constexpr bool is_emit_map_v = std::is_invocable_v<MapFn&, std::string_view, Emitter<key, value>&>;
+
+    /** @brief Indicates if MapFn can be used as a MAP: either returning a std::pair<key, value> for a line taken as a
+     * const std::string& or a std::string_view, or emitting pairs for a std::string_view into an Emitter<key, value>
+     */
+    template<typename MapFn, typename key, typename value>
+    inline constexpr bool is_map_v =
+        is_emit_map_v<MapFn, key, value> ||
+        std::is_invocable_r_v<std::pair<key, value>, MapFn&, std::string_view> ||
+        std::is_invocable_r_v<std::pair<key, value>, MapFn&, const std::string&>;
+
     /** @brief Handles the entire map phase
      * @param key Data type of the key emitted by the MAP method
      * @param value Data type of the value emitted by the MAP method
+     * @param Partitioner Function object assigning a key to a partition of the shuffle. See reduse::HashPartitioner
      */
-    template<typename key, typename value>
+    template<typename key, typename value, typename Partitioner = HashPartitioner<key>>
     class Mapper {
     private:
 
         const std::string input_filename; // Input filename
-        const std::string map_output_filename; // Mapper's intermediate output filename
-        const std::function<std::pair<key, value>(const std::string&)> MAP; // Mapper routine
+        const std::string map_output_filename; // Mapper's intermediate output filename. Empty when the output stays in the shuffle
+        class WorkerOutput;
+
+        const std::function<void(std::vector<std::string>&, WorkerOutput&)> map_batch; // Applies MAP to every line of a batch
+        const std::function<void(std::string_view, RecordScanner&, WorkerOutput&)> map_split; // Applies MAP to every record of a map task
         const int num_mappers; // Number of mappers
         const bool verbose; // Verbose output to console
+        const Options options; // Tuning options
 
-        std::fstream map_output_file; // Mapper's intermediate output filestream
-        std::atomic_bool isProducerDone; // Indicates if the producer worker is done reading the file
+        std::function<value(const key&, std::vector<value>&)> COMBINE; // Combiner routine. Map output is not pre-aggregated if unset
         std::vector<std::thread> mp_threads; // Mapper workers
-        std::condition_variable buff_full; // Signals if the buffer has an item for a mapper to process
-        std::condition_variable buff_empty; // Signals if the buffer is empty for the producer to put an item into it
-        std::mutex buff_mutex; // Mutex over the buffer
-        std::mutex map_output_file_mutex; // Mutex over the intermediate mapper output file
-        bool produced; // Indicates if the producer has produced a new item into the buffer
-        std::string buff; // Item buffer
-
+        RingBuffer<std::string> buff; // Buffer of input line batches
+        std::shared_ptr<ExternalSorter<key, value>> shuffle; // Sorts the emitted pairs by key, per partition
+        Partitioner partitioner; // Assigns every emitted pair to a partition of the shuffle
+        std::shared_ptr<TraceRecorder> trace; // Receives a span per worker. Not traced if unset
+        std::shared_ptr<ThreadPool> pool; // Runs the workers. Workers get threads of their own if unset
+        std::shared_ptr<HotKeyDetector<key>> hot_keys; // Finds the keys spread over every partition. Keys are never spread if unset
+        std::optional<std::pair<std::size_t, std::size_t>> input_range; // Offset and length of the part of the input to map. The whole input if unset
+        std::shared_ptr<MemoryBudget> memory_budget; // Job-wide budget of the combine tables and the batches in flight. None if unset
+        PhaseStats stats; // Statistics of the current run
+        std::mutex stats_mutex; // Mutex over stats
 
         /** @brief Mapper worker routine */
         void consumer();
 
         /** @brief File reader worker routine */
         void producer();
-        
-        /** @brief Sorts the mapper output file for the reduce phase */
-        void sortOutputFile();
 
-        /** @brief Fetches a new line from the buffer */
-        bool get(std::string& input_buff);
+        /** @brief Mapper worker routine for the memory mapped input mode
+         * @param scheduler Hands out the map tasks
+         * @param worker Index of the worker in the scheduler
+         */
+        void splitConsumer(SplitScheduler& scheduler, const std::size_t worker);
+
+        /** @brief Returns the part of the mapped input file selected by setInputRange */
+        std::string_view mappedInput(const MappedFile& input_file) const;
+
+        /** @brief Applies MAP to a single line, in whichever form MAP takes it
+         * @param MAP The mapper function
+         * @param line Line to map. Either a std::string or a std::string_view
+         * @param output Worker output receiving the pairs
+         * @param scratch String reused for a MAP taking a std::string when line is a view
+         */
+        template<typename MapFn, typename Line>
+        static void mapLine(MapFn& MAP, const Line& line, WorkerOutput& output, std::string& scratch);
+
+        /** @brief Output side of a single mapper worker. Pairs pass through an optional combine table before they are
+         * routed to their partition of the shuffle. Serves as the Emitter of an emitting MAP
+         */
+        class WorkerOutput final: public Emitter<key, value> {
+        private:
+
+            Mapper& mapper; // Mapper owning the worker
+            SortBuffer<key, value> sort_buffer; // Worker's sort buffer
+            std::optional<CombineTable<key, value>> combine_table; // Worker's combine table. Empty without COMBINE
+            std::size_t lines; // Number of lines mapped by the worker
+            std::size_t routed; // Number of pairs handed to the shuffle by the worker
+            key_set<key> hot; // Worker's copy of the hot keys
+            std::size_t hot_version; // Version of the detector the copy was taken at
+            std::size_t next_spread; // Partition the next pair of a hot key goes to
+
+            /** @brief Routes a pair to its partition of the shuffle. Pairs of a hot key go round-robin to every partition */
+            void route(std::pair<key, value>&& new_map_pair);
+
+            /** @brief Returns true if the detector found the key hot, refreshing the worker's copy of the hot keys */
+            bool isHot(const key& item);
+
+        public:
+
+            /** @brief Constructor for the WorkerOutput
+             * @param _mapper Mapper owning the worker
+             */
+            explicit WorkerOutput(Mapper& _mapper);
+
+            /** @brief Takes a pair emitted by MAP */
+            void push(std::pair<key, value>&& new_map_pair) override;
+
+            /** @brief Counts a mapped line */
+            void countLine() { lines++; }
+
+            /** @brief Flushes the combine table, hands the remaining pairs over as in-memory runs and adds the worker's
+             * counters to the statistics of the run
+             */
+            void close();
+        };
+
+        /** @brief Delegated constructor storing the map loops instantiated for the user's MAP */
+        Mapper(
+            const std::string& _input_filename,
+            const std::string& _map_output_filename,
+            const std::shared_ptr<ExternalSorter<key, value>>& _shuffle,
+            const std::function<void(std::vector<std::string>&, WorkerOutput&)>& _map_batch,
+            const std::function<void(std::string_view, RecordScanner&, WorkerOutput&)>& _map_split,
+            const int _num_mappers,
+            const bool _verbose,
+            const Options& _options
+        );
+
+        /** @brief Returns the loop applying MAP to a batch of lines. MAP is called directly, so it can be inlined */
+        template<typename MapFn>
+        static std::function<void(std::vector<std::string>&, WorkerOutput&)> batchMap(MapFn&& _MAP);
 
-        /** @brief Puts a new line into the buffer */
-        void put(std::string& input_line);
+        /** @brief Returns the loop applying MAP to every record of a map task. MAP is called directly, so it can be inlined */
+        template<typename MapFn>
+        static std::function<void(std::string_view, RecordScanner&, WorkerOutput&)> splitMap(MapFn&& _MAP);
+        
+        /** @brief Merges the sorted runs of all mappers into the mapper output file for the reduce phase */
+        void sortOutputFile();
 
     public:
 
         using key_type = key; // Alias to key for public access
         using value_type = value; // Alias to value for public access
 
-        /** @brief Constructor for the Mapper
+        /** @brief Constructor for the Mapper writing a single sorted output file
          * @param _input_filename Relative or absolute path to the file where the mapper needs to draw the input from
          * @param _map_output_filename Relative or absolute path to the file where the mapper will store its output for the reduce phase
-         * @param _MAP The mapper function
+         * @param _MAP The mapper function, callable as std::pair<key, value>(const std::string&), std::pair<key, value>(std::string_view)
+         * or void(std::string_view, reduse::Emitter<key, value>&). An emitting MAP may emit any number of pairs per line.
+         * In the memory mapped input mode the views point straight into the mapping, so no string is allocated per line
          * @param _num_mappers Number of mappers to run concurrently. Set to 1 by default, for no concurrency
          * @param _verbose Set true if you want the a verbose output. Useful for debugging
+         * @param _options Tuning options. See reduse::Options
          */
+        template<typename MapFn, typename = std::enable_if_t<is_map_v<MapFn, key, value>>>
         Mapper(
             const std::string& _input_filename,
             const std::string& _map_output_filename,
-            const std::function<std::pair<key_type, value>(const std::string&)>& _MAP,
+            MapFn&& _MAP,
+            const int _num_mappers = DEFAULT_NUM_MAPPERS,
+            const bool _verbose = false,
+            const Options& _options = Options()
+        );
+
+        /** @brief Constructor for the Mapper leaving its sorted output, partitioned, in a shuffle for the Reducer to merge
+         * @param _input_filename Relative or absolute path to the file where the mapper needs to draw the input from
+         * @param _shuffle Shuffle receiving the sorted runs. Every key is routed to one of its partitions by the Partitioner
+         * @param _MAP The mapper function, callable as std::pair<key, value>(const std::string&), std::pair<key, value>(std::string_view)
+         * or void(std::string_view, reduse::Emitter<key, value>&)
+         * @param _num_mappers Number of mappers to run concurrently. Set to 1 by default, for no concurrency
+         * @param _verbose Set true if you want the a verbose output. Useful for debugging
+         * @param _options Tuning options. See reduse::Options
+         */
+        template<typename MapFn, typename = std::enable_if_t<is_map_v<MapFn, key, value>>>
+        Mapper(
+            const std::string& _input_filename,
+            const std::shared_ptr<ExternalSorter<key, value>>& _shuffle,
+            MapFn&& _MAP,
             const int _num_mappers = DEFAULT_NUM_MAPPERS,
-            const bool _verbose = false
+            const bool _verbose = false,
+            const Options& _options = Options()
         );
 
-        /** @brief Routine to run the Mapper instance */
-        void run();
+        /** @brief Enables map-side pre-aggregation. Every mapper worker folds the values of a key in a local table and
+         * only passes partial results on, whenever the table outgrows Options::combine_memory_budget and at the end
+         * @param _COMBINE The combiner function. Folds a list of values of a key into a single one. Must be associative
+         * and commutative, as it is applied to arbitrary subsets of the values and to its own results
+         */
+        void setCombiner(const std::function<value(const key&, std::vector<value>&)>& _COMBINE) { COMBINE = _COMBINE; }
+
+        /** @brief Records a span per worker of every run into a trace
+         * @param _trace Recorder receiving the spans. Set to nullptr to stop tracing
+         */
+        void setTrace(const std::shared_ptr<TraceRecorder>& _trace) { trace = _trace; }
+
+        /** @brief Runs the workers of every run as tasks of a pool instead of on threads of their own. The producer
+         * runs on the calling thread, so workers waiting for input never hold up the pool
+         * @param _pool Pool running the workers. Set to nullptr to start threads again
+         */
+        void setPool(const std::shared_ptr<ThreadPool>& _pool) { pool = _pool; }
+
+        /** @brief Samples the routed pairs for hot keys and spreads the pairs of every hot key round-robin over all the
+         * partitions of the shuffle, instead of sending them to the partition of their key. Every partition then holds
+         * part of a hot key group, so the Reducer must merge their results. See Reducer::setHotKeys
+         * @param _hot_keys Detector shared with the Reducer. Cleared at the start of every run. Set to nullptr to stop spreading
+         */
+        void setHotKeys(const std::shared_ptr<HotKeyDetector<key>>& _hot_keys) { hot_keys = _hot_keys; }
+
+        /** @brief Maps only a byte range of the input file in every following run, e.g. a single chunk of a ChunkCache.
+         * Only used in the memory mapped input mode
+         * @param offset Offset of the range. Must be the start of a record
+         * @param length Bytes of the range. Must end at a record boundary
+         */
+        void setInputRange(const std::size_t offset, const std::size_t length) { input_range.emplace(offset, length); }
+
+        /** @brief Reserves the memory of the combine tables and of the input batches in flight from a job-wide budget.
+         * The producer waits for the workers to give memory back before it reads on, and a combine table is flushed
+         * whenever the budget runs short. The sort buffers reserve theirs through the shuffle. See
+         * ExternalSorter::setMemoryBudget
+         * @param _memory_budget Job-wide budget. Set to nullptr to stop accounting
+         */
+        void setMemoryBudget(const std::shared_ptr<MemoryBudget>& _memory_budget) { memory_budget = _memory_budget; }
+
+        /** @brief Routine to run the Mapper instance. Returns the statistics of the run */
+        PhaseStats run();
     };
     
     // ----- Definitions ------
     
-    template<typename key, typename value>
-    Mapper<key, value>::Mapper(
+    template<typename key, typename value, typename Partitioner>
+    template<typename MapFn, typename>
+    Mapper<key, value, Partitioner>::Mapper(
         const std::string& _input_filename,
         const std::string& _map_output_filename,
-        const std::function<std::pair<key, value>(const std::string&)>& _MAP,
+        MapFn&& _MAP,
         const int _num_mappers,
-        const bool _verbose
+        const bool _verbose,
+        const Options& _options
+    ):  Mapper(
+            _input_filename,
+            _map_output_filename,
+            std::make_shared<ExternalSorter<key, value>>(
+                _map_output_filename,
+                sortBufferBudget(_options, _num_mappers),
+                1,
+                _options.spill_format,
+                _options.io_backend
+            ),
+            batchMap(_MAP),
+            splitMap(_MAP),
+            _num_mappers,
+            _verbose,
+            _options
+        ) {}
+
+    template<typename key, typename value, typename Partitioner>
+    template<typename MapFn, typename>
+    Mapper<key, value, Partitioner>::Mapper(
+        const std::string& _input_filename,
+        const std::shared_ptr<ExternalSorter<key, value>>& _shuffle,
+        MapFn&& _MAP,
+        const int _num_mappers,
+        const bool _verbose,
+        const Options& _options
+    ):  Mapper(_input_filename, "", _shuffle, batchMap(_MAP), splitMap(_MAP), _num_mappers, _verbose, _options) {}
+
+    template<typename key, typename value, typename Partitioner>
+    Mapper<key, value, Partitioner>::Mapper(
+        const std::string& _input_filename,
+        const std::string& _map_output_filename,
+        const std::shared_ptr<ExternalSorter<key, value>>& _shuffle,
+        const std::function<void(std::vector<std::string>&, WorkerOutput&)>& _map_batch,
+        const std::function<void(std::string_view, RecordScanner&, WorkerOutput&)>& _map_split,
+        const int _num_mappers,
+        const bool _verbose,
+        const Options& _options
     ):  input_filename(_input_filename),
         map_output_filename(_map_output_filename), 
-        MAP(_MAP), 
+        map_batch(_map_batch),
+        map_split(_map_split),
         num_mappers(_num_mappers),
         verbose(_verbose),
-        isProducerDone(false),
-        mp_threads(std::vector<std::thread>(_num_mappers)) {}
+        options(_options),
+        mp_threads(std::vector<std::thread>(_num_mappers)),
+        buff(_options.buffer_depth),
+        shuffle(_shuffle) {}
 
-    template<typename key, typename value>
-    void Mapper<key, value>::run() {
+    template<typename key, typename value, typename Partitioner>
+    template<typename MapFn>
+    std::function<void(std::vector<std::string>&, typename Mapper<key, value, Partitioner>::WorkerOutput&)>
+    Mapper<key, value, Partitioner>::batchMap(MapFn&& _MAP) {
+        return [MAP = std::decay_t<MapFn>(_MAP)](std::vector<std::string>& batch, WorkerOutput& output) mutable {
+            std::string scratch;
+            for(auto &input_line: batch)
+                mapLine(MAP, input_line, output, scratch);
+        };
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    template<typename MapFn>
+    std::function<void(std::string_view, RecordScanner&, typename Mapper<key, value, Partitioner>::WorkerOutput&)>
+    Mapper<key, value, Partitioner>::splitMap(MapFn&& _MAP) {
+        return [MAP = std::decay_t<MapFn>(_MAP)](std::string_view task, RecordScanner& scanner, WorkerOutput& output) mutable {
+            // A MAP taking a std::string gets the record copied into a reused string, so its capacity is recycled
+            std::string scratch;
+            scanner.scan(task, true, [&](std::string_view record) { mapLine(MAP, record, output, scratch); });
+        };
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    template<typename MapFn, typename Line>
+    void Mapper<key, value, Partitioner>::mapLine(MapFn& MAP, const Line& line, WorkerOutput& output, std::string& scratch) {
+        output.countLine();
+        if constexpr (is_emit_map_v<MapFn, key, value>) {
+            MAP(std::string_view(line), output);
+        } else if constexpr (std::is_invocable_r_v<std::pair<key, value>, MapFn&, std::string_view>) {
+            output.push(MAP(std::string_view(line)));
+        } else if constexpr (std::is_same_v<Line, std::string>) {
+            output.push(MAP(line));
+        } else {
+            scratch.assign(line);
+            output.push(MAP(scratch));
+        }
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    PhaseStats Mapper<key, value, Partitioner>::run() {
         if (verbose) std::cout << "Starting map phase..." << std::endl;
 
         // Initialize variables
-        isProducerDone = false;
-        produced = false;
-        map_output_file.open(map_output_filename, std::ios::out);
-        if(!map_output_file.is_open())
-            throw std::runtime_error("Cannot open mapper output file: " + map_output_filename);
-
-        // Initialize the consumers
-        if (verbose) std::cout << "Starting mappers..." << std::endl;
-        for (auto i = 0; i < num_mappers; i++)
-            mp_threads[i] = std::thread(&Mapper<key, value>::consumer, this);
-        
-        // Start the producer
-        std::thread producer_thread(&Mapper<key, value>::producer, this);        
-        if (verbose) std::cout << "Mappers executing..." << std::endl;
-        
-        // Wait for threads to finish
-        producer_thread.join();
-        for(auto &consumer_thread: mp_threads)
-            consumer_thread.join();
+        PhaseTimer timer;
+        stats = PhaseStats();
+        buff.reset();
+        shuffle->clear();
+        if (hot_keys)
+            hot_keys->clear();
+        if (memory_budget)
+            memory_budget->resetPeak();
+        const std::size_t spills_before = shuffle->spillCount();
+        const std::size_t spilled_bytes_before = shuffle->spilledBytes();
+        if (!map_output_filename.empty()) {
+            std::fstream map_output_file;
+            map_output_file.open(map_output_filename, std::ios::out);
+            if(!map_output_file.is_open())
+                throw std::runtime_error("Cannot open mapper output file: " + map_output_filename);
+            map_output_file.close();
+        }
+
+        if (options.input_mode == InputMode::MMAP && pool) {
+            // Every worker of the scheduler is a task of the pool
+            MappedFile input_file(input_filename);
+            stats.bytes_in = mappedInput(input_file).size();
+            SplitScheduler scheduler(mappedInput(input_file), num_mappers, options);
+            shuffle->expectWriters(scheduler.workerCount());
+            if (verbose) std::cout << "Starting mappers..." << std::endl;
+            TaskGroup workers(*pool);
+            for(std::size_t i = 0; i < scheduler.workerCount(); i++)
+                workers.submit([this, &scheduler, i]() { splitConsumer(scheduler, i); });
+            if (verbose) std::cout << "Mappers executing..." << std::endl;
+            workers.wait();
+            stats.steals = scheduler.stealCount();
+        } else if (options.input_mode == InputMode::MMAP) {
+            // Every mapper takes tasks off the mapping itself, so there is no producer
+            MappedFile input_file(input_filename);
+            stats.bytes_in = mappedInput(input_file).size();
+            SplitScheduler scheduler(mappedInput(input_file), num_mappers, options);
+            shuffle->expectWriters(scheduler.workerCount());
+            if (verbose) std::cout << "Starting mappers..." << std::endl;
+            for (std::size_t i = 0; i < scheduler.workerCount(); i++)
+                mp_threads[i] = std::thread(&Mapper<key, value, Partitioner>::splitConsumer, this, std::ref(scheduler), i);
+            if (verbose) std::cout << "Mappers executing..." << std::endl;
+
+            // Wait for threads to finish before the mapping goes away
+            for(auto &consumer_thread: mp_threads)
+                if (consumer_thread.joinable())
+                    consumer_thread.join();
+            stats.steals = scheduler.stealCount();
+        } else if (pool) {
+            // The consumers are tasks of the pool and the calling thread produces
+            if (verbose) std::cout << "Starting mappers..." << std::endl;
+            shuffle->expectWriters(num_mappers);
+            TaskGroup workers(*pool);
+            for (auto i = 0; i < num_mappers; i++)
+                workers.submit([this]() {
+                    // A consumer that dies must not leave the producer blocked on a full buffer
+                    try {
+                        consumer();
+                    } catch (...) {
+                        buff.close();
+                        throw;
+                    }
+                });
+            if (verbose) std::cout << "Mappers executing..." << std::endl;
+            try {
+                producer();
+            } catch (...) {
+                buff.close();
+                throw;
+            }
+            workers.wait();
+        } else {
+            // Initialize the consumers
+            if (verbose) std::cout << "Starting mappers..." << std::endl;
+            shuffle->expectWriters(num_mappers);
+            for (auto i = 0; i < num_mappers; i++)
+                mp_threads[i] = std::thread(&Mapper<key, value, Partitioner>::consumer, this);
+            
+            // Start the producer
+            std::thread producer_thread(&Mapper<key, value, Partitioner>::producer, this);        
+            if (verbose) std::cout << "Mappers executing..." << std::endl;
+            
+            // Wait for threads to finish
+            producer_thread.join();
+            for(auto &consumer_thread: mp_threads)
+                consumer_thread.join();
+        }
         if (verbose) std::cout << "Mappers execution complete successfully!" << std::endl;
-        
-        // Close output file
-        map_output_file.close();
+        stats.producer_wait_seconds = buff.producerWaitSeconds();
+        stats.consumer_wait_seconds = buff.consumerWaitSeconds();
+        if (memory_budget) {
+            stats.producer_wait_seconds += memory_budget->waitSeconds();
+            stats.peak_memory = memory_budget->peakBytes();
+        }
+        stats.spill_files = shuffle->spillCount() - spills_before;
+        stats.bytes_out = shuffle->spilledBytes() - spilled_bytes_before;
 
-        // Group the values in the map_output_file by sorting it
-        if (verbose) std::cout << "Grouping values by mapping keys..." << std::endl;
-        sortOutputFile();
-        if (verbose) std::cout << "Grouping completed successfully!" << std::endl;
+        // Group the values in the map_output_file by sorting it. In a shuffle, every reducer merges its own partition instead
+        if (!map_output_filename.empty()) {
+            if (verbose) std::cout << "Grouping values by mapping keys..." << std::endl;
+            sortOutputFile();
+            if (verbose) std::cout << "Grouping completed successfully!" << std::endl;
+        } else if (verbose) {
+            if (shuffle->spillCount() == 0)
+                std::cout << "Map output held in memory" << std::endl;
+            else
+                std::cout << "Map output spilled to " << shuffle->spillCount() << " files" << std::endl;
+        }
 
         // Mapper completed successfully
+        timer.stop(stats);
         if (verbose) std::cout << "Map phase completed successfully!" << std::endl;
+        return stats;
     }
 
-    template<typename key, typename value>
-    void Mapper<key, value>::producer() {
-        // Open the input file
-        std::fstream input_file;
-        input_file.open(input_filename, std::ios::in);
-        if(!input_file.is_open())
-            throw std::runtime_error("Cannot open mapper input file: " + input_filename);
-
-        // Producer starts writing here
-        std::string input_line;
-        while(std::getline(input_file,input_line))
-            // Put the new line into the buffer
-            put(input_line);
-
-        // Mark producer done
-        isProducerDone = true;
-        
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::producer() {
+        TraceSpan span(trace.get(), "map producer");
+
+        // Open the input file. Its next blocks are read in the background while the current one is cut into records
+        FileReader input_file(input_filename, options.io_backend);
+
+        // Producer starts writing here. Records are copied into the strings of a recycled batch to reuse their capacity
+        const std::size_t batch_size = options.batch_size > 0 ? options.batch_size : 1;
+        std::vector<std::string> batch;
+        std::size_t batch_count = 0;
+        bool rejected = false; // Set once the buffer refuses a batch, as a consumer died and closed it
+        auto putBatch = [&]() {
+            const std::size_t in_flight = memory_budget ? memoryFootprint(batch) : 0;
+            if (memory_budget)
+                memory_budget->acquire(in_flight);
+            if (!buff.put(batch)) {
+                if (memory_budget)
+                    memory_budget->releaseInFlight(in_flight);
+                rejected = true;
+            }
+        };
+        auto putRecord = [&](std::string_view record) {
+            if (rejected)
+                return;
+            if (batch_count == batch.size())
+                batch.emplace_back();
+            batch[batch_count].assign(record);
+
+            // Put the batch into the buffer once it is full, and once the memory budget has room for it
+            if (++batch_count == batch_size) {
+                putBatch();
+                batch_count = 0;
+            }
+        };
+
+        // The input is read in large blocks and cut into records in place. The incomplete record at the end of a
+        // block is carried over to the next one, and the block grows if a single record does not fit into it
+        RecordScanner scanner(options);
+        std::vector<char> block(INPUT_BLOCK_SIZE);
+        std::size_t filled = 0;
+        std::size_t bytes_read = 0;
+        bool final = false;
+        while(!final && !rejected) {
+            const std::size_t count = input_file.read(block.data() + filled, block.size() - filled);
+            bytes_read += count;
+            filled += count;
+            final = filled < block.size();
+            const char* rest = scanner.scan(std::string_view(block.data(), filled), final, putRecord);
+            const std::size_t carried = static_cast<std::size_t>(block.data() + filled - rest);
+            std::memmove(block.data(), rest, carried);
+            filled = carried;
+            if (filled == block.size())
+                block.resize(block.size() * 2);
+        }
+
+        // Put the last partial batch into the buffer
+        if (batch_count > 0 && !rejected) {
+            batch.resize(batch_count);
+            putBatch();
+        }
+
         // Must tell all sleeping consumers that the producer is done
-        buff_full.notify_all();
+        buff.close();
+        {
+            std::scoped_lock stats_lock{stats_mutex};
+            stats.bytes_in = bytes_read;
+        }
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::consumer() {
+        TraceSpan span(trace.get(), "map worker");
 
-        // Close input file
-        input_file.close();
+        // Consumer repeats till the producer is done and the buffer is drained
+        std::vector<std::string> batch;
+        WorkerOutput output(*this);
+        while(buff.get(batch)) {
+            // Process every new line. The batch's memory goes back to the budget once it is mapped
+            const std::size_t in_flight = memory_budget ? memoryFootprint(batch) : 0;
+            map_batch(batch, output);
+            if (memory_budget)
+                memory_budget->releaseInFlight(in_flight);
+        }
+
+        // Hand the remaining pairs over as in-memory runs
+        output.close();
     }
 
-    template<typename key, typename value>
-    void Mapper<key, value>::consumer() {
-        // Consumer repeats till the producer is done
-        std::string input_line;
-        while(!isProducerDone || produced) {
-            // Fetch a new input line 
-            if(!get(input_line))
-                break;
-
-            // Process new line
-            auto new_map_pair = MAP(std::ref(input_line));
-
-            // Write emitted value to file
-            std::scoped_lock file_lock{map_output_file_mutex};
-            map_output_file << new_map_pair.first << " " << new_map_pair.second << std::endl;
-        }   
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::splitConsumer(SplitScheduler& scheduler, const std::size_t worker) {
+        TraceSpan span(trace.get(), "map worker");
+        RecordScanner scanner(options);
+        WorkerOutput output(*this);
+        std::string_view task;
+        while(scheduler.next(worker, task))
+            map_split(task, scanner, output);
+        output.close();
     }
 
-    template<typename key, typename value>
-    void Mapper<key, value>::sortOutputFile() {
-        // Sort in a separate forked off process
-        int wstatus;
-        if(fork() == 0) {
-            auto status = execlp("sort", "sort", map_output_filename.c_str(), "-o", map_output_filename.c_str(), (char*)NULL);
-            std::cerr << "Mapper failed at grouping output file. Exited with status code " << status << std::endl;
-        } else {
-            // Wait foor the child sorting process to finish
-            wait(&wstatus);
+    template<typename key, typename value, typename Partitioner>
+    std::string_view Mapper<key, value, Partitioner>::mappedInput(const MappedFile& input_file) const {
+        std::string_view input = input_file.view();
+        if (!input_range)
+            return input;
+        return input.substr(std::min(input_range->first, input.size()), input_range->second);
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::sortOutputFile() {
+        TraceSpan span(trace.get(), "merge map output");
+        // Every mapper thread takes a key range of the k-way merge
+        if (verbose) std::cout << "Merging " << shuffle->getRuns().size() << " sorted runs (" << shuffle->spillCount() << " spill files)..." << std::endl;
+        shuffle->merge(map_output_filename, num_mappers, 0, options.map_output_format);
+        shuffle->clear();
+    }
 
-            // Sorting failed. Throw an exception
-            if(!WIFEXITED(wstatus))
-                throw std::runtime_error("Mapper failed at grouping output file. Mapper failed with status code " + std::to_string(wstatus));
+    template<typename key, typename value, typename Partitioner>
+    Mapper<key, value, Partitioner>::WorkerOutput::WorkerOutput(Mapper& _mapper):
+        mapper(_mapper),
+        sort_buffer(*_mapper.shuffle),
+        lines(0),
+        routed(0),
+        hot_version(0),
+        next_spread(0) {
+        const std::size_t combine_budget = mapper.options.memory_budget > 0
+            ? std::min(mapper.options.combine_memory_budget, mapper.options.memory_budget)
+            : mapper.options.combine_memory_budget;
+        if (mapper.COMBINE && combine_budget > 0)
+            combine_table.emplace(
+                mapper.COMBINE,
+                combine_budget / (mapper.num_mappers > 0 ? mapper.num_mappers : 1),
+                mapper.memory_budget.get()
+            );
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::WorkerOutput::route(std::pair<key, value>&& new_map_pair) {
+        const std::size_t num_partitions = mapper.shuffle->partitionCount();
+        std::size_t partition = 0;
+        if (num_partitions > 1) {
+            if (mapper.hot_keys && routed % HOT_KEY_SAMPLE_INTERVAL == 0)
+                mapper.hot_keys->sample(new_map_pair.first);
+            if (mapper.hot_keys && isHot(new_map_pair.first))
+                partition = next_spread++ % num_partitions;
+            else
+                partition = mapper.partitioner(new_map_pair.first, num_partitions);
+        }
+        sort_buffer.push(partition, std::move(new_map_pair));
+        routed++;
+    }
+
+    template<typename key, typename value, typename Partitioner>
+    bool Mapper<key, value, Partitioner>::WorkerOutput::isHot(const key& item) {
+        const std::size_t version = mapper.hot_keys->version();
+        if (version != hot_version) {
+            hot = mapper.hot_keys->hotKeys();
+            hot_version = version;
         }
+        return !hot.empty() && hot.count(item) > 0;
     }
 
-    template<typename key, typename value>
-    bool Mapper<key, value>::get(std::string& input_buff) {
-         // Wait for a new item to process
-        std::unique_lock consumer_lock{buff_mutex}; 
-        buff_full.wait(consumer_lock, [&]() { return produced || isProducerDone; });
-        if (!produced)
-            return false;
-        input_buff = std::move(buff);
-        produced = false;  
-        consumer_lock.unlock();
-        buff_empty.notify_one();
-        return true;
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::WorkerOutput::push(std::pair<key, value>&& new_map_pair) {
+        if (combine_table)
+            combine_table->add(std::move(new_map_pair), [&](std::pair<key, value>&& partial) { route(std::move(partial)); });
+        else
+            route(std::move(new_map_pair));
     }
 
-    template<typename key, typename value>
-    void Mapper<key, value>::put(std::string& input_line) {
-        // Main producer logic
-        std::unique_lock producer_lock{buff_mutex};
-        buff_empty.wait(producer_lock, [&]() { return !produced; });
-        buff = std::move(input_line);
-        produced = true;
-        producer_lock.unlock();
-        buff_full.notify_one();
+    template<typename key, typename value, typename Partitioner>
+    void Mapper<key, value, Partitioner>::WorkerOutput::close() {
+        if (combine_table)
+            combine_table->flush([&](std::pair<key, value>&& partial) { route(std::move(partial)); });
+        sort_buffer.close();
+
+        std::scoped_lock stats_lock{mapper.stats_mutex};
+        mapper.stats.records_in += lines;
+        mapper.stats.records_out += routed;
     }
 }
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace reduse {
+
+    /** @brief Approximate number of bytes an item occupies in memory, including what it owns on the heap.
+     * Overload this for your own types if they own heap memory, so that memory budgets are honoured
+     * @param item Item to measure
+     */
+    template<typename T>
+    std::size_t memoryFootprint(const T& item) { return sizeof(item); }
+
+    // Declared up front so that nested containers, such as vectors of pairs, find each other's overloads
+    inline std::size_t memoryFootprint(const std::string& item);
+    template<typename T>
+    std::size_t memoryFootprint(const std::vector<T>& item);
+    template<typename A, typename B>
+    std::size_t memoryFootprint(const std::pair<A, B>& item);
+
+    // Short strings live inside the object itself (small string optimization)
+    inline std::size_t memoryFootprint(const std::string& item) {
+        return sizeof(item) + (item.capacity() > 15 ? item.capacity() : 0);
+    }
+
+    template<typename T>
+    std::size_t memoryFootprint(const std::vector<T>& item) {
+        std::size_t footprint = sizeof(item) + (item.capacity() - item.size()) * sizeof(T);
+        for(auto &it: item)
+            footprint += memoryFootprint(it);
+        return footprint;
+    }
+
+    template<typename A, typename B>
+    std::size_t memoryFootprint(const std::pair<A, B>& item) {
+        return memoryFootprint(item.first) + memoryFootprint(item.second);
+    }
+}
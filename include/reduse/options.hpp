@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace reduse {
+
+    const std::size_t DEFAULT_BUFFER_DEPTH = 64; // Default number of batches held by a hand-off buffer
+    const std::size_t DEFAULT_BATCH_SIZE = 256; // Default number of records carried by a single batch
+    const std::size_t DEFAULT_SORT_MEMORY_BUDGET = 256 << 20; // Default bytes of map output buffered in memory before sorted runs are spilled
+    const std::size_t DEFAULT_COMBINE_MEMORY_BUDGET = 64 << 20; // Default bytes of pre-aggregated map output held before it is flushed
+    const std::size_t DEFAULT_OUTPUT_CHUNK_SIZE = 1 << 20; // Default bytes of output a worker collects before appending them to the output file
+    const std::size_t DEFAULT_CACHE_CHUNK_SIZE = 64 << 20; // Default bytes of input whose map output is cached on its own by an incremental job
+    const double DEFAULT_HOT_KEY_SHARE = 0.5; // Default fraction of a partition's share of the map output that makes a key hot
+
+    /** @brief How the map phase reads its input file */
+    enum class InputMode {
+        STREAM, // A single producer reads the input in blocks, cuts it into records and hands them off to the mappers
+        MMAP // The file is memory mapped and every mapper scans its own record aligned byte range
+    };
+
+    /** @brief Layout of the records in the input file. Every record is handed to MAP as a line */
+    enum class RecordFormat {
+        LINES, // Newline terminated records
+        DELIMITED, // Records terminated by Options::record_delimiter
+        FIXED_WIDTH, // Records of exactly Options::record_width bytes, without any terminator
+        LENGTH_PREFIXED, // Records preceded by their byte length as a little-endian 32-bit unsigned integer
+        CSV // Newline terminated records of fields separated by Options::csv_separator. MAP gets the fields listed in Options::csv_fields
+    };
+
+    /** @brief How files are read and written */
+    enum class IoBackend {
+        AUTO, // io_uring if the kernel supports it, POSIX otherwise
+        POSIX, // Blocking pread and pwrite calls on the calling thread
+        IO_URING // Asynchronous requests through a Linux io_uring, overlapping I/O with computation
+    };
+
+    /** @brief Encoding of intermediate records */
+    enum class Format {
+        TEXT, // "key value" lines written with << and read back with >>
+        BINARY // Typed binary records written through reduse::Serializer
+    };
+
+    /** @brief Where the map output is kept until it is reduced */
+    enum class ShuffleMode {
+        AUTO, // Sorted runs stay in memory and are only spilled to disk once sort_memory_budget or memory_budget is exceeded
+        MEMORY // Sorted runs always stay in memory, whatever their size. They are not counted against memory_budget
+    };
+
+    /** @brief Tuning options shared by the map and reduce phases */
+    struct Options {
+        std::size_t buffer_depth = DEFAULT_BUFFER_DEPTH; // Number of batches the hand-off buffer between workers can hold
+        std::size_t batch_size = DEFAULT_BATCH_SIZE; // Number of records handed off to a worker at once
+        InputMode input_mode = InputMode::STREAM; // How the map phase reads its input file
+        std::size_t sort_memory_budget = DEFAULT_SORT_MEMORY_BUDGET; // Bytes of map output all mappers together buffer in memory before spilling sorted runs to disk
+        std::size_t combine_memory_budget = DEFAULT_COMBINE_MEMORY_BUDGET; // Bytes all mappers together spend on combine tables before flushing partial results. 0 turns map-side combining off
+        ShuffleMode shuffle_mode = ShuffleMode::AUTO; // Where the map output is kept until it is reduced
+        Format spill_format = Format::BINARY; // Encoding of the sorted runs spilled to disk during the map phase
+        Format map_output_format = Format::TEXT; // Encoding of the sorted file a Mapper writes to, and a Reducer reads from, map_output_filename
+        std::size_t output_chunk_size = DEFAULT_OUTPUT_CHUNK_SIZE; // Bytes of output every reducer worker collects before appending them to the output file
+        bool pipelined = false; // reduse::reduse starts reducing a partition as soon as every mapper closed it, instead of after the whole map phase. Mappers close their partitions once the input runs out, so only the closing sorts overlap the reduce phase, not the mapping itself
+        std::string trace_filename; // If set, reduse::reduse writes a per-thread timeline of the job to this file in the Chrome trace format
+        bool associative_reduce = false; // REDUCE is associative and commutative, so it may be applied to partial key groups and its own results (requires reduce_value == map_value)
+        bool split_hot_keys = true; // With associative_reduce, reduse::reduse spreads the groups of hot keys over every reducer and merges their partial results
+        double hot_key_share = DEFAULT_HOT_KEY_SHARE; // A key is hot once it holds more than this fraction of a single partition's share of the map output
+        RecordFormat record_format = RecordFormat::LINES; // Layout of the records in the input file
+        char record_delimiter = '\0'; // Byte terminating a record of the RecordFormat::DELIMITED format
+        std::size_t record_width = 0; // Bytes of a record of the RecordFormat::FIXED_WIDTH format
+        char csv_separator = ','; // Field separator of the RecordFormat::CSV format
+        std::vector<std::size_t> csv_fields; // Zero-based fields of a RecordFormat::CSV record passed to MAP, unquoted and joined by csv_separator. The whole record if empty
+        IoBackend io_backend = IoBackend::AUTO; // How the input is read and the spill, merge and output files are written
+        bool encode_keys = false; // reduse::reduse interns the map keys into a dictionary and shuffles integer IDs in their place, decoding them for REDUCE. Ignored with sorted_output, and with cache_directory since the IDs of one run mean nothing to the next
+        bool sorted_output = false; // reduse::reduse writes a "key result" line per key group in ascending key order. The reducers take key ranges picked from samples of the map output, instead of hash partitions
+        std::string cache_directory; // If set, reduse::reduse caches the sorted map output of every input chunk in this directory and only maps new or changed chunks on a rerun
+        std::string cache_tag; // Identifies the job definition whose map output is cached in cache_directory. Change it whenever MAP, REDUCE or COMBINE change, or the cached runs of the old definition are reused
+        std::size_t cache_chunk_size = DEFAULT_CACHE_CHUNK_SIZE; // Bytes of input whose map output is cached on its own, up to the next record boundary
+        std::size_t memory_budget = 0; // If set, bytes reduse::reduse may hold in memory at once across sort buffers, combine tables, batches in flight and key groups. Caps sort_memory_budget and combine_memory_budget. 0 leaves every part to its own budget
+    };
+}
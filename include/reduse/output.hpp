@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <optional>
+#include <mutex>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <reduse/options.hpp>
+#include <reduse/io.hpp>
+
+namespace reduse {
+
+    /** @brief Output file shared by several workers. Workers append whole chunks of text, so the lock and the write
+     * request are paid once per chunk instead of once per record. Chunks are written in the background, so a worker
+     * goes back to reducing as soon as its chunk is queued
+     */
+    class SharedOutput {
+    private:
+
+        std::optional<FileWriter> output; // Writer of the open file
+        std::mutex output_mutex; // Mutex lock over output
+
+    public:
+
+        /** @brief Opens (and truncates) the output file
+         * @param filename Relative or absolute path to the output file
+         * @param backend Backend running the writes. Set to IoBackend::AUTO by default
+         */
+        void open(const std::string& filename, const IoBackend backend = IoBackend::AUTO);
+
+        /** @brief Appends a chunk of text to the file as a whole. Takes the contents of chunk and leaves it empty. Thread safe */
+        void append(std::string& chunk);
+
+        /** @brief Closes the file, throwing if any write failed */
+        void close();
+    };
+
+    /** @brief Per-worker text buffer in front of a SharedOutput. Not thread safe; every worker owns its own ChunkWriter */
+    class ChunkWriter {
+    private:
+
+        SharedOutput& output; // File the chunks are committed to
+        const std::size_t chunk_size; // Bytes collected before a chunk is committed
+        std::ostringstream chunk; // Text not yet committed
+        std::size_t written; // Bytes committed so far
+
+    public:
+
+        /** @brief Constructor for the ChunkWriter
+         * @param _output File the chunks are committed to
+         * @param _chunk_size Bytes collected before a chunk is committed
+         */
+        ChunkWriter(SharedOutput& _output, const std::size_t _chunk_size): output(_output), chunk_size(_chunk_size), written(0) {}
+
+        ChunkWriter(const ChunkWriter&) = delete;
+        ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+        /** @brief Destructor. Commits the remaining text */
+        ~ChunkWriter() { flush(); }
+
+        /** @brief Writes an item followed by a newline, committing the chunk once it is full */
+        template<typename T>
+        void writeLine(const T& item) {
+            chunk << item << '\n';
+            if (static_cast<std::size_t>(chunk.tellp()) >= chunk_size)
+                flush();
+        }
+
+        /** @brief Writes two items separated by a space and followed by a newline, committing the chunk once it is full */
+        template<typename K, typename T>
+        void writeLine(const K& first, const T& second) {
+            chunk << first << ' ' << second << '\n';
+            if (static_cast<std::size_t>(chunk.tellp()) >= chunk_size)
+                flush();
+        }
+
+        /** @brief Commits the collected text to the file */
+        void flush();
+
+        /** @brief Returns the number of bytes committed so far */
+        std::size_t bytesWritten() const { return written; }
+    };
+
+    // ----- Definitions ------
+
+    inline void SharedOutput::open(const std::string& filename, const IoBackend backend) {
+        std::scoped_lock output_lock{output_mutex};
+        output.reset();
+        try {
+            output.emplace(filename, backend);
+        } catch (const std::runtime_error&) {
+            throw std::runtime_error("Cannot open reduse output file: " + filename);
+        }
+    }
+
+    inline void SharedOutput::append(std::string& chunk) {
+        std::scoped_lock output_lock{output_mutex};
+        output->append(chunk);
+    }
+
+    inline void SharedOutput::close() {
+        std::scoped_lock output_lock{output_mutex};
+        if (output)
+            output->close();
+    }
+
+    inline void ChunkWriter::flush() {
+        if (chunk.tellp() <= 0)
+            return;
+        std::string text = chunk.str();
+        written += text.size();
+        output.append(text);
+        chunk.str(std::string());
+    }
+}
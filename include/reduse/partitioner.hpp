@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace reduse {
+
+    /** @brief Default partitioner. Assigns a key to a partition by its hash
+     * @param key Data type of the key to partition
+     * @param Hash Hash function object for key. std::hash<key> by default
+     *
+     * Any default constructible function object callable as std::size_t(const key&, std::size_t num_partitions)
+     * and returning a value below num_partitions can be used as a partitioner instead.
+     */
+    template<typename key, typename Hash = std::hash<key>>
+    struct HashPartitioner {
+        Hash hash; // Hash function object
+
+        std::size_t operator()(const key& item, const std::size_t num_partitions) const {
+            // Fibonacci hashing spreads weak hashes, like the identity hash of integers, over all the partitions
+            std::uint64_t mixed = static_cast<std::uint64_t>(hash(item)) * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>((mixed >> 32) % num_partitions);
+        }
+    };
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <reduse/options.hpp>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace reduse {
+
+    const std::size_t INPUT_BLOCK_SIZE = 1 << 20; // Bytes the map producer reads from the input file at once
+    const std::size_t RECORD_LENGTH_PREFIX = sizeof(std::uint32_t); // Bytes of the length prefix of a RecordFormat::LENGTH_PREFIXED record
+
+    /** @brief Returns the first occurrence of target in [begin, end), or end if there is none.
+     * Compares 32 bytes at once with AVX2 or 16 with SSE2, when the compiler targets them, and falls back to memchr
+     */
+    inline const char* findByte(const char* begin, const char* end, const char target) {
+#if defined(__AVX2__)
+        const __m256i pattern = _mm256_set1_epi8(target);
+        for(; end - begin >= 32; begin += 32) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern)));
+            if (mask != 0)
+                return begin + __builtin_ctz(mask);
+        }
+#elif defined(__SSE2__)
+        const __m128i pattern = _mm_set1_epi8(target);
+        for(; end - begin >= 16; begin += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)));
+            if (mask != 0)
+                return begin + __builtin_ctz(mask);
+        }
+#endif
+        if (begin >= end)
+            return end;
+        auto found = static_cast<const char*>(std::memchr(begin, target, end - begin));
+        return found != nullptr ? found : end;
+    }
+
+    /** @brief Splits raw input into the records handed to MAP, in the format set by Options::record_format.
+     * Not thread safe; every worker owns its own scanner
+     */
+    class RecordScanner {
+    private:
+
+        const RecordFormat format; // Layout of the records
+        const char delimiter; // Byte ending a record of the LINES, DELIMITED and CSV formats
+        const std::size_t width; // Bytes of a FIXED_WIDTH record
+        const char separator; // Field separator of the CSV format
+        const std::vector<std::size_t> fields; // Fields projected out of a CSV record. The whole record if empty
+        std::vector<std::pair<std::size_t, std::size_t>> field_bounds; // Offset and length in unquoted of every field of the current CSV record
+        std::string unquoted; // Unquoted fields of the current CSV record
+        std::string projection; // Projected fields of the current CSV record
+
+        /** @brief Returns the projected fields of a CSV record, unquoted and joined by the separator */
+        std::string_view project(std::string_view record);
+
+        /** @brief Returns the byte length of the record starting at curr, or end - curr + 1 if it is incomplete */
+        std::size_t recordLength(const char* curr, const char* end) const;
+
+    public:
+
+        /** @brief Constructor for the RecordScanner
+         * @param options Tuning options holding the record format. See reduse::Options
+         */
+        explicit RecordScanner(const Options& options);
+
+        /** @brief Calls fn on every complete record of text, in order
+         * @param text Bytes to scan. Must start at the beginning of a record
+         * @param final Set true if text ends the input. The last record then needs no delimiter; a truncated
+         * FIXED_WIDTH or LENGTH_PREFIXED record raises a std::runtime_error
+         * @param fn Callable taking a std::string_view of a record, without its delimiter or length prefix
+         * @return Start of the incomplete record left at the end of text. The end of text if final
+         */
+        template<typename Fn>
+        const char* scan(std::string_view text, const bool final, Fn&& fn);
+
+        /** @brief Splits text into at most num_splits contiguous ranges of about equal size that all start at the
+         * beginning of a record. Empty ranges are dropped
+         * @param text Whole input
+         * @param num_splits Desired number of ranges
+         */
+        std::vector<std::string_view> split(std::string_view text, const std::size_t num_splits) const;
+
+        /** @brief Returns the offset of the first record of text starting at or after offset, or the size of text if
+         * there is none
+         * @param text Bytes to search. Must start at the beginning of a record
+         * @param offset Offset to search from
+         */
+        std::size_t nextBoundary(std::string_view text, const std::size_t offset) const;
+    };
+
+    // ----- Definitions ------
+
+    inline RecordScanner::RecordScanner(const Options& options):
+        format(options.record_format),
+        delimiter(options.record_format == RecordFormat::DELIMITED ? options.record_delimiter : '\n'),
+        width(options.record_width),
+        separator(options.csv_separator),
+        fields(options.csv_fields) {
+        if (format == RecordFormat::FIXED_WIDTH && width == 0)
+            throw std::invalid_argument("RecordFormat::FIXED_WIDTH requires a non-zero Options::record_width");
+    }
+
+    inline std::size_t RecordScanner::recordLength(const char* curr, const char* end) const {
+        const std::size_t available = static_cast<std::size_t>(end - curr);
+        if (format == RecordFormat::FIXED_WIDTH)
+            return width <= available ? width : available + 1;
+        if (format == RecordFormat::LENGTH_PREFIXED) {
+            if (available < RECORD_LENGTH_PREFIX)
+                return available + 1;
+            std::uint32_t length;
+            std::memcpy(&length, curr, RECORD_LENGTH_PREFIX);
+            return RECORD_LENGTH_PREFIX + length <= available ? RECORD_LENGTH_PREFIX + length : available + 1;
+        }
+        const char* found = findByte(curr, end, delimiter);
+        return found < end ? static_cast<std::size_t>(found - curr) + 1 : available + 1;
+    }
+
+    template<typename Fn>
+    const char* RecordScanner::scan(std::string_view text, const bool final, Fn&& fn) {
+        const char* curr = text.data();
+        const char* end = text.data() + text.size();
+        while(curr < end) {
+            switch(format) {
+                case RecordFormat::FIXED_WIDTH:
+                    if (static_cast<std::size_t>(end - curr) < width) {
+                        if (final)
+                            throw std::runtime_error("Truncated fixed-width record at the end of the input");
+                        return curr;
+                    }
+                    fn(std::string_view(curr, width));
+                    curr += width;
+                    break;
+
+                case RecordFormat::LENGTH_PREFIXED: {
+                    const std::size_t length = recordLength(curr, end);
+                    if (length > static_cast<std::size_t>(end - curr)) {
+                        if (final)
+                            throw std::runtime_error("Truncated length-prefixed record at the end of the input");
+                        return curr;
+                    }
+                    fn(std::string_view(curr + RECORD_LENGTH_PREFIX, length - RECORD_LENGTH_PREFIX));
+                    curr += length;
+                    break;
+                }
+
+                default: {
+                    // Like std::getline, the last record needs no delimiter but an empty one is not a record
+                    const char* found = findByte(curr, end, delimiter);
+                    if (found == end && !final)
+                        return curr;
+                    std::string_view record(curr, found - curr);
+                    fn(format == RecordFormat::CSV && !fields.empty() ? project(record) : record);
+                    curr = found < end ? found + 1 : end;
+                }
+            }
+        }
+        return end;
+    }
+
+    inline std::string_view RecordScanner::project(std::string_view record) {
+        // Cut the record into fields. A quoted field may hold separators and "" stands for a quote inside it
+        field_bounds.clear();
+        unquoted.clear();
+        const char* curr = record.data();
+        const char* end = record.data() + record.size();
+        while(true) {
+            if (curr < end && *curr == '"') {
+                const std::size_t start = unquoted.size();
+                for(curr++; curr < end; curr++) {
+                    if (*curr == '"') {
+                        if (curr + 1 < end && curr[1] == '"')
+                            curr++;
+                        else
+                            break;
+                    }
+                    unquoted.push_back(*curr);
+                }
+                field_bounds.emplace_back(start, unquoted.size() - start);
+                curr = findByte(std::min(curr + 1, end), end, separator);
+            } else {
+                const char* found = findByte(curr, end, separator);
+                field_bounds.emplace_back(unquoted.size(), found - curr);
+                unquoted.append(curr, found - curr);
+                curr = found;
+            }
+            if (curr >= end)
+                break;
+            curr++;
+        }
+
+        // Join the projected fields. Fields past the end of the record are empty
+        projection.clear();
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            if (i > 0)
+                projection.push_back(separator);
+            if (fields[i] < field_bounds.size())
+                projection.append(unquoted, field_bounds[fields[i]].first, field_bounds[fields[i]].second);
+        }
+        return projection;
+    }
+
+    inline std::size_t RecordScanner::nextBoundary(std::string_view text, const std::size_t offset) const {
+        const char* data = text.data();
+        const std::size_t length = text.size();
+        if (offset == 0 || offset >= length)
+            return std::min(offset, length);
+        if (format == RecordFormat::FIXED_WIDTH)
+            return std::min((offset + width - 1) / width * width, length);
+        if (format == RecordFormat::LENGTH_PREFIXED) {
+            // Record starts are only known by hopping from prefix to prefix
+            std::size_t boundary = 0;
+            while(boundary < offset)
+                boundary += std::min(recordLength(data + boundary, data + length), length - boundary);
+            return boundary;
+        }
+        const char* found = findByte(data + offset - 1, data + length, delimiter);
+        return found < data + length ? static_cast<std::size_t>(found - data) + 1 : length;
+    }
+
+    inline std::vector<std::string_view> RecordScanner::split(std::string_view text, const std::size_t num_splits) const {
+        const std::size_t length = text.size();
+        const std::size_t parts = num_splits > 0 ? num_splits : 1;
+        std::vector<std::string_view> splits;
+        std::size_t begin = 0;
+        for(std::size_t i = 1; i <= parts && begin < length; i++) {
+            // Every boundary is searched from the previous one, so a length-prefixed input is only hopped through once
+            const std::size_t target = i == parts ? length : length / parts * i;
+            const std::size_t end = target > begin ? begin + nextBoundary(text.substr(begin), target - begin) : begin;
+            if (end > begin)
+                splits.emplace_back(text.data() + begin, end - begin);
+            begin = end;
+        }
+        return splits;
+    }
+}
@@ -9,11 +9,44 @@
 #include <fstream>
 #include <functional>
 #include <exception>
+#include <utility>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <map>
+#include <type_traits>
+#include <algorithm>
+#include <cstdio>
+#include <reduse/options.hpp>
+#include <reduse/ring_buffer.hpp>
+#include <reduse/output.hpp>
+#include <reduse/io.hpp>
+#include <reduse/values.hpp>
+#include <reduse/sorter.hpp>
+#include <reduse/stats.hpp>
+#include <reduse/thread_pool.hpp>
+#include <reduse/hot_keys.hpp>
+#include <reduse/budget.hpp>
+#include <reduse/emitter.hpp>
+#include <reduse/memory.hpp>
 
 namespace reduse {
 
     const int DEFAULT_NUM_REDUCERS = 1; // Default number of reducer workers
 
+    /** @brief Indicates if ReduceFn can be used as a streaming REDUCE, pulling the values of a key group from a ValueStream */
+    template<typename ReduceFn, typename map_key, typename map_value, typename reduce_value>
+    inline constexpr bool is_stream_reduce_v =
+        std::is_invocable_r_v<reduce_value, ReduceFn&, const map_key&, ValueStream<map_value>&>;
+
+    /** @brief Indicates if ReduceFn can be used as a REDUCE: either taking every value of a key group in a
+     * std::vector<map_value>&, or streaming them from a ValueStream<map_value>&
+     */
+    template<typename ReduceFn, typename map_key, typename map_value, typename reduce_value>
+    inline constexpr bool is_reduce_v =
+        std::is_invocable_r_v<reduce_value, ReduceFn&, map_key, std::vector<map_value>&> ||
+        is_stream_reduce_v<ReduceFn, map_key, map_value, reduce_value>;
+
     /** @brief Handles the reduce phase
      * @param map_key Type of the key produced during the mapping phase
      * @param map_value Type of the value produced during the mapping phase
@@ -23,22 +56,33 @@ namespace reduse {
     class Reducer {
     private:
 
-        const std::string map_output_filename; // Input file for the reduce phase (produced by map phase)
+        const std::string map_output_filename; // Input file for the reduce phase (produced by map phase). Unused with a shuffle
+        const std::shared_ptr<ExternalSorter<map_key, map_value>> shuffle; // Partitioned input for the reduce phase (produced by map phase). Null with an input file
         const std::string output_filename; // Output file of the reduce phase
-        const std::function<reduce_value(map_key, std::vector<map_value>&)> REDUCE; // Reducer routine
+        using group_type = std::pair<map_key, std::vector<map_value>>; // A key along with all of its values
+        class WorkerOutput;
+
+        const std::function<void(std::vector<group_type>&, WorkerOutput&)> reduce_batch; // Applies REDUCE to every key group of a batch
+        const std::function<void(RunMerger<map_key, map_value>&, WorkerOutput&)> reduce_merged; // Applies REDUCE to every key group of a merged partition
         const int num_reducers; // Number of reducer workers
         const bool verbose; // Verbose output to console
+        const Options options; // Tuning options
 
-        std::fstream output_file; // Reducer's output filestream
-        map_key buff_key; // Item buffer for the key 
-        std::vector<reduce_value> buff_values; // Item buffer for the values associated with the key
-        std::atomic_bool isProducerDone; // Indicates if the producer worker is finished reading the input
-        bool produced; // Indicates if the producer worker has produced a new item or not
+        SharedOutput output_file; // Reducer's output file. Every worker appends whole chunks to it
         std::vector<std::thread> rd_threads; // List of consumer workers
-        std::mutex buff_mutex; // Mutex lock over the buffer
-        std::mutex output_file_mutex; // Mutex lock over the output file
-        std::condition_variable buff_empty; // Signals if the buffer is empty
-        std::condition_variable buff_full; // Signals if the buffer is full
+        RingBuffer<group_type> buff; // Buffer of key group batches
+        RingBuffer<std::size_t> ready; // Shuffle partitions ready to be reduced, in the order they became final
+        std::optional<TaskGroup> tasks; // Tasks reducing a shuffle partition each. Only used with a pool
+        std::optional<PhaseTimer> timer; // Measures a run over a shuffle, from start() to finish()
+        std::shared_ptr<HotKeyDetector<map_key>> hot_keys; // Keys whose groups are spread over every partition. None if unset
+        std::function<reduce_value(const map_key&, std::vector<reduce_value>&)> merge_partials; // Merges the partial results of a hot key
+        std::map<map_key, std::pair<std::vector<reduce_value>, std::size_t>> hot_partials; // Partial results and total group size of every hot key. Guarded by stats_mutex
+        std::shared_ptr<TraceRecorder> trace; // Receives a span per worker and partition. Not traced if unset
+        std::shared_ptr<ThreadPool> pool; // Runs the workers. Workers get threads of their own if unset
+        std::shared_ptr<MemoryBudget> memory_budget; // Job-wide budget of the batches in flight and the collected key groups. None if unset
+        std::function<std::unique_ptr<ResultSink<map_key, reduce_value>>()> make_sink; // Creates the result sink of every worker. Results only go to the output file if unset
+        PhaseStats stats; // Statistics of the current run
+        std::mutex stats_mutex; // Mutex over stats
         
         /** @brief Reducer worker routine */
         void consumer();
@@ -46,18 +90,151 @@ namespace reduse {
         /** @brief File reader worker routine */
         void producer();
 
-        /** @brief Adds a new item into the buffer
-         * @param new_key key of the new item
-         * @param new_values List of values corresponding to the item
+        /** @brief Reducer worker routine for a shuffle. Takes whole partitions as they become ready */
+        void partitionConsumer();
+
+        /** @brief Merges the runs of a shuffle partition and reduces every key group */
+        void reducePartition(const std::size_t partition, WorkerOutput& output);
+
+        /** @brief Returns true if the partitions are cut into key ranges: for Options::sorted_output, and whenever the
+         * shuffle has fewer partitions than there are workers
+         */
+        bool reducesRanges() const { return options.sorted_output || shuffle->partitionCount() < static_cast<std::size_t>(num_reducers); }
+
+        /** @brief Reduces every partition of the shuffle, in order. Every partition is cut into key ranges sampled from
+         * its runs, the workers reduce whole ranges into segment files of their own, and the segments are finally
+         * concatenated into the output file in key order
+         */
+        void reduceRanges();
+
+        /** @brief Applies REDUCE to a collected key group and writes the result to the worker's output chunk.
+         * The key is moved into REDUCE, unless the output needs it as well
          */
-        void put(map_key &new_key, std::vector<map_value> &new_values);
+        template<typename ReduceFn>
+        static void reduceGroup(ReduceFn& REDUCE, map_key& curr_key, std::vector<map_value>& curr_values, WorkerOutput& output);
 
+        /** @brief Folds a key group collected so far into a single partial result, if the worker folds groups that
+         * outgrow the memory budget. See WorkerOutput::holdValue
+         */
+        template<typename ReduceFn>
+        static void foldGroup(ReduceFn& REDUCE, const map_key& curr_key, std::vector<map_value>& curr_values, WorkerOutput& output);
+
+        /** @brief Applies REDUCE to a collected key group, in whichever form REDUCE takes it. The key is forwarded to
+         * REDUCE, so an rvalue is moved into it and an lvalue is only copied if REDUCE takes its key by value
+         */
+        template<typename ReduceFn, typename Key>
+        static reduce_value applyReduce(ReduceFn& REDUCE, Key&& curr_key, std::vector<map_value>& curr_values);
+
+        /** @brief Applies REDUCE to every key group of a merged partition and writes the results to the worker's output chunk.
+         * A streaming REDUCE pulls the values straight out of the merge
+         */
+        template<typename ReduceFn>
+        static void reduceMerged(ReduceFn& REDUCE, RunMerger<map_key, map_value>& merger, WorkerOutput& output);
 
-        /** @brief Fetches a new item into the buffer. Returns true if some item is fetched otherwise false
-         * @param new_key Location to put the key of the new item
-         * @param new_values Location to put the list of values of the new item
+        /** @brief Output side of a single reducer worker. Collects the results in an output chunk, sets the partial
+         * results of hot keys aside and counts the key groups
          */
-        bool get(map_key &new_key, std::vector<map_value> &new_values);
+        class WorkerOutput {
+        private:
+
+            Reducer& reducer; // Reducer owning the worker
+            ChunkWriter writer; // Worker's output chunk
+            const bool keyed; // Writes the key in front of every result
+            std::unique_ptr<ResultSink<map_key, reduce_value>> sink; // Receives every result along with its key. None without a result sink
+            const bool folds; // Folds key groups that outgrow the memory budget into partial results. Needs an associative REDUCE
+            std::size_t records_in; // Number of values reduced by the worker
+            std::size_t key_groups; // Number of key groups reduced by the worker
+            std::size_t largest_group; // Number of values of the largest key group reduced by the worker
+            key_set<map_key> hot; // Keys whose groups are spread over every partition
+            std::vector<std::tuple<map_key, reduce_value, std::size_t>> partials; // Partial results of hot keys and their group sizes
+            std::size_t group_bytes; // Approximate memory held by the values of the current key group
+            std::size_t group_reserved; // Bytes of the current key group reserved from the memory budget
+            std::size_t group_folded; // Values of the current key group already folded into a partial result
+
+            /** @brief Ends the current key group: gives its memory back and returns its number of values
+             * @param group_size Number of values passed to REDUCE for the last part of the group
+             */
+            std::size_t endGroup(const std::size_t group_size);
+
+        public:
+
+            /** @brief Constructor for the WorkerOutput
+             * @param _reducer Reducer owning the worker
+             * @param _output File the worker's chunks are committed to
+             */
+            WorkerOutput(Reducer& _reducer, SharedOutput& _output);
+
+            /** @brief Returns true if the key of a group must be passed to write along with its result */
+            bool isKeyed() const { return keyed; }
+
+            /** @brief Returns true if key groups that outgrow the memory budget are folded into partial results */
+            bool foldsGroups() const { return folds; }
+
+            /** @brief Counts a value collected into the current key group against the memory budget
+             * @return False if the budget ran short, in which case the group should be folded. Always true unless the
+             * worker folds groups
+             */
+            bool holdValue(const map_value& item);
+
+            /** @brief Counts the values of the current key group folded into a partial result and gives their memory back
+             * @param count Number of values folded
+             */
+            void countFolded(const std::size_t count);
+
+            /** @brief Writes the result of a key group
+             * @param result Result of REDUCE
+             * @param group_size Number of values of the key group
+             */
+            void write(const reduce_value& result, const std::size_t group_size);
+
+            /** @brief Writes the result of a key group, along with its key if the output is keyed
+             * @param item Key of the group
+             * @param result Result of REDUCE
+             * @param group_size Number of values of the key group
+             */
+            void write(const map_key& item, const reduce_value& result, const std::size_t group_size);
+
+            /** @brief Takes a copy of the hot keys. They are final once the map phase has closed a partition */
+            void refreshHotKeys() {
+                if (reducer.hot_keys)
+                    hot = reducer.hot_keys->hotKeys();
+            }
+
+            /** @brief Returns true if the group of a key is spread over every partition */
+            bool isHot(const map_key& item) const { return !hot.empty() && hot.count(item) > 0; }
+
+            /** @brief Sets the partial result of a hot key aside, to be merged with the other partitions' at the end
+             * @param item Hot key
+             * @param partial Result of REDUCE over the part of the key group in one partition
+             * @param group_size Number of values of the part
+             */
+            void writePartial(map_key&& item, reduce_value&& partial, const std::size_t group_size);
+
+            /** @brief Commits the remaining results, hands the partial results over and adds the worker's counters to
+             * the statistics of the run
+             */
+            void close();
+        };
+
+        /** @brief Delegated constructor storing the reduce loops instantiated for the user's REDUCE */
+        Reducer(
+            const std::string& _map_output_filename,
+            const std::shared_ptr<ExternalSorter<map_key, map_value>>& _shuffle,
+            const std::string& _output_filename,
+            const std::function<void(std::vector<group_type>&, WorkerOutput&)>& _reduce_batch,
+            const std::function<void(RunMerger<map_key, map_value>&, WorkerOutput&)>& _reduce_merged,
+            const int _num_reducers,
+            const bool _verbose,
+            const Options& _options
+        );
+
+        /** @brief Returns the loop applying REDUCE to a batch of key groups. REDUCE is called directly, so it can be inlined */
+        template<typename ReduceFn>
+        static std::function<void(std::vector<group_type>&, WorkerOutput&)> batchReduce(ReduceFn&& _REDUCE);
+
+        /** @brief Returns the loop applying REDUCE to a merged partition. REDUCE is called directly, so it can be inlined */
+        template<typename ReduceFn>
+        static std::function<void(RunMerger<map_key, map_value>&, WorkerOutput&)> mergedReduce(ReduceFn&& _REDUCE);
 
     public:
 
@@ -68,99 +245,415 @@ namespace reduse {
         /** @brief Constructor for the Reducer object 
          * @param _map_output_filename Filename for the output file produced by the mapper phase
          * @param _output_filename Filename for the output file to be produced by the reducer phase
-         * @param _REDUCE The reducer function
+         * @param _REDUCE The reducer function, callable as reduce_value(map_key, std::vector<map_value>&) or
+         * reduce_value(const map_key&, reduse::ValueStream<map_value>&)
          * @param _num_reducers Number of parallel reducer workers. Set to 1 by default, for no concurrency
+         * @param _verbose Set true if you want the a verbose output. Useful for debugging
+         * @param _options Tuning options. See reduse::Options
         */
+        template<typename ReduceFn, typename = std::enable_if_t<is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>>
         Reducer(
-            const std::string _map_output_filename,
-            const std::string _output_filename,
-            const std::function<reduce_value(map_key, std::vector<map_value>&)> _REDUCE,
+            const std::string& _map_output_filename,
+            const std::string& _output_filename,
+            ReduceFn&& _REDUCE,
             const int _num_reducers = DEFAULT_NUM_REDUCERS,
-            const bool _verbose = false
+            const bool _verbose = false,
+            const Options& _options = Options()
         );
 
-        /** @brief Routine to run the Reducer instance */
-        void run();
+        /** @brief Constructor for the Reducer object reading a partitioned shuffle. Every reducer worker owns whole
+         * partitions, so key groups are formed without any shared producer or buffer
+         * @param _shuffle Shuffle filled by a Mapper
+         * @param _output_filename Filename for the output file to be produced by the reducer phase
+         * @param _REDUCE The reducer function, callable as reduce_value(map_key, std::vector<map_value>&) or
+         * reduce_value(const map_key&, reduse::ValueStream<map_value>&). A streaming REDUCE pulls the values straight
+         * out of the merged runs, so a key group never has to fit in memory
+         * @param _num_reducers Number of parallel reducer workers. Set to 1 by default, for no concurrency
+         * @param _verbose Set true if you want the a verbose output. Useful for debugging
+         * @param _options Tuning options. See reduse::Options
+        */
+        template<typename ReduceFn, typename = std::enable_if_t<is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>>
+        Reducer(
+            const std::shared_ptr<ExternalSorter<map_key, map_value>>& _shuffle,
+            const std::string& _output_filename,
+            ReduceFn&& _REDUCE,
+            const int _num_reducers = DEFAULT_NUM_REDUCERS,
+            const bool _verbose = false,
+            const Options& _options = Options()
+        );
+
+        /** @brief Records a span per worker and per partition of every run into a trace
+         * @param _trace Recorder receiving the spans. Set to nullptr to stop tracing
+         */
+        void setTrace(const std::shared_ptr<TraceRecorder>& _trace) { trace = _trace; }
+
+        /** @brief Runs the workers of every run as tasks of a pool instead of on threads of their own. The producer
+         * runs on the calling thread, so workers waiting for input never hold up the pool
+         * @param _pool Pool running the workers. Set to nullptr to start threads again
+         */
+        void setPool(const std::shared_ptr<ThreadPool>& _pool) { pool = _pool; }
+
+        /** @brief Reserves the memory of the key group batches in flight, and of the key groups collected for a REDUCE
+         * taking a std::vector, from a job-wide budget. The producer waits for the workers to give memory back before it
+         * reads on. With Options::associative_reduce, a key group that outgrows the budget is folded into a partial
+         * result by REDUCE and collection goes on from there. A streaming REDUCE never holds a key group
+         * @param _memory_budget Job-wide budget. Set to nullptr to stop accounting
+         */
+        void setMemoryBudget(const std::shared_ptr<MemoryBudget>& _memory_budget) { memory_budget = _memory_budget; }
+
+        /** @brief Hands the results of every run to sinks, one per worker, along with their keys. The results are also
+         * written to the output file, as "key result" lines, unless the output filename is empty. Not used with a
+         * standalone input file, and partitions cut into key ranges still need an output file
+         * @param _make_sink Creates the sink of a worker. Called once per worker, and once more for the results of hot
+         * keys. Set to nullptr to only write the output file
+         */
+        void setResultSink(const std::function<std::unique_ptr<ResultSink<map_key, reduce_value>>()>& _make_sink) { make_sink = _make_sink; }
+
+        /** @brief Merges the groups of hot keys spread over every partition of the shuffle by Mapper::setHotKeys. Every
+         * partition reduces its part of a hot key group into a partial result, and the partial results are merged at the
+         * end of the run. Only used over a shuffle
+         * @param _hot_keys Detector shared with the Mapper. Set to nullptr if no keys are spread
+         * @param _merge_partials Merges the partial results of a key into its final result. Must be associative and
+         * commutative, e.g. an associative REDUCE
+         */
+        void setHotKeys(
+            const std::shared_ptr<HotKeyDetector<map_key>>& _hot_keys,
+            const std::function<reduce_value(const map_key&, std::vector<reduce_value>&)>& _merge_partials
+        ) {
+            hot_keys = _hot_keys;
+            merge_partials = _merge_partials;
+        }
+
+        /** @brief Routine to run the Reducer instance. Returns the statistics of the run */
+        PhaseStats run();
+
+        /** @brief Starts a run over a shuffle that reduces partitions as they are handed in by partitionReady, e.g.
+         * while the Mapper is still filling other partitions. See ExternalSorter::setFinalHandler. Partitions cut into
+         * key ranges are all reduced by finish(). With Options::sorted_output they must hold ascending key ranges, e.g. a
+         * single partition
+         */
+        void start();
+
+        /** @brief Hands in a shuffle partition whose runs are final. Never blocks. Thread safe
+         * @param partition Partition to reduce
+         */
+        void partitionReady(const std::size_t partition);
+
+        /** @brief Waits for every partition handed in since start() to be reduced and ends the run. Returns the
+         * statistics of the run
+         */
+        PhaseStats finish();
     };
 
     // ------- Definitions --------
 
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn, typename>
+    Reducer<map_key, map_value, reduce_value>::Reducer(
+        const std::string& _map_output_filename,
+        const std::string& _output_filename,
+        ReduceFn&& _REDUCE,
+        const int _num_reducers,
+        const bool _verbose,
+        const Options& _options
+    ):  Reducer(
+            _map_output_filename,
+            nullptr,
+            _output_filename,
+            batchReduce(_REDUCE),
+            mergedReduce(_REDUCE),
+            _num_reducers,
+            _verbose,
+            _options
+        ) {}
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn, typename>
+    Reducer<map_key, map_value, reduce_value>::Reducer(
+        const std::shared_ptr<ExternalSorter<map_key, map_value>>& _shuffle,
+        const std::string& _output_filename,
+        ReduceFn&& _REDUCE,
+        const int _num_reducers,
+        const bool _verbose,
+        const Options& _options
+    ):  Reducer("", _shuffle, _output_filename, batchReduce(_REDUCE), mergedReduce(_REDUCE), _num_reducers, _verbose, _options) {}
+
     template<typename map_key, typename map_value, typename reduce_value>
     Reducer<map_key, map_value, reduce_value>::Reducer(
-        const std::string _map_output_filename,
-        const std::string _output_filename,
-        const std::function<reduce_value(map_key, std::vector<map_value>&)> _REDUCE,
+        const std::string& _map_output_filename,
+        const std::shared_ptr<ExternalSorter<map_key, map_value>>& _shuffle,
+        const std::string& _output_filename,
+        const std::function<void(std::vector<group_type>&, WorkerOutput&)>& _reduce_batch,
+        const std::function<void(RunMerger<map_key, map_value>&, WorkerOutput&)>& _reduce_merged,
         const int _num_reducers,
-        const bool _verbose
+        const bool _verbose,
+        const Options& _options
     ):  map_output_filename(_map_output_filename),
+        shuffle(_shuffle),
         output_filename(_output_filename),
-        REDUCE(_REDUCE),
+        reduce_batch(_reduce_batch),
+        reduce_merged(_reduce_merged),
         num_reducers(_num_reducers),
         verbose(_verbose),
-        isProducerDone(false),
-        produced(false),
-        rd_threads(std::vector<std::thread>(_num_reducers)) {}
+        options(_options),
+        rd_threads(std::vector<std::thread>(_num_reducers)),
+        buff(_options.buffer_depth),
+        ready(_shuffle ? _shuffle->partitionCount() : 1) {}
 
     template<typename map_key, typename map_value, typename reduce_value>
-    void Reducer<map_key, map_value, reduce_value>::run() {
+    template<typename ReduceFn>
+    std::function<void(std::vector<typename Reducer<map_key, map_value, reduce_value>::group_type>&, typename Reducer<map_key, map_value, reduce_value>::WorkerOutput&)>
+    Reducer<map_key, map_value, reduce_value>::batchReduce(ReduceFn&& _REDUCE) {
+        return [REDUCE = std::decay_t<ReduceFn>(_REDUCE)](std::vector<group_type>& batch, WorkerOutput& output) mutable {
+            for(auto &[curr_key, curr_values]: batch)
+                reduceGroup(REDUCE, curr_key, curr_values, output);
+        };
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn>
+    std::function<void(RunMerger<map_key, map_value>&, typename Reducer<map_key, map_value, reduce_value>::WorkerOutput&)>
+    Reducer<map_key, map_value, reduce_value>::mergedReduce(ReduceFn&& _REDUCE) {
+        return [REDUCE = std::decay_t<ReduceFn>(_REDUCE)](RunMerger<map_key, map_value>& merger, WorkerOutput& output) mutable {
+            reduceMerged(REDUCE, merger, output);
+        };
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    PhaseStats Reducer<map_key, map_value, reduce_value>::run() {
+        // Every partition of a finished shuffle is ready right away
+        if (shuffle) {
+            start();
+            for(std::size_t partition = 0; partition < shuffle->partitionCount(); partition++)
+                partitionReady(partition);
+            return finish();
+        }
+
         if (verbose) std::cout << "Starting reduce phase..." << std::endl;
 
         // Initialize variables
-        isProducerDone = false;
-        produced = false;
-        buff_values.clear();
-        output_file.open(output_filename, std::ios::out);
-        if(!output_file.is_open())
-            throw std::runtime_error("Cannot open reduse output file: " + output_filename);
-        
-        // Initialize the consumers
-        if (verbose) std::cout << "Starting reducers..." << std::endl;
-        for(auto i = 0; i < num_reducers; i++)
-            rd_threads[i] = std::thread(&Reducer<map_key, map_value, reduce_value>::consumer, this);
+        timer.emplace();
+        stats = PhaseStats();
+        buff.reset();
+        if (memory_budget)
+            memory_budget->resetPeak();
+        output_file.open(output_filename, options.io_backend);
         
-        // Start the producer
-        std::thread producer_thread(&Reducer<map_key, map_value, reduce_value>::producer, this);
+        if (pool) {
+            // The consumers are tasks of the pool and the calling thread produces
+            if (verbose) std::cout << "Starting reducers..." << std::endl;
+            TaskGroup workers(*pool);
+            for(auto i = 0; i < num_reducers; i++)
+                workers.submit([this]() {
+                    // A consumer that dies must not leave the producer blocked on a full buffer
+                    try {
+                        consumer();
+                    } catch (...) {
+                        buff.close();
+                        throw;
+                    }
+                });
+            if (verbose) std::cout << "Reducers executing..." << std::endl;
+            try {
+                producer();
+            } catch (...) {
+                buff.close();
+                throw;
+            }
+            workers.wait();
+        } else {
+            // Initialize the consumers
+            if (verbose) std::cout << "Starting reducers..." << std::endl;
+            for(auto i = 0; i < num_reducers; i++)
+                rd_threads[i] = std::thread(&Reducer<map_key, map_value, reduce_value>::consumer, this);
+            
+            // Start the producer
+            std::thread producer_thread(&Reducer<map_key, map_value, reduce_value>::producer, this);
+            if (verbose) std::cout << "Reducers executing..." << std::endl;
+
+            // Wait for threads to finish
+            producer_thread.join();
+            for(auto &consumer_thread: rd_threads)
+                consumer_thread.join();
+        }
+        if (verbose) std::cout << "Reducers execution completed successfully!" << std::endl;
+        stats.producer_wait_seconds = buff.producerWaitSeconds();
+        stats.consumer_wait_seconds = buff.consumerWaitSeconds();
+        if (memory_budget) {
+            stats.producer_wait_seconds += memory_budget->waitSeconds();
+            stats.peak_memory = memory_budget->peakBytes();
+        }
+
+        // Close the output file
+        output_file.close();
+
+        // Reducer completed successfully
+        timer->stop(stats);
+        if (verbose) std::cout << "Reduce phase completed successfully!" << std::endl;
+        return stats;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::start() {
+        if (!shuffle)
+            throw std::runtime_error("Reducer::start requires a shuffle");
+        if (verbose) std::cout << "Starting reduce phase..." << std::endl;
+
+        // Initialize variables
+        timer.emplace();
+        stats = PhaseStats();
+        hot_partials.clear();
+        if (memory_budget)
+            memory_budget->resetPeak();
+        ready.reset();
+        if (!output_filename.empty())
+            output_file.open(output_filename, options.io_backend);
+
+        // Every partition becomes a task of the pool. Otherwise the reducers take whole partitions as they get ready.
+        // Key ranges can only be picked once a partition is final, so they wait for finish()
+        if (reducesRanges())
+            return;
+        if (verbose) std::cout << "Starting reducers over " << shuffle->partitionCount() << " partitions..." << std::endl;
+        if (pool) {
+            tasks.emplace(*pool);
+        } else {
+            for(auto i = 0; i < num_reducers; i++)
+                rd_threads[i] = std::thread(&Reducer<map_key, map_value, reduce_value>::partitionConsumer, this);
+        }
         if (verbose) std::cout << "Reducers executing..." << std::endl;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::partitionReady(const std::size_t partition) {
+        if (reducesRanges())
+            return;
+        if (tasks) {
+            tasks->submit([this, partition]() {
+                WorkerOutput output(*this, output_file);
+                reducePartition(partition, output);
+                output.close();
+            });
+        } else {
+            // The buffer holds every partition, so this never blocks
+            std::vector<std::size_t> batch{partition};
+            ready.put(batch);
+        }
+    }
 
-        // Wait for threads to finish
-        producer_thread.join();
-        for(auto &consumer_thread: rd_threads)
-            consumer_thread.join();
-        if (verbose) std::cout << "Reducers execution completed successfully!";
+    template<typename map_key, typename map_value, typename reduce_value>
+    PhaseStats Reducer<map_key, map_value, reduce_value>::finish() {
+        // Wait for the workers to finish, then drop the consumed runs
+        if (reducesRanges()) {
+            reduceRanges();
+        } else if (tasks) {
+            tasks->wait();
+            tasks.reset();
+        } else {
+            ready.close();
+            for(auto &consumer_thread: rd_threads)
+                consumer_thread.join();
+        }
+        shuffle->clear();
+        if (verbose) std::cout << "Reducers execution completed successfully!" << std::endl;
+
+        // Merge the partial results of every hot key
+        if (!hot_partials.empty()) {
+            if (verbose) std::cout << "Merging the partial results of " << hot_partials.size() << " hot keys..." << std::endl;
+            ChunkWriter writer(output_file, options.output_chunk_size);
+            auto sink = make_sink ? make_sink() : nullptr;
+            for(auto &[hot_key, partial]: hot_partials) {
+                reduce_value merged = merge_partials(hot_key, partial.first);
+                if (!sink)
+                    writer.writeLine(merged);
+                else if (!output_filename.empty())
+                    writer.writeLine(hot_key, merged);
+                if (sink)
+                    sink->emit(hot_key, std::move(merged));
+                stats.key_groups++;
+                stats.records_out++;
+                stats.largest_group = std::max(stats.largest_group, partial.second);
+            }
+            writer.flush();
+            if (sink)
+                sink->close();
+            stats.bytes_out += writer.bytesWritten();
+            stats.hot_keys = hot_partials.size();
+            hot_partials.clear();
+        }
+        stats.producer_wait_seconds = ready.producerWaitSeconds();
+        stats.consumer_wait_seconds = ready.consumerWaitSeconds();
+        if (memory_budget)
+            stats.peak_memory = memory_budget->peakBytes();
 
         // Close the output file
         output_file.close();
 
         // Reducer completed successfully
-        if (verbose) std::cout << "Reduce phase completed successfully!";
+        timer->stop(stats);
+        if (verbose) std::cout << "Reduce phase completed successfully!" << std::endl;
+        return stats;
     }
 
     template<typename map_key, typename map_value, typename reduce_value>
     void Reducer<map_key, map_value, reduce_value>::producer() {
+        TraceSpan span(trace.get(), "reduce producer");
+
         // Open the input file
         std::fstream input;
-        input.open(map_output_filename, std::ios::in);
+        input.open(map_output_filename, std::ios::in | std::ios::binary | std::ios::ate);
         if(!input.is_open())
             throw std::runtime_error("Unable to open map phase output file: " + map_output_filename);
+        {
+            std::scoped_lock stats_lock{stats_mutex};
+            stats.bytes_in = static_cast<std::size_t>(input.tellg());
+        }
+        input.seekg(0);
         
         // Producer local variables
-        map_key input_key;
-        map_value input_value;
-        map_key curr_key; 
+        const std::size_t batch_size = options.batch_size > 0 ? options.batch_size : 1;
+        std::vector<group_type> batch;
+        RecordReader<map_key, map_value> reader(input, options.map_output_format);
+        std::pair<map_key, map_value> record;
+        map_key curr_key;
         std::vector<map_value> curr_values;
 
+        // Appends a finished key group to the batch and hands the batch off once it is full. A buffer closed by a
+        // consumer that died refuses the batch, which gives its memory back and stops the producer
+        std::size_t batch_count = 0;
+        bool rejected = false;
+        auto putBatch = [&]() {
+            const std::size_t in_flight = memory_budget ? memoryFootprint(batch) : 0;
+            if (memory_budget)
+                memory_budget->acquire(in_flight);
+            if (!buff.put(batch)) {
+                if (memory_budget)
+                    memory_budget->releaseInFlight(in_flight);
+                rejected = true;
+            }
+        };
+        auto put = [&](map_key &new_key, std::vector<map_value> &new_values) {
+            if (batch_count == batch.size())
+                batch.emplace_back();
+            batch[batch_count].first = std::move(new_key);
+            std::swap(batch[batch_count].second, new_values);
+            new_values.clear();
+            if (++batch_count == batch_size) {
+                putBatch();
+                batch_count = 0;
+            }
+        };
+
         // Input the initial item. Continue producer only if there exists an initial item
-        if(input >> curr_key) {
-            input >> input_value;
-            curr_values.push_back(input_value);
+        if(reader.read(record)) {
+            curr_key = std::move(record.first);
+            curr_values.push_back(std::move(record.second));
 
             // Input a new object everytime
-            while(input >> input_key) {
-                input >> input_value;
+            while(!rejected && reader.read(record)) {
 
                 // If key of previous object same as new object, add the value to the list
-                if(input_key == curr_key) {
-                    curr_values.push_back(std::move(input_value));
+                if(record.first == curr_key) {
+                    curr_values.push_back(std::move(record.second));
                     continue;
                 }
 
@@ -168,20 +661,24 @@ namespace reduse {
                 put(curr_key, curr_values);
 
                 // Update old key and set of values with new item
-                curr_key = std::move(input_key);
+                curr_key = std::move(record.first);
                 curr_values.clear();
-                curr_values.push_back(std::move(input_value));
+                curr_values.push_back(std::move(record.second));
             }
 
             // Put the last object into the buffer
-            put(curr_key, curr_values);
+            if (!rejected)
+                put(curr_key, curr_values);
         }
 
-        // Mark the producer done
-        isProducerDone = true;
+        // Put the last partial batch into the buffer
+        if (batch_count > 0 && !rejected) {
+            batch.resize(batch_count);
+            putBatch();
+        }
 
         // Signal to all sleeping threads
-        buff_full.notify_all();
+        buff.close();
 
         // Close the input file
         input.close();
@@ -189,61 +686,324 @@ namespace reduse {
 
     template<typename map_key, typename map_value, typename reduce_value>
     void Reducer<map_key, map_value, reduce_value>::consumer() {
+        TraceSpan span(trace.get(), "reduce worker");
 
         // Consumer variables
-        map_key curr_key;
-        std::vector<map_value> curr_values;
+        std::vector<group_type> batch;
+        WorkerOutput output(*this, output_file);
+
+        // Run until producer is done and the buffer is drained. A batch's memory goes back to the budget once it is reduced
+        while(buff.get(batch)) {
+            const std::size_t in_flight = memory_budget ? memoryFootprint(batch) : 0;
+            reduce_batch(batch, output);
+            if (memory_budget)
+                memory_budget->releaseInFlight(in_flight);
+        }
+        output.close();
+    }
 
-        // Run until producer is done
-        while(!isProducerDone || produced) {
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::partitionConsumer() {
+        TraceSpan span(trace.get(), "reduce worker");
+        WorkerOutput output(*this, output_file);
+
+        // Take partitions till every partition has been handed in and taken
+        std::vector<std::size_t> batch;
+        while(ready.get(batch))
+            for(auto partition: batch)
+                reducePartition(partition, output);
+        output.close();
+    }
 
-            // Try to fetch a new item. If no new item is found, then exit
-            if(!get(curr_key, curr_values))
-                break;
-            
-            // Apply REDUCE on the new item
-            reduce_value curr_result = REDUCE(curr_key, curr_values);
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::reducePartition(const std::size_t partition, WorkerOutput& output) {
+        TraceSpan span(trace.get(), "reduce partition");
+        output.refreshHotKeys();
+        RunMerger<map_key, map_value> merger(shuffle->getRuns(partition), std::nullopt, std::nullopt);
+        reduce_merged(merger, output);
+    }
 
-            // Write the new item to the output file
-            std::scoped_lock output_file_lock{output_file_mutex};
-            output_file << curr_result << std::endl;
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::reduceRanges() {
+        // Cut every partition into about one key range per worker. The merger of every range is positioned before any
+        // worker starts, as REDUCE moves the records of in-memory runs out while other ranges are still being looked up
+        struct Range {
+            std::unique_ptr<RunMerger<map_key, map_value>> merger; // Merges the records of the range
+            std::string segment_filename; // File the range is reduced into
+        };
+        std::vector<Range> ranges;
+        for(std::size_t partition = 0; partition < shuffle->partitionCount(); partition++) {
+            auto splitters = shuffle->pickSplitters(partition, num_reducers > 0 ? num_reducers : 1);
+            for(std::size_t i = 0; i <= splitters.size(); i++) {
+                std::optional<map_key> lower, upper;
+                if (i > 0)
+                    lower = splitters[i - 1];
+                if (i < splitters.size())
+                    upper = splitters[i];
+                auto merger = std::make_unique<RunMerger<map_key, map_value>>(shuffle->getRuns(partition), lower, upper);
+                ranges.push_back({std::move(merger), output_filename + ".segment" + std::to_string(ranges.size())});
+            }
+        }
+        if (verbose) std::cout << "Reducing " << ranges.size() << " key ranges into sorted segments..." << std::endl;
+
+        // Every range is merged and reduced into a segment of its own, so the workers never wait on each other
+        auto reduceRange = [this](Range& range) {
+            TraceSpan span(trace.get(), "reduce range");
+            SharedOutput segment;
+            segment.open(range.segment_filename, options.io_backend);
+            {
+                WorkerOutput output(*this, segment);
+                reduce_merged(*range.merger, output);
+                output.close();
+            }
+            segment.close();
+            range.merger.reset();
+        };
+        if (pool) {
+            TaskGroup range_tasks(*pool);
+            for(auto &range: ranges)
+                range_tasks.submit([&reduceRange, &range]() { reduceRange(range); });
+            range_tasks.wait();
+        } else {
+            std::atomic<std::size_t> next_range{0};
+            for(auto &consumer_thread: rd_threads)
+                consumer_thread = std::thread([&]() {
+                    TraceSpan span(trace.get(), "reduce worker");
+                    for(std::size_t i = next_range++; i < ranges.size(); i = next_range++)
+                        reduceRange(ranges[i]);
+                });
+            for(auto &consumer_thread: rd_threads)
+                consumer_thread.join();
+        }
+
+        // Concatenate the segments in key order
+        std::string chunk;
+        for(auto &range: ranges) {
+            {
+                FileReader segment(range.segment_filename, options.io_backend);
+                do {
+                    chunk.resize(options.output_chunk_size > 0 ? options.output_chunk_size : IO_BLOCK_SIZE);
+                    chunk.resize(segment.read(chunk.data(), chunk.size()));
+                    if (!chunk.empty())
+                        output_file.append(chunk);
+                } while(!chunk.empty());
+            }
+            std::remove(range.segment_filename.c_str());
         }
     }
 
     template<typename map_key, typename map_value, typename reduce_value>
-    void Reducer<map_key, map_value, reduce_value>::put(map_key &new_key, std::vector<map_value> &new_values) {
-        // Wait for the buffer to be empty
-        std::unique_lock buff_lock{buff_mutex};
-        buff_empty.wait(buff_lock, [&]() { return !produced; });
-        
-        // Put the item into the buffer and turn produced as true
-        buff_key = std::move(new_key);
-        buff_values = std::move(new_values);
-        produced = true;
+    template<typename ReduceFn>
+    void Reducer<map_key, map_value, reduce_value>::reduceGroup(
+        ReduceFn& REDUCE,
+        map_key& curr_key,
+        std::vector<map_value>& curr_values,
+        WorkerOutput& output
+    ) {
+        // The part of a hot key group in this partition only yields a partial result
+        const std::size_t group_size = curr_values.size();
+        if (output.isHot(curr_key)) {
+            reduce_value partial = applyReduce(REDUCE, std::as_const(curr_key), curr_values);
+            output.writePartial(std::move(curr_key), std::move(partial), group_size);
+        } else if (output.isKeyed()) {
+            const reduce_value result = applyReduce(REDUCE, std::as_const(curr_key), curr_values);
+            output.write(curr_key, result, group_size);
+        } else {
+            output.write(applyReduce(REDUCE, std::move(curr_key), curr_values), group_size);
+        }
+    }
 
-        // Nofify one sleeping consumer of the available item
-        buff_lock.unlock();
-        buff_full.notify_one();
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn>
+    void Reducer<map_key, map_value, reduce_value>::foldGroup(
+        ReduceFn& REDUCE,
+        const map_key& curr_key,
+        std::vector<map_value>& curr_values,
+        WorkerOutput& output
+    ) {
+        // An associative REDUCE takes its own partial result as one of the values of the rest of the group
+        if constexpr (std::is_same_v<reduce_value, map_value>) {
+            if (!output.foldsGroups() || curr_values.size() < 2)
+                return;
+            const std::size_t count = curr_values.size();
+            map_value partial = applyReduce(REDUCE, curr_key, curr_values);
+            curr_values.clear();
+            curr_values.push_back(std::move(partial));
+            output.countFolded(count - 1);
+        }
     }
 
     template<typename map_key, typename map_value, typename reduce_value>
-    bool Reducer<map_key, map_value, reduce_value>::get(map_key &new_key, std::vector<map_value> &new_values) {
-        // Wait for the buffer to be full
-        std::unique_lock buff_lock{buff_mutex};
-        buff_full.wait(buff_lock, [&](){ return ( produced || isProducerDone ); });
-        
-        // If no item has been produced, that means producer is done and there is nothing left to consume
-        if(!produced)
-            return false;
+    template<typename ReduceFn, typename Key>
+    reduce_value Reducer<map_key, map_value, reduce_value>::applyReduce(
+        ReduceFn& REDUCE,
+        Key&& curr_key,
+        std::vector<map_value>& curr_values
+    ) {
+        // A streaming REDUCE reads the collected values through a stream
+        if constexpr (std::is_invocable_r_v<reduce_value, ReduceFn&, map_key, std::vector<map_value>&>) {
+            if constexpr (std::is_invocable_r_v<reduce_value, ReduceFn&, Key, std::vector<map_value>&>)
+                return static_cast<reduce_value>(REDUCE(std::forward<Key>(curr_key), curr_values));
+            else
+                return static_cast<reduce_value>(REDUCE(map_key(curr_key), curr_values));
+        } else {
+            VectorValueStream<map_value> values(curr_values);
+            return static_cast<reduce_value>(REDUCE(std::as_const(curr_key), values));
+        }
+    }
 
-        // Put the buffered item into the consumer's local buffer and marked produced as false
-        new_key = std::move(buff_key);
-        new_values = std::move(buff_values);
-        produced = false;
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn>
+    void Reducer<map_key, map_value, reduce_value>::reduceMerged(
+        ReduceFn& REDUCE,
+        RunMerger<map_key, map_value>& merger,
+        WorkerOutput& output
+    ) {
+        if constexpr (std::is_invocable_r_v<reduce_value, ReduceFn&, map_key, std::vector<map_value>&>) {
+            // The merged runs arrive sorted by key, so a key group ends as soon as the key changes
+            std::optional<map_key> curr_key;
+            std::vector<map_value> curr_values;
+            for(; merger.valid(); merger.next()) {
+                auto &record = merger.current();
+                if (curr_key && record.first == *curr_key) {
+                    curr_values.push_back(std::move(record.second));
+                    if (!output.holdValue(curr_values.back()))
+                        foldGroup(REDUCE, *curr_key, curr_values, output);
+                    continue;
+                }
+                if (curr_key)
+                    reduceGroup(REDUCE, *curr_key, curr_values, output);
+                curr_key = std::move(record.first);
+                curr_values.clear();
+                curr_values.push_back(std::move(record.second));
+                output.holdValue(curr_values.back());
+            }
 
-        // Signal that the buffer is empty
-        buff_lock.unlock();
-        buff_empty.notify_one();
+            // Reduce the last key group of the partition
+            if (curr_key)
+                reduceGroup(REDUCE, *curr_key, curr_values, output);
+        } else {
+            // The values are pulled straight out of the merge, so only one record of a key group is in memory at a time
+            while(merger.valid()) {
+                map_key curr_key = merger.current().first;
+                MergedValueStream<map_key, map_value> values(merger, curr_key);
+                reduce_value curr_result = REDUCE(std::as_const(curr_key), values);
+
+                // Skip whatever REDUCE left unread, up to the next key group
+                values.drain();
+                if (output.isHot(curr_key))
+                    output.writePartial(std::move(curr_key), std::move(curr_result), values.count());
+                else
+                    output.write(curr_key, curr_result, values.count());
+            }
+        }
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    Reducer<map_key, map_value, reduce_value>::WorkerOutput::WorkerOutput(Reducer& _reducer, SharedOutput& _output):
+        reducer(_reducer),
+        writer(_output, _reducer.options.output_chunk_size),
+        keyed(_reducer.shuffle && (_reducer.options.sorted_output || _reducer.make_sink)),
+        sink(_reducer.shuffle && _reducer.make_sink ? _reducer.make_sink() : nullptr),
+        folds(_reducer.memory_budget && _reducer.options.associative_reduce && std::is_same_v<reduce_value, map_value>),
+        records_in(0),
+        key_groups(0),
+        largest_group(0),
+        group_bytes(0),
+        group_reserved(0),
+        group_folded(0) {}
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    bool Reducer<map_key, map_value, reduce_value>::WorkerOutput::holdValue(const map_value& item) {
+        if (!folds)
+            return true;
+        group_bytes += memoryFootprint(item);
+        if (group_bytes <= group_reserved)
+            return true;
+
+        // Reserve in steps, so the budget is not locked for every value
+        const std::size_t step = std::max(group_bytes - group_reserved, MEMORY_RESERVE_STEP);
+        if (!reducer.memory_budget->tryAcquire(step))
+            return false;
+        group_reserved += step;
         return true;
     }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::WorkerOutput::countFolded(const std::size_t count) {
+        group_folded += count;
+        group_bytes = 0;
+        reducer.memory_budget->release(group_reserved);
+        group_reserved = 0;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    std::size_t Reducer<map_key, map_value, reduce_value>::WorkerOutput::endGroup(const std::size_t group_size) {
+        const std::size_t total = group_size + group_folded;
+        if (group_reserved > 0)
+            reducer.memory_budget->release(group_reserved);
+        group_bytes = 0;
+        group_reserved = 0;
+        group_folded = 0;
+        return total;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::WorkerOutput::write(const reduce_value& result, const std::size_t group_size) {
+        const std::size_t total = endGroup(group_size);
+        writer.writeLine(result);
+        records_in += total;
+        key_groups++;
+        largest_group = std::max(largest_group, total);
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::WorkerOutput::write(
+        const map_key& item,
+        const reduce_value& result,
+        const std::size_t group_size
+    ) {
+        if (!keyed) {
+            write(result, group_size);
+            return;
+        }
+        const std::size_t total = endGroup(group_size);
+        if (sink)
+            sink->emit(item, result);
+        if (!sink || !reducer.output_filename.empty())
+            writer.writeLine(item, result);
+        records_in += total;
+        key_groups++;
+        largest_group = std::max(largest_group, total);
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::WorkerOutput::close() {
+        writer.flush();
+        if (sink)
+            sink->close();
+
+        std::scoped_lock stats_lock{reducer.stats_mutex};
+        reducer.stats.records_in += records_in;
+        reducer.stats.records_out += key_groups;
+        reducer.stats.bytes_out += writer.bytesWritten();
+        reducer.stats.key_groups += key_groups;
+        reducer.stats.largest_group = std::max(reducer.stats.largest_group, largest_group);
+        for(auto &[hot_key, partial, group_size]: partials) {
+            auto &merged = reducer.hot_partials[hot_key];
+            merged.first.push_back(std::move(partial));
+            merged.second += group_size;
+        }
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void Reducer<map_key, map_value, reduce_value>::WorkerOutput::writePartial(
+        map_key&& item,
+        reduce_value&& partial,
+        const std::size_t group_size
+    ) {
+        const std::size_t total = endGroup(group_size);
+        partials.emplace_back(std::move(item), std::move(partial), total);
+        records_in += total;
+    }
 }
@@ -4,32 +4,437 @@
 #include <string>
 #include <functional>
 #include <utility>
+#include <memory>
+#include <type_traits>
+#include <iterator>
+#include <filesystem>
+#include <cstdint>
+#include <stdexcept>
+#include <reduse/options.hpp>
+#include <reduse/partitioner.hpp>
+#include <reduse/sorter.hpp>
 #include <reduse/mapper.hpp>
 #include <reduse/reducer.hpp>
+#include <reduse/stats.hpp>
+#include <reduse/thread_pool.hpp>
+#include <reduse/hot_keys.hpp>
+#include <reduse/dictionary.hpp>
+#include <reduse/cache.hpp>
+#include <reduse/mapped_file.hpp>
+#include <reduse/budget.hpp>
 
 namespace reduse {
-    template<typename map_key, typename map_value, typename reduce_value>
-    void reduse(
-        const std::string input_filename,
-        const std::string output_filename,
-        const std::function<std::pair<map_key, map_value>(const std::string&)> &MAP, 
-        const std::function<reduce_value(map_key, std::vector<map_value>&)> &REDUCE,
-        const int num_mappers = DEFAULT_NUM_MAPPERS,
-        const int num_reducers = DEFAULT_NUM_REDUCERS,
-        const bool verbose = false
+
+    /** @brief Returns REDUCE as a combiner if Options::associative_reduce is set, and an empty function otherwise.
+     * The combiner refers to REDUCE, which must outlive it
+     */
+    template<typename map_key, typename map_value, typename reduce_value, typename ReduceFn>
+    std::function<map_value(const map_key&, std::vector<map_value>&)> associativeCombiner(ReduceFn& REDUCE, const Options& options) {
+        std::function<map_value(const map_key&, std::vector<map_value>&)> COMBINE;
+        if (options.associative_reduce) {
+            if constexpr (std::is_same_v<reduce_value, map_value>)
+                COMBINE = [&REDUCE](const map_key& curr_key, std::vector<map_value>& curr_values) {
+                    if constexpr (std::is_invocable_r_v<reduce_value, ReduceFn&, map_key, std::vector<map_value>&>) {
+                        return static_cast<map_value>(REDUCE(curr_key, curr_values));
+                    } else {
+                        VectorValueStream<map_value> values(curr_values);
+                        return static_cast<map_value>(REDUCE(curr_key, values));
+                    }
+                };
+            else
+                throw std::invalid_argument("Options::associative_reduce requires reduce_value to be the same type as map_value");
+        }
+        return COMBINE;
+    }
+
+    /** @brief Returns the budget of a job with Options::memory_budget set, shared by its shuffle, mappers and reducers,
+     * or null otherwise. A shuffle held in memory by ShuffleMode::MEMORY is not counted against it
+     */
+    template<typename map_key, typename map_value>
+    std::shared_ptr<MemoryBudget> jobMemoryBudget(ExternalSorter<map_key, map_value>& shuffle, const Options& options) {
+        if (options.memory_budget == 0)
+            return nullptr;
+        auto memory_budget = std::make_shared<MemoryBudget>(options.memory_budget);
+        if (options.shuffle_mode == ShuffleMode::AUTO)
+            shuffle.setMemoryBudget(memory_budget);
+        return memory_budget;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    JobStats runEncodedJob(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
+    );
+
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    JobStats runIncrementalJob(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
+    );
+
+    /** @brief Runs a whole job: the map phase into a partitioned shuffle, then the reduce phase out of it
+     * @param pool Pool running the workers of both phases. Every worker gets a thread of its own if null
+     */
+    template<
+        typename map_key,
+        typename map_value,
+        typename reduce_value,
+        typename Partitioner,
+        typename MapFn,
+        typename ReduceFn
+    >
+    JobStats runJob(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
+    ) {
+        if (!options.cache_directory.empty())
+            return runIncrementalJob<map_key, map_value, reduce_value, Partitioner>(
+                pool, input_filename, output_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), COMBINE,
+                num_mappers, num_reducers, verbose, options
+            );
+        if constexpr (!std::is_same_v<map_key, KeyId>) {
+            if (options.encode_keys && !options.sorted_output)
+                return runEncodedJob<map_key, map_value, reduce_value, Partitioner>(
+                    pool, input_filename, output_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), COMBINE,
+                    num_mappers, num_reducers, verbose, options
+                );
+        }
+
+        // Map output is hash partitioned into one partition per reducer and handed to the reducers in memory.
+        // Only the runs beyond the sort memory budget are spilled, to files named after the input file and the job. Sorted
+        // output keeps a single partition, which the reducers cut into key ranges once it is final
+        auto shuffle = std::make_shared<ExternalSorter<map_key, map_value>>(
+            jobSpillPrefix(input_filename + "_map_output.txt"),
+            sortBufferBudget(options, num_mappers),
+            num_reducers > 0 && !options.sorted_output ? num_reducers : 1,
+            options.spill_format,
+            options.io_backend
+        );
+        auto memory_budget = jobMemoryBudget(*shuffle, options);
+
+        // With an associative REDUCE, the groups of hot keys are spread over every reducer. REDUCE merges their partial
+        // results, through a copy of its own, as the original is moved into the Reducer
+        std::shared_ptr<HotKeyDetector<map_key>> hot_keys;
+        std::decay_t<ReduceFn> MERGE(REDUCE);
+        std::function<reduce_value(const map_key&, std::vector<reduce_value>&)> merge_partials;
+        if constexpr (std::is_same_v<reduce_value, map_value>) {
+            if (options.associative_reduce && options.split_hot_keys && num_reducers > 1 && !options.sorted_output) {
+                hot_keys = std::make_shared<HotKeyDetector<map_key>>(num_reducers, options.hot_key_share);
+                merge_partials = associativeCombiner<map_key, map_value, reduce_value>(MERGE, options);
+            }
+        }
+        std::shared_ptr<TraceRecorder> trace;
+        if (!options.trace_filename.empty())
+            trace = std::make_shared<TraceRecorder>();
+        JobStats stats;
+        PhaseTimer timer;
+        try {
+            Mapper<map_key, map_value, Partitioner> mapper(input_filename, shuffle, std::forward<MapFn>(MAP), num_mappers, verbose, options);
+            if (COMBINE)
+                mapper.setCombiner(COMBINE);
+            mapper.setTrace(trace);
+            mapper.setPool(pool);
+            mapper.setHotKeys(hot_keys);
+            mapper.setMemoryBudget(memory_budget);
+            Reducer<map_key, map_value, reduce_value> reducer(shuffle, output_filename, std::forward<ReduceFn>(REDUCE), num_reducers, verbose, options);
+            reducer.setTrace(trace);
+            reducer.setPool(pool);
+            reducer.setHotKeys(hot_keys, merge_partials);
+            reducer.setMemoryBudget(memory_budget);
+            if (options.pipelined) {
+                // The mapper worker closing a partition last hands it to the reducers while the others are still being sorted
+                reducer.start();
+                shuffle->setFinalHandler([&reducer](std::size_t partition) { reducer.partitionReady(partition); });
+                stats.map = mapper.run();
+                stats.reduce = reducer.finish();
+                shuffle->setFinalHandler(nullptr);
+            } else {
+                stats.map = mapper.run();
+                stats.reduce = reducer.run();
+            }
+            if (trace)
+                trace->write(options.trace_filename);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            shuffle->clear();
+            std::terminate();
+        }
+        PhaseStats job;
+        timer.stop(job);
+        stats.wall_seconds = job.wall_seconds;
+        if (verbose) {
+            std::cout << "Map phase: " << stats.map << std::endl;
+            std::cout << "Reduce phase: " << stats.reduce << std::endl;
+        }
+        return stats;
+    }
+
+    /** @brief Runs a job with the keys interned into a KeyDictionary. MAP, REDUCE and COMBINE are wrapped so the
+     * mappers emit key IDs and the reducers see the keys again, while the shuffle sorts, groups and partitions IDs
+     */
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    JobStats runEncodedJob(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
+    ) {
+        KeyDictionary<map_key, Partitioner> dictionary(num_reducers > 0 ? num_reducers : 1);
+
+        // Every form of MAP becomes an emitting MAP, with the emitted keys swapped for their IDs
+        auto ENCODED_MAP = [&dictionary, MAP = std::decay_t<MapFn>(std::forward<MapFn>(MAP))](std::string_view line, Emitter<KeyId, map_value>& output) mutable {
+            if constexpr (is_emit_map_v<MapFn, map_key, map_value>) {
+                EncodingEmitter<map_key, map_value, Partitioner> encoder(dictionary, output);
+                MAP(line, encoder);
+            } else if constexpr (std::is_invocable_r_v<std::pair<map_key, map_value>, std::decay_t<MapFn>&, std::string_view>) {
+                auto new_pair = MAP(line);
+                output.emplace(dictionary.encode(new_pair.first), std::move(new_pair.second));
+            } else {
+                thread_local std::string scratch;
+                scratch.assign(line);
+                auto new_pair = MAP(scratch);
+                output.emplace(dictionary.encode(new_pair.first), std::move(new_pair.second));
+            }
+        };
+
+        // REDUCE gets the key of every group back, and its values in the form it takes them
+        auto ENCODED_REDUCE = [&]() {
+            if constexpr (is_stream_reduce_v<std::decay_t<ReduceFn>, map_key, map_value, reduce_value>)
+                return [&dictionary, REDUCE = std::decay_t<ReduceFn>(std::forward<ReduceFn>(REDUCE))](const KeyId& id, ValueStream<map_value>& values) mutable -> reduce_value {
+                    return REDUCE(dictionary.decode(id), values);
+                };
+            else
+                return [&dictionary, REDUCE = std::decay_t<ReduceFn>(std::forward<ReduceFn>(REDUCE))](const KeyId& id, std::vector<map_value>& values) mutable -> reduce_value {
+                    return REDUCE(dictionary.decode(id), values);
+                };
+        }();
+
+        std::function<map_value(const KeyId&, std::vector<map_value>&)> ENCODED_COMBINE;
+        if (COMBINE)
+            ENCODED_COMBINE = [&dictionary, &COMBINE](const KeyId& id, std::vector<map_value>& values) {
+                return COMBINE(dictionary.decode(id), values);
+            };
+
+        Options encoded_options = options;
+        encoded_options.encode_keys = false;
+        auto stats = runJob<KeyId, map_value, reduce_value, KeyIdPartitioner>(
+            pool, input_filename, output_filename, std::move(ENCODED_MAP), std::move(ENCODED_REDUCE), ENCODED_COMBINE,
+            num_mappers, num_reducers, verbose, encoded_options
+        );
+        if (verbose) std::cout << "Key dictionary held " << dictionary.size() << " distinct keys" << std::endl;
+        return stats;
+    }
+
+    /** @brief Runs a job over the chunks of a ChunkCache. Only the chunks missing from the cache are mapped, one at a
+     * time, and their sorted map output is stored before the cached runs of every chunk are reduced together. With an
+     * associative REDUCE, the complete chunks are also folded into a base run holding one partial result per key, so a
+     * rerun over a grown input only merges the base with the new chunks
+     */
+    template<typename map_key, typename map_value, typename reduce_value, typename Partitioner, typename MapFn, typename ReduceFn>
+    JobStats runIncrementalJob(
+        const std::shared_ptr<ThreadPool>& pool,
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers,
+        const int num_reducers,
+        const bool verbose,
+        const Options& options
     ) {
-        std::string map_output_filename = input_filename + "_map_output.txt";
+        ChunkCache<map_key, map_value> cache(options.cache_directory, options, std::filesystem::absolute(input_filename).string());
+        std::vector<InputChunk> chunks;
+        {
+            MappedFile input_file(input_filename);
+            chunks = cache.split(input_file.view());
+        }
+
+        // The chain of chunk hashes names the base run of every prefix of the input
+        std::vector<std::uint64_t> chains{CHUNK_HASH_SEED};
+        for(auto &chunk: chunks)
+            chains.push_back(hashBytes(std::string_view(reinterpret_cast<const char*>(&chunk.hash), sizeof(chunk.hash)), chains.back()));
+        std::decay_t<ReduceFn> MERGE(REDUCE);
+        auto fold = associativeCombiner<map_key, map_value, reduce_value>(MERGE, options);
+
+        // Chunks are mapped one at a time into a single partition, which the reducers cut into key ranges
+        auto shuffle = std::make_shared<ExternalSorter<map_key, map_value>>(
+            jobSpillPrefix(input_filename + "_map_output.txt"),
+            sortBufferBudget(options, num_mappers),
+            1,
+            options.spill_format,
+            options.io_backend
+        );
+        auto memory_budget = jobMemoryBudget(*shuffle, options);
+        Options chunk_options = options;
+        chunk_options.input_mode = InputMode::MMAP;
+        std::shared_ptr<TraceRecorder> trace;
+        if (!options.trace_filename.empty())
+            trace = std::make_shared<TraceRecorder>();
+        JobStats stats;
+        PhaseTimer timer;
         try {
-            Mapper<map_key, map_value> mapper(input_filename, map_output_filename, MAP, num_mappers, verbose);
-            mapper.run();
-            Reducer<map_key, map_value, reduce_value> reducer(map_output_filename, output_filename, REDUCE, num_reducers, verbose);
-            reducer.run();
-            if(remove(map_output_filename.c_str()) != 0)
-                throw std::runtime_error("Unable to delete " + map_output_filename);
+            PhaseTimer map_timer;
+            Mapper<map_key, map_value, Partitioner> mapper(input_filename, shuffle, std::forward<MapFn>(MAP), num_mappers, verbose, chunk_options);
+            if (COMBINE)
+                mapper.setCombiner(COMBINE);
+            mapper.setTrace(trace);
+            mapper.setPool(pool);
+            mapper.setMemoryBudget(memory_budget);
+
+            // Start from the base run covering the longest prefix of the input
+            std::vector<typename ChunkCache<map_key, map_value>::run_type> runs;
+            std::vector<std::string> live;
+            std::size_t covered = 0;
+            for(std::size_t i = chunks.size(); fold && i > 0 && covered == 0; i--)
+                if (auto base = cache.load(cache.baseName(i, chains[i]))) {
+                    runs.push_back(std::move(*base));
+                    live.push_back(cache.baseName(i, chains[i]));
+                    covered = i;
+                }
+            stats.map.cached_chunks = covered;
+
+            // Map the chunks missing from the cache
+            for(std::size_t i = 0; i < chunks.size(); i++) {
+                live.push_back(cache.chunkName(chunks[i]));
+                if (i < covered)
+                    continue;
+                auto run = cache.load(cache.chunkName(chunks[i]));
+                if (run) {
+                    stats.map.cached_chunks++;
+                } else {
+                    if (verbose) std::cout << "Mapping input chunk at offset " << chunks[i].offset << "..." << std::endl;
+                    mapper.setInputRange(chunks[i].offset, chunks[i].length);
+                    stats.map += mapper.run();
+                    run = cache.store(cache.chunkName(chunks[i]), shuffle->getRuns());
+                    shuffle->clear();
+                }
+                runs.push_back(std::move(*run));
+            }
+
+            // Fold the complete chunks into a new base, so the next run starts from it
+            std::size_t complete = 0;
+            while(complete < chunks.size() && chunks[complete].complete)
+                complete++;
+            if (fold && complete > covered) {
+                const std::size_t folded = (covered > 0 ? 1 : 0) + complete - covered;
+                std::vector<typename ChunkCache<map_key, map_value>::run_type> prefix(
+                    std::make_move_iterator(runs.begin()), std::make_move_iterator(runs.begin() + folded)
+                );
+                runs.erase(runs.begin(), runs.begin() + folded);
+                runs.insert(runs.begin(), cache.store(cache.baseName(complete, chains[complete]), prefix, fold));
+                if (covered > 0)
+                    live.erase(live.begin());
+                live.push_back(cache.baseName(complete, chains[complete]));
+            }
+            cache.prune(live);
+            for(auto &run: runs)
+                shuffle->addRun(0, std::move(run));
+            map_timer.stop(stats.map);
+            if (verbose) std::cout << stats.map.cached_chunks << " of " << chunks.size() << " input chunks taken from the cache" << std::endl;
+
+            Reducer<map_key, map_value, reduce_value> reducer(shuffle, output_filename, std::forward<ReduceFn>(REDUCE), num_reducers, verbose, options);
+            reducer.setTrace(trace);
+            reducer.setPool(pool);
+            reducer.setMemoryBudget(memory_budget);
+            stats.reduce = reducer.run();
+            if (trace)
+                trace->write(options.trace_filename);
         } catch (const std::exception &e) {
             std::cerr << e.what() << std::endl;
-            remove(map_output_filename.c_str());
+            shuffle->clear();
             std::terminate();
         }
+        PhaseStats job;
+        timer.stop(job);
+        stats.wall_seconds = job.wall_seconds;
+        if (verbose) {
+            std::cout << "Map phase: " << stats.map << std::endl;
+            std::cout << "Reduce phase: " << stats.reduce << std::endl;
+        }
+        return stats;
+    }
+
+    template<
+        typename map_key,
+        typename map_value,
+        typename reduce_value,
+        typename Partitioner = HashPartitioner<map_key>,
+        typename MapFn,
+        typename ReduceFn,
+        typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+    >
+    JobStats reduse(
+        const std::string input_filename,
+        const std::string output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+        const int num_mappers = DEFAULT_NUM_MAPPERS,
+        const int num_reducers = DEFAULT_NUM_REDUCERS,
+        const bool verbose = false,
+        const Options& options = Options()
+    ) {
+        return runJob<map_key, map_value, reduce_value, Partitioner>(
+            nullptr, input_filename, output_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), COMBINE,
+            num_mappers, num_reducers, verbose, options
+        );
+    }
+
+    template<
+        typename map_key,
+        typename map_value,
+        typename reduce_value,
+        typename Partitioner = HashPartitioner<map_key>,
+        typename MapFn,
+        typename ReduceFn,
+        typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+    >
+    JobStats reduse(
+        const std::string input_filename,
+        const std::string output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const int num_mappers = DEFAULT_NUM_MAPPERS,
+        const int num_reducers = DEFAULT_NUM_REDUCERS,
+        const bool verbose = false,
+        const Options& options = Options()
+    ) {
+        // An associative REDUCE doubles as the combiner
+        auto COMBINE = associativeCombiner<map_key, map_value, reduce_value>(REDUCE, options);
+        return runJob<map_key, map_value, reduce_value, Partitioner>(
+            nullptr, input_filename, output_filename, std::forward<MapFn>(MAP), REDUCE, COMBINE,
+            num_mappers, num_reducers, verbose, options
+        );
     }
 }
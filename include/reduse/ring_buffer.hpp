@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <chrono>
+
+namespace reduse {
+
+    /** @brief Bounded multi-producer/multi-consumer queue of record batches
+     * @param T Data type of a single record
+     *
+     * Records travel in batches so that the lock round-trip and the notifications are paid once per batch
+     * instead of once per record. Slots are exchanged with std::swap, so the vectors (and the capacity of the
+     * records inside them) are recycled between producers and consumers instead of being reallocated.
+     */
+    template<typename T>
+    class RingBuffer {
+    public:
+
+        using batch_type = std::vector<T>; // A single batch of records
+
+    private:
+
+        std::vector<batch_type> slots; // Circular array of batches
+        std::size_t head; // Index of the next slot to be consumed
+        std::size_t tail; // Index of the next slot to be produced into
+        std::size_t count; // Number of filled slots
+        bool closed; // Indicates that no more batches will be put into the buffer
+        std::size_t waiting_producers; // Number of producers sleeping on a full buffer
+        std::size_t waiting_consumers; // Number of consumers sleeping on an empty buffer
+        std::mutex buff_mutex; // Mutex over the slots
+        std::condition_variable buff_full; // Signals if the buffer has a batch for a consumer
+        std::condition_variable buff_empty; // Signals if the buffer has a free slot for a producer
+        std::chrono::nanoseconds producer_wait; // Time producers spent blocked on the mutex or on a full buffer
+        std::chrono::nanoseconds consumer_wait; // Time consumers spent blocked on the mutex or on an empty buffer
+
+    public:
+
+        /** @brief Constructor for the RingBuffer
+         * @param depth Maximum number of batches held by the buffer at once. Must be at least 1
+         */
+        explicit RingBuffer(const std::size_t depth);
+
+        /** @brief Puts a batch into the buffer, blocking while the buffer is full.
+         * On return, batch holds a recycled batch whose stale records the caller may overwrite when refilling it.
+         * Returns false, leaving batch untouched, if the buffer has been closed
+         * @param batch Batch of records to hand off
+         */
+        bool put(batch_type& batch);
+
+        /** @brief Fetches a batch from the buffer, blocking while the buffer is empty.
+         * The previous contents of batch are handed back to the buffer for recycling.
+         * Returns false if the buffer is closed and fully drained
+         * @param batch Location to put the fetched batch
+         */
+        bool get(batch_type& batch);
+
+        /** @brief Marks the buffer as closed and wakes up every sleeping producer and consumer */
+        void close();
+
+        /** @brief Reopens a closed and drained buffer for reuse, clearing the wait times */
+        void reset();
+
+        /** @brief Returns the seconds producers spent blocked on the mutex or on a full buffer */
+        double producerWaitSeconds();
+
+        /** @brief Returns the seconds consumers spent blocked on the mutex or on an empty buffer */
+        double consumerWaitSeconds();
+    };
+
+    // ----- Definitions ------
+
+    template<typename T>
+    RingBuffer<T>::RingBuffer(const std::size_t depth):
+        slots(depth > 0 ? depth : 1),
+        head(0),
+        tail(0),
+        count(0),
+        closed(false),
+        waiting_producers(0),
+        waiting_consumers(0),
+        producer_wait(0),
+        consumer_wait(0) {}
+
+    template<typename T>
+    bool RingBuffer<T>::put(batch_type& batch) {
+        // Wait for a free slot
+        auto wait_start = std::chrono::steady_clock::now();
+        std::unique_lock producer_lock{buff_mutex};
+        if (count == slots.size() && !closed) {
+            waiting_producers++;
+            buff_empty.wait(producer_lock, [&]() { return count < slots.size() || closed; });
+            waiting_producers--;
+        }
+        producer_wait += std::chrono::steady_clock::now() - wait_start;
+        if (closed)
+            return false;
+
+        // Swap the batch in, getting back the recycled contents of the slot
+        std::swap(slots[tail], batch);
+        tail = (tail + 1) % slots.size();
+        count++;
+
+        // Only notify when somebody is actually sleeping
+        const bool notify = waiting_consumers > 0;
+        producer_lock.unlock();
+        if (notify)
+            buff_full.notify_one();
+        return true;
+    }
+
+    template<typename T>
+    bool RingBuffer<T>::get(batch_type& batch) {
+        // Wait for a filled slot
+        auto wait_start = std::chrono::steady_clock::now();
+        std::unique_lock consumer_lock{buff_mutex};
+        if (count == 0 && !closed) {
+            waiting_consumers++;
+            buff_full.wait(consumer_lock, [&]() { return count > 0 || closed; });
+            waiting_consumers--;
+        }
+        consumer_wait += std::chrono::steady_clock::now() - wait_start;
+        if (count == 0)
+            return false;
+
+        // Swap the batch out, handing back the consumer's previous batch for recycling
+        std::swap(slots[head], batch);
+        head = (head + 1) % slots.size();
+        count--;
+
+        const bool notify = waiting_producers > 0;
+        consumer_lock.unlock();
+        if (notify)
+            buff_empty.notify_one();
+        return true;
+    }
+
+    template<typename T>
+    void RingBuffer<T>::close() {
+        {
+            std::scoped_lock close_lock{buff_mutex};
+            closed = true;
+        }
+        buff_full.notify_all();
+        buff_empty.notify_all();
+    }
+
+    template<typename T>
+    void RingBuffer<T>::reset() {
+        std::scoped_lock reset_lock{buff_mutex};
+        head = tail = count = 0;
+        closed = false;
+        producer_wait = consumer_wait = std::chrono::nanoseconds(0);
+    }
+
+    template<typename T>
+    double RingBuffer<T>::producerWaitSeconds() {
+        std::scoped_lock wait_lock{buff_mutex};
+        return std::chrono::duration<double>(producer_wait).count();
+    }
+
+    template<typename T>
+    double RingBuffer<T>::consumerWaitSeconds() {
+        std::scoped_lock wait_lock{buff_mutex};
+        return std::chrono::duration<double>(consumer_wait).count();
+    }
+}
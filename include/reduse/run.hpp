@@ -0,0 +1,370 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <reduse/options.hpp>
+#include <reduse/serialization.hpp>
+
+namespace reduse {
+
+    const std::size_t RUN_INDEX_INTERVAL = 1024; // Number of records between two entries of a spilled run's sparse index
+
+    /** @brief Entry of the sparse index of a spilled run */
+    template<typename key>
+    struct RunIndexEntry {
+        key first; // Key of the indexed record
+        std::streamoff offset; // File offset of the indexed record
+        std::size_t position; // Position of the indexed record within the run
+    };
+
+    /** @brief A sequence of records sorted by key, held either in memory or in a slice of a spill file.
+     * Several runs (one per partition) may share a single spill file
+     * @param key Data type of the key of a record
+     * @param value Data type of the value of a record
+     */
+    template<typename key, typename value>
+    struct SortedRun {
+        using record_type = std::pair<key, value>; // A single record
+
+        std::vector<record_type> records; // Records of an in-memory run
+        std::string filename; // File holding a spilled run. Empty for in-memory runs
+        std::streamoff offset = 0; // File offset of the first record of a spilled run
+        std::vector<RunIndexEntry<key>> index; // Every RUN_INDEX_INTERVAL-th record of a spilled run
+        std::size_t size = 0; // Number of records in the run
+        Format format = Format::TEXT; // Encoding of the records of a spilled run
+
+        /** @brief Returns true if the run lives in a spill file */
+        bool onDisk() const { return !filename.empty(); }
+    };
+
+    /** @brief Writes records to a stream in one of the intermediate formats */
+    template<typename key, typename value>
+    class RecordWriter {
+    private:
+
+        std::ostream& output; // Underlying stream
+        const Format format; // Encoding of the records
+        std::optional<BinaryWriter> binary; // Buffered writer of the binary format
+
+    public:
+
+        /** @brief Constructor for the RecordWriter. Writing starts at the current position of the stream
+         * @param _output Stream to write to
+         * @param _format Encoding of the records
+         */
+        RecordWriter(std::ostream& _output, const Format _format): output(_output), format(_format) {
+            if (format == Format::BINARY)
+                binary.emplace(output);
+        }
+
+        /** @brief Writes a single record */
+        void write(const std::pair<key, value>& record) {
+            if (format == Format::BINARY) {
+                Serializer<key>::write(*binary, record.first);
+                Serializer<value>::write(*binary, record.second);
+            } else {
+                output << record.first << ' ' << record.second << '\n';
+            }
+        }
+
+        /** @brief Returns the stream offset the next record will be written at */
+        std::streamoff offset() {
+            return format == Format::BINARY ? binary->offset() : static_cast<std::streamoff>(output.tellp());
+        }
+
+        /** @brief Hands every buffered record to the stream */
+        void flush() {
+            if (binary)
+                binary->flush();
+        }
+    };
+
+    /** @brief Reads records from a stream in one of the intermediate formats */
+    template<typename key, typename value>
+    class RecordReader {
+    private:
+
+        std::istream& input; // Underlying stream
+        const Format format; // Encoding of the records
+        std::optional<BinaryReader> binary; // Buffered reader of the binary format
+
+    public:
+
+        /** @brief Constructor for the RecordReader. Reading starts at the current position of the stream
+         * @param _input Stream to read from
+         * @param _format Encoding of the records
+         */
+        RecordReader(std::istream& _input, const Format _format): input(_input), format(_format) {
+            if (format == Format::BINARY)
+                binary.emplace(input);
+        }
+
+        /** @brief Reads a single record. Returns false at the end of the input */
+        bool read(std::pair<key, value>& record) {
+            if (format == Format::BINARY)
+                return Serializer<key>::read(*binary, record.first) && Serializer<value>::read(*binary, record.second);
+            return static_cast<bool>(input >> record.first >> record.second);
+        }
+
+        /** @brief Moves to an absolute offset of the stream */
+        void seek(const std::streamoff offset) {
+            if (binary) {
+                binary->seek(offset);
+            } else {
+                input.clear();
+                input.seekg(offset);
+            }
+        }
+    };
+
+    /** @brief Appends already sorted records to an open spill file and returns the spilled run. The records are cleared
+     * @param records Records sorted by key
+     * @param writer Writer of the spill file
+     * @param filename Name of the spill file
+     * @param format Encoding used by writer
+     */
+    template<typename key, typename value>
+    SortedRun<key, value> spillRun(
+        std::vector<std::pair<key, value>>& records,
+        RecordWriter<key, value>& writer,
+        const std::string& filename,
+        const Format format
+    ) {
+        SortedRun<key, value> run;
+        run.filename = filename;
+        run.format = format;
+        run.offset = writer.offset();
+        run.size = records.size();
+        for(std::size_t i = 0; i < records.size(); i++) {
+            if (i % RUN_INDEX_INTERVAL == 0)
+                run.index.push_back({records[i].first, writer.offset(), i});
+            writer.write(records[i]);
+        }
+        records.clear();
+        return run;
+    }
+
+    /** @brief Reads the records of a run that fall within a half-open key range, in key order */
+    template<typename key, typename value>
+    class RunCursor {
+    public:
+
+        using record_type = std::pair<key, value>; // A single record
+
+    private:
+
+        const std::optional<key> upper; // Exclusive upper bound of the key range
+        record_type* curr; // Current record
+        record_type* end; // End of the in-memory records
+        std::ifstream input; // Spill file stream
+        std::optional<RecordReader<key, value>> reader; // Record reader over input
+        record_type record; // Last record read from the spill file
+        std::size_t remaining; // Number of records of the spilled run not read yet
+        bool from_file; // Indicates that the run is read from its spill file
+
+    public:
+
+        /** @brief Constructor for the RunCursor
+         * @param run Run to read
+         * @param lower Inclusive lower bound of the keys to read. Unbounded if empty
+         * @param _upper Exclusive upper bound of the keys to read. Unbounded if empty
+         */
+        RunCursor(SortedRun<key, value>& run, const std::optional<key>& lower, const std::optional<key>& _upper);
+
+        /** @brief Returns true if the cursor points at a record */
+        bool valid() const { return curr != nullptr; }
+
+        /** @brief Returns the current record. Its contents may be moved out before advancing */
+        record_type& current() { return *curr; }
+
+        /** @brief Advances to the next record */
+        void next();
+    };
+
+    /** @brief Pulls the records of several runs that fall within a half-open key range, in key order. Ties go to the
+     * earlier run
+     */
+    template<typename key, typename value>
+    class RunMerger {
+    public:
+
+        using record_type = std::pair<key, value>; // A single record
+
+    private:
+
+        std::vector<std::unique_ptr<RunCursor<key, value>>> cursors; // Cursors of the runs with records left
+        std::vector<std::size_t> heap; // Min-heap of cursor indices ordered by their current key. Excludes top
+        std::size_t top; // Index of the cursor holding the current record
+        bool has_top; // Indicates that top holds a record
+
+        /** @brief Returns true if the current record of cursor a comes after the current record of cursor b */
+        bool heapGreater(const std::size_t a, const std::size_t b) const;
+
+        /** @brief Takes the cursor with the smallest key off the heap and makes it the top */
+        void pop();
+
+    public:
+
+        /** @brief Constructor for the RunMerger
+         * @param runs Runs to merge. Must outlive the merger
+         * @param lower Inclusive lower bound of the keys to merge. Unbounded if empty
+         * @param upper Exclusive upper bound of the keys to merge. Unbounded if empty
+         */
+        RunMerger(std::vector<SortedRun<key, value>>& runs, const std::optional<key>& lower, const std::optional<key>& upper);
+
+        /** @brief Returns true if the merger points at a record */
+        bool valid() const { return has_top; }
+
+        /** @brief Returns the current record. Its contents may be moved out before advancing */
+        record_type& current() { return cursors[top]->current(); }
+
+        /** @brief Advances to the next record in key order */
+        void next();
+    };
+
+    /** @brief Merges the records of several runs that fall within a half-open key range, calling fn on each in key order
+     * @param runs Runs to merge
+     * @param lower Inclusive lower bound of the keys to merge. Unbounded if empty
+     * @param upper Exclusive upper bound of the keys to merge. Unbounded if empty
+     * @param fn Callable taking a std::pair<key, value>&, which it may move from
+     */
+    template<typename key, typename value, typename Fn>
+    void mergeRuns(
+        std::vector<SortedRun<key, value>>& runs,
+        const std::optional<key>& lower,
+        const std::optional<key>& upper,
+        Fn&& fn
+    );
+
+    // ----- Definitions ------
+
+    template<typename key, typename value>
+    RunCursor<key, value>::RunCursor(
+        SortedRun<key, value>& run,
+        const std::optional<key>& lower,
+        const std::optional<key>& _upper
+    ):  upper(_upper),
+        curr(nullptr),
+        end(nullptr),
+        remaining(run.size),
+        from_file(run.onDisk()) {
+        auto key_less = [](const record_type& a, const key& b) { return a.first < b; };
+
+        if (!from_file) {
+            // Binary search the bounds of the range in memory
+            auto begin = run.records.data();
+            end = run.records.data() + run.records.size();
+            if (lower)
+                begin = std::lower_bound(begin, end, *lower, key_less);
+            if (upper)
+                end = std::lower_bound(begin, end, *upper, key_less);
+            curr = begin < end ? begin : nullptr;
+            return;
+        }
+
+        input.open(run.filename, std::ios::in | std::ios::binary);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open spill file: " + run.filename);
+        reader.emplace(input, run.format);
+
+        // Seek to the last indexed record whose key is below the lower bound. Every record before it is out of range
+        reader->seek(run.offset);
+        if (lower) {
+            auto entry = std::lower_bound(run.index.begin(), run.index.end(), *lower,
+                [](const RunIndexEntry<key>& a, const key& b) { return a.first < b; });
+            if (entry != run.index.begin()) {
+                reader->seek(std::prev(entry)->offset);
+                remaining = run.size - std::prev(entry)->position;
+            }
+        }
+
+        // Skip the records below the lower bound
+        curr = &record;
+        next();
+        while (valid() && lower && record.first < *lower)
+            next();
+    }
+
+    template<typename key, typename value>
+    void RunCursor<key, value>::next() {
+        if (!from_file) {
+            if (++curr == end)
+                curr = nullptr;
+            return;
+        }
+        if (remaining == 0 || !reader->read(record) || (upper && !(record.first < *upper))) {
+            curr = nullptr;
+            return;
+        }
+        remaining--;
+    }
+
+    template<typename key, typename value>
+    RunMerger<key, value>::RunMerger(
+        std::vector<SortedRun<key, value>>& runs,
+        const std::optional<key>& lower,
+        const std::optional<key>& upper
+    ):  top(0),
+        has_top(false) {
+        for(auto &run: runs) {
+            auto cursor = std::make_unique<RunCursor<key, value>>(run, lower, upper);
+            if (cursor->valid())
+                cursors.push_back(std::move(cursor));
+        }
+        for(std::size_t i = 0; i < cursors.size(); i++)
+            heap.push_back(i);
+        std::make_heap(heap.begin(), heap.end(), [this](std::size_t a, std::size_t b) { return heapGreater(a, b); });
+        pop();
+    }
+
+    template<typename key, typename value>
+    bool RunMerger<key, value>::heapGreater(const std::size_t a, const std::size_t b) const {
+        const key& key_a = cursors[a]->current().first;
+        const key& key_b = cursors[b]->current().first;
+        if (key_b < key_a) return true;
+        if (key_a < key_b) return false;
+        return a > b;
+    }
+
+    template<typename key, typename value>
+    void RunMerger<key, value>::pop() {
+        has_top = !heap.empty();
+        if (!has_top)
+            return;
+        std::pop_heap(heap.begin(), heap.end(), [this](std::size_t a, std::size_t b) { return heapGreater(a, b); });
+        top = heap.back();
+        heap.pop_back();
+    }
+
+    template<typename key, typename value>
+    void RunMerger<key, value>::next() {
+        // The top cursor is only compared again once it has advanced, so its record may have been moved from
+        auto &cursor = cursors[top];
+        cursor->next();
+        if (cursor->valid()) {
+            heap.push_back(top);
+            std::push_heap(heap.begin(), heap.end(), [this](std::size_t a, std::size_t b) { return heapGreater(a, b); });
+        }
+        pop();
+    }
+
+    template<typename key, typename value, typename Fn>
+    void mergeRuns(
+        std::vector<SortedRun<key, value>>& runs,
+        const std::optional<key>& lower,
+        const std::optional<key>& upper,
+        Fn&& fn
+    ) {
+        for(RunMerger<key, value> merger(runs, lower, upper); merger.valid(); merger.next())
+            fn(merger.current());
+    }
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <vector>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <reduse/options.hpp>
+#include <reduse/records.hpp>
+
+namespace reduse {
+
+    const std::size_t MIN_MAP_TASK_SIZE = 1 << 12; // Fewest bytes of input a map task covers
+    const std::size_t MAX_MAP_TASK_SIZE = 1 << 22; // Most bytes of input a map task covers
+    const std::size_t INITIAL_MAP_TASK_SIZE = 1 << 16; // Bytes of input covered by the first map task of a worker
+    const double MAP_TASK_SECONDS = 0.002; // Time a map task is sized to take, judging by the previous task of its worker
+
+    /** @brief Hands out an input in record aligned map tasks to a fixed set of workers, balancing them by work
+     * stealing. Every worker owns a contiguous range of the input and takes its tasks off the front of it. A worker
+     * whose range runs dry steals the back half of the largest range left. Tasks are sized from the time the previous
+     * task of the same worker took, so cheap records come in large tasks and expensive ones in small tasks that leave
+     * more of the input up for stealing. Thread safe
+     */
+    class SplitScheduler {
+    private:
+
+        /** @brief Input range and task sizing of a single worker */
+        struct Worker {
+            std::string_view range; // Input not handed out yet
+            std::size_t task_size = INITIAL_MAP_TASK_SIZE; // Bytes of the next task
+            std::size_t last_size = 0; // Bytes of the previous task. 0 before the first one
+            std::chrono::steady_clock::time_point last_start; // Time the previous task was handed out
+            std::size_t steals = 0; // Number of ranges stolen by the worker
+            std::mutex worker_mutex; // Mutex over range
+        };
+
+        const RecordScanner scanner; // Finds the record boundaries of the input
+        std::vector<std::unique_ptr<Worker>> workers; // Every worker. Each sits in its own allocation, so their mutexes never share a cache line
+
+        /** @brief Takes the back half of the largest range of another worker, or all of it if it is small
+         * @return False if no input is left anywhere
+         */
+        bool steal(const std::size_t thief);
+
+    public:
+
+        /** @brief Constructor for the SplitScheduler. The input is first spread evenly over the workers
+         * @param input Whole input. Must outlive the scheduler
+         * @param num_workers Number of workers. At least one
+         * @param options Tuning options holding the record format. See reduse::Options
+         */
+        SplitScheduler(std::string_view input, const std::size_t num_workers, const Options& options);
+
+        /** @brief Returns the number of workers */
+        std::size_t workerCount() const { return workers.size(); }
+
+        /** @brief Hands the next map task to a worker, and sizes it by the time the worker took for the previous one
+         * @param worker Index of the worker, below workerCount()
+         * @param task Set to the record aligned input range of the task
+         * @return False once the whole input has been handed out
+         */
+        bool next(const std::size_t worker, std::string_view& task);
+
+        /** @brief Returns the number of ranges stolen by every worker together. Call once the workers are done */
+        std::size_t stealCount() const;
+    };
+
+    // ----- Definitions ------
+
+    inline SplitScheduler::SplitScheduler(std::string_view input, const std::size_t num_workers, const Options& options):
+        scanner(options) {
+        auto splits = scanner.split(input, num_workers);
+        for(std::size_t i = 0; i < std::max<std::size_t>(num_workers, 1); i++) {
+            workers.push_back(std::make_unique<Worker>());
+            if (i < splits.size())
+                workers.back()->range = splits[i];
+        }
+    }
+
+    inline bool SplitScheduler::next(const std::size_t worker, std::string_view& task) {
+        Worker& self = *workers[worker];
+
+        // Aim the next task at MAP_TASK_SECONDS, growing at most fourfold at once so a lucky task does not overshoot
+        const auto now = std::chrono::steady_clock::now();
+        if (self.last_size > 0) {
+            const double seconds = std::max(std::chrono::duration<double>(now - self.last_start).count(), 1e-7);
+            const double fitted = static_cast<double>(self.last_size) * MAP_TASK_SECONDS / seconds;
+            self.task_size = static_cast<std::size_t>(std::clamp(
+                fitted, static_cast<double>(MIN_MAP_TASK_SIZE), static_cast<double>(std::min(self.task_size * 4, MAX_MAP_TASK_SIZE))
+            ));
+        }
+
+        while(true) {
+            {
+                std::scoped_lock worker_lock{self.worker_mutex};
+                if (!self.range.empty()) {
+                    const std::size_t end = scanner.nextBoundary(self.range, std::min(self.task_size, self.range.size()));
+                    task = self.range.substr(0, end);
+                    self.range.remove_prefix(task.size());
+                    self.last_size = task.size();
+                    self.last_start = now;
+                    return true;
+                }
+            }
+            if (!steal(worker))
+                return false;
+        }
+    }
+
+    inline bool SplitScheduler::steal(const std::size_t thief) {
+        while(true) {
+            // The victim is the worker with the most input left
+            std::size_t victim = workers.size();
+            std::size_t most = 0;
+            for(std::size_t i = 0; i < workers.size(); i++) {
+                if (i == thief)
+                    continue;
+                std::scoped_lock worker_lock{workers[i]->worker_mutex};
+                if (workers[i]->range.size() > most) {
+                    most = workers[i]->range.size();
+                    victim = i;
+                }
+            }
+            if (victim == workers.size())
+                return false;
+
+            // Take the back half. The thief's own range is empty, so no other thief looks at it meanwhile
+            std::string_view stolen;
+            {
+                Worker& other = *workers[victim];
+                std::scoped_lock worker_lock{other.worker_mutex};
+                if (other.range.empty())
+                    continue;
+                std::size_t split = other.range.size() <= MIN_MAP_TASK_SIZE
+                    ? 0
+                    : scanner.nextBoundary(other.range, other.range.size() / 2);
+                if (split == other.range.size())
+                    split = 0;
+                stolen = other.range.substr(split);
+                other.range = other.range.substr(0, split);
+            }
+
+            Worker& self = *workers[thief];
+            std::scoped_lock worker_lock{self.worker_mutex};
+            self.range = stolen;
+            self.steals++;
+            return true;
+        }
+    }
+
+    inline std::size_t SplitScheduler::stealCount() const {
+        std::size_t steals = 0;
+        for(auto &worker: workers) {
+            std::scoped_lock worker_lock{worker->worker_mutex};
+            steals += worker->steals;
+        }
+        return steals;
+    }
+}
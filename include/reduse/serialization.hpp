@@ -0,0 +1,174 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <algorithm>
+
+namespace reduse {
+
+    const std::size_t BINARY_BUFFER_SIZE = 1 << 16; // Bytes buffered by a BinaryWriter or a BinaryReader
+
+    /** @brief Buffered writer of raw bytes on top of an output stream */
+    class BinaryWriter {
+    private:
+
+        std::ostream& output; // Underlying stream
+        std::vector<char> buffer; // Bytes not yet handed to the stream
+        std::size_t used; // Number of bytes used in buffer
+        std::streamoff flushed; // Stream offset right after the last flushed byte
+
+    public:
+
+        /** @brief Constructor for the BinaryWriter. Writing starts at the current position of the stream
+         * @param _output Stream to write to
+         */
+        explicit BinaryWriter(std::ostream& _output):
+            output(_output),
+            buffer(BINARY_BUFFER_SIZE),
+            used(0),
+            flushed(static_cast<std::streamoff>(_output.tellp())) {}
+
+        BinaryWriter(const BinaryWriter&) = delete;
+        BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+        /** @brief Destructor. Flushes the remaining bytes */
+        ~BinaryWriter() { flush(); }
+
+        /** @brief Writes size bytes starting at data */
+        void write(const void* data, const std::size_t size) {
+            if (used + size > buffer.size()) {
+                flush();
+                if (size > buffer.size()) {
+                    output.write(static_cast<const char*>(data), size);
+                    flushed += size;
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        /** @brief Returns the stream offset the next byte will be written at */
+        std::streamoff offset() const { return flushed + static_cast<std::streamoff>(used); }
+
+        /** @brief Hands the buffered bytes to the stream */
+        void flush() {
+            if (used == 0)
+                return;
+            output.write(buffer.data(), used);
+            flushed += used;
+            used = 0;
+        }
+    };
+
+    /** @brief Buffered reader of raw bytes on top of an input stream */
+    class BinaryReader {
+    private:
+
+        std::istream& input; // Underlying stream
+        std::vector<char> buffer; // Bytes read ahead from the stream
+        std::size_t pos; // Position of the next unread byte in buffer
+        std::size_t end; // Number of valid bytes in buffer
+
+    public:
+
+        /** @brief Constructor for the BinaryReader. Reading starts at the current position of the stream
+         * @param _input Stream to read from
+         */
+        explicit BinaryReader(std::istream& _input):
+            input(_input),
+            buffer(BINARY_BUFFER_SIZE),
+            pos(0),
+            end(0) {}
+
+        BinaryReader(const BinaryReader&) = delete;
+        BinaryReader& operator=(const BinaryReader&) = delete;
+
+        /** @brief Reads size bytes into data. Returns false if the input ends first */
+        bool read(void* data, std::size_t size) {
+            char* dest = static_cast<char*>(data);
+            while (size > 0) {
+                if (pos == end) {
+                    if (!input.read(buffer.data(), buffer.size()) && input.gcount() == 0)
+                        return false;
+                    pos = 0;
+                    end = static_cast<std::size_t>(input.gcount());
+                }
+                std::size_t chunk = std::min(size, end - pos);
+                std::memcpy(dest, buffer.data() + pos, chunk);
+                pos += chunk;
+                dest += chunk;
+                size -= chunk;
+            }
+            return true;
+        }
+
+        /** @brief Moves to an absolute offset of the stream, dropping the bytes read ahead */
+        void seek(const std::streamoff offset) {
+            input.clear();
+            input.seekg(offset);
+            pos = end = 0;
+        }
+    };
+
+    /** @brief Writes a length-prefixed string */
+    inline void writeString(BinaryWriter& writer, const std::string& item) {
+        std::uint64_t length = item.size();
+        writer.write(&length, sizeof(length));
+        writer.write(item.data(), item.size());
+    }
+
+    /** @brief Reads a length-prefixed string. Returns false at the end of the input */
+    inline bool readString(BinaryReader& reader, std::string& item) {
+        std::uint64_t length;
+        if (!reader.read(&length, sizeof(length)))
+            return false;
+        item.resize(length);
+        return reader.read(item.data(), length);
+    }
+
+    /** @brief Serialization trait of the binary intermediate format.
+     * Trivially copyable types are copied byte for byte and std::string is length-prefixed. Every other type falls back
+     * to its << and >> operators, storing the text length-prefixed. Specialize this for your own types to skip the text:
+     *
+     *     template<> struct reduse::Serializer<MyType> {
+     *         static void write(reduse::BinaryWriter& writer, const MyType& item);
+     *         static bool read(reduse::BinaryReader& reader, MyType& item);
+     *     };
+     */
+    template<typename T, typename = void>
+    struct Serializer {
+        static void write(BinaryWriter& writer, const T& item) {
+            std::ostringstream text;
+            text << item;
+            writeString(writer, text.str());
+        }
+
+        static bool read(BinaryReader& reader, T& item) {
+            std::string text;
+            if (!readString(reader, text))
+                return false;
+            std::istringstream text_stream(text);
+            return static_cast<bool>(text_stream >> item);
+        }
+    };
+
+    template<typename T>
+    struct Serializer<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+        static void write(BinaryWriter& writer, const T& item) { writer.write(&item, sizeof(T)); }
+
+        static bool read(BinaryReader& reader, T& item) { return reader.read(&item, sizeof(T)); }
+    };
+
+    template<>
+    struct Serializer<std::string> {
+        static void write(BinaryWriter& writer, const std::string& item) { writeString(writer, item); }
+
+        static bool read(BinaryReader& reader, std::string& item) { return readString(reader, item); }
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <reduse/options.hpp>
+#include <reduse/partitioner.hpp>
+#include <reduse/thread_pool.hpp>
+#include <reduse/stats.hpp>
+#include <reduse/reduse.hpp>
+
+namespace reduse {
+
+    /** @brief Long-lived executor for many reduse jobs. Owns a thread pool that runs the mapper and reducer workers of
+     * every job, so no thread is created or torn down per job. Jobs may be run from several threads at once; each job
+     * gets a fair share of the pool
+     */
+    class Session {
+    private:
+
+        const std::shared_ptr<ThreadPool> pool; // Pool running the workers of every job
+
+    public:
+
+        /** @brief Constructor for the Session. Starts the worker threads
+         * @param num_threads Number of worker threads. Set to the number of hardware threads by default
+         */
+        explicit Session(const int num_threads = static_cast<int>(std::thread::hardware_concurrency())):
+            pool(std::make_shared<ThreadPool>(num_threads)) {}
+
+        /** @brief Returns the number of worker threads */
+        int threadCount() const { return pool->size(); }
+
+        /** @brief Runs a job on the session's workers. Takes the same arguments as reduse::reduse with a combiner.
+         * num_mappers and num_reducers set the number of worker tasks of the job; they may exceed the number of threads
+         */
+        template<
+            typename map_key,
+            typename map_value,
+            typename reduce_value,
+            typename Partitioner = HashPartitioner<map_key>,
+            typename MapFn,
+            typename ReduceFn,
+            typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+        >
+        JobStats reduse(
+            const std::string& input_filename,
+            const std::string& output_filename,
+            MapFn&& MAP,
+            ReduceFn&& REDUCE,
+            const std::function<map_value(const map_key&, std::vector<map_value>&)> &COMBINE,
+            const int num_mappers = DEFAULT_NUM_MAPPERS,
+            const int num_reducers = DEFAULT_NUM_REDUCERS,
+            const bool verbose = false,
+            const Options& options = Options()
+        ) {
+            return runJob<map_key, map_value, reduce_value, Partitioner>(
+                pool, input_filename, output_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), COMBINE,
+                num_mappers, num_reducers, verbose, options
+            );
+        }
+
+        /** @brief Runs a job on the session's workers. Takes the same arguments as reduse::reduse */
+        template<
+            typename map_key,
+            typename map_value,
+            typename reduce_value,
+            typename Partitioner = HashPartitioner<map_key>,
+            typename MapFn,
+            typename ReduceFn,
+            typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+        >
+        JobStats reduse(
+            const std::string& input_filename,
+            const std::string& output_filename,
+            MapFn&& MAP,
+            ReduceFn&& REDUCE,
+            const int num_mappers = DEFAULT_NUM_MAPPERS,
+            const int num_reducers = DEFAULT_NUM_REDUCERS,
+            const bool verbose = false,
+            const Options& options = Options()
+        ) {
+            auto COMBINE = associativeCombiner<map_key, map_value, reduce_value>(REDUCE, options);
+            return runJob<map_key, map_value, reduce_value, Partitioner>(
+                pool, input_filename, output_filename, std::forward<MapFn>(MAP), REDUCE, COMBINE,
+                num_mappers, num_reducers, verbose, options
+            );
+        }
+    };
+}
@@ -0,0 +1,488 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <exception>
+#include <stdexcept>
+#include <reduse/memory.hpp>
+#include <reduse/budget.hpp>
+#include <reduse/run.hpp>
+#include <reduse/io.hpp>
+#include <unistd.h>
+
+namespace reduse {
+
+    /** @brief Returns the bytes a single SortBuffer may hold before it is spilled, when num_workers fill a sorter
+     * @param options Tuning options. See reduse::Options
+     * @param num_workers Number of workers owning a SortBuffer each
+     */
+    inline std::size_t sortBufferBudget(const Options& options, const int num_workers) {
+        if (options.shuffle_mode == ShuffleMode::MEMORY)
+            return std::numeric_limits<std::size_t>::max();
+        std::size_t budget = options.sort_memory_budget;
+        if (options.memory_budget > 0)
+            budget = std::min(budget, static_cast<std::size_t>(static_cast<double>(options.memory_budget) * (1 - MEMORY_HEADROOM_SHARE)));
+        return budget / (num_workers > 0 ? num_workers : 1);
+    }
+
+    /** @brief Returns a spill prefix of its own for every job, made of base, the process ID and a process-wide job
+     * counter, so jobs running at the same time over the same input never write to each other's spill files
+     * @param base Name the spill files of the job start with
+     */
+    inline std::string jobSpillPrefix(const std::string& base) {
+        static std::atomic<std::uint64_t> next_job{0};
+        return base + "." + std::to_string(::getpid()) + "_" + std::to_string(next_job++);
+    }
+
+    /** @brief In-process external sort over a fixed number of partitions. Workers hand in records through SortBuffers,
+     * which sort them into per-partition runs and spill them to disk when they outgrow their memory budget. The runs
+     * of a partition are finally combined with a k-way merge ordered by operator< on the key
+     * @param key Data type of the key of a record
+     * @param value Data type of the value of a record
+     */
+    template<typename key, typename value>
+    class ExternalSorter {
+    public:
+
+        using record_type = std::pair<key, value>; // A single record
+        using run_type = SortedRun<key, value>; // A single sorted run
+
+    private:
+
+        const std::string spill_prefix; // Prefix of the spill and segment filenames
+        const std::size_t buffer_budget; // Bytes a single sort buffer may hold before it is spilled
+        const std::size_t num_partitions; // Number of partitions
+        const Format spill_format; // Encoding of the spill files
+        const IoBackend io_backend; // How the spill and merge output files are written
+        std::vector<std::vector<run_type>> runs; // Sorted runs produced so far, per partition
+        std::vector<std::string> spill_files; // Spill files written so far
+        std::atomic<std::size_t> num_spills; // Number of spill files written so far
+        std::atomic<std::size_t> spilled_bytes; // Bytes written to spill files so far
+        std::vector<std::size_t> closed_writers; // Number of writers that closed each partition
+        std::size_t num_writers; // Number of writers expected to close every partition
+        std::atomic<std::size_t> next_closer; // Rotates the partition every closing writer starts with
+        std::function<void(std::size_t)> on_final; // Called with every partition once all writers closed it
+        std::shared_ptr<MemoryBudget> memory_budget; // Job-wide budget the sort buffers reserve their memory from. None if unset
+        std::size_t held_bytes; // Bytes reserved from memory_budget for the records of in-memory runs
+        std::mutex runs_mutex; // Mutex over runs, spill_files, closed_writers and held_bytes
+
+    public:
+
+        /** @brief Constructor for the ExternalSorter
+         * @param _spill_prefix Prefix of the spill and segment filenames. Files are named <prefix>.run<N> and <prefix>.segment<P>_<N>
+         * @param _buffer_budget Bytes a single SortBuffer may hold before it is spilled to disk
+         * @param _num_partitions Number of partitions the records are split into. Set to 1 by default
+         * @param _spill_format Encoding of the spill files. Set to Format::BINARY by default
+         * @param _io_backend How the spill and merge output files are written. Set to IoBackend::AUTO by default
+         */
+        ExternalSorter(
+            const std::string& _spill_prefix,
+            const std::size_t _buffer_budget,
+            const std::size_t _num_partitions = 1,
+            const Format _spill_format = Format::BINARY,
+            const IoBackend _io_backend = IoBackend::AUTO
+        );
+
+        ExternalSorter(const ExternalSorter&) = delete;
+        ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+        /** @brief Destructor. Removes any spill file left behind */
+        ~ExternalSorter();
+
+        /** @brief Returns the number of bytes a single SortBuffer may hold before it is spilled */
+        std::size_t bufferBudget() const { return buffer_budget; }
+
+        /** @brief Reserves the memory of the sort buffers from a job-wide budget. A sort buffer is also spilled whenever
+         * the budget runs short, and the records of in-memory runs stay reserved until clear(). Not thread safe
+         * @param _memory_budget Job-wide budget. Set to nullptr to only keep to the buffer budget
+         */
+        void setMemoryBudget(const std::shared_ptr<MemoryBudget>& _memory_budget) { memory_budget = _memory_budget; }
+
+        /** @brief Returns the job-wide budget of the sort buffers, or null if unset */
+        MemoryBudget* memoryBudget() const { return memory_budget.get(); }
+
+        /** @brief Takes over memory reserved by a sort buffer for records that stay in an in-memory run. It is given
+         * back to the budget by clear(). Thread safe
+         */
+        void holdReserved(const std::size_t bytes);
+
+        /** @brief Returns the number of partitions */
+        std::size_t partitionCount() const { return num_partitions; }
+
+        /** @brief Returns the number of spill files written so far */
+        std::size_t spillCount() const { return num_spills; }
+
+        /** @brief Returns the number of bytes written to spill files so far */
+        std::size_t spilledBytes() const { return spilled_bytes; }
+
+        /** @brief Sorts every partition of a batch of records into a new run. Thread safe
+         * @param partitions Records to sort, per partition. Moved into the runs (or cleared, if spilled)
+         * @param spill Set true to write the runs to a single spill file instead of keeping them in memory
+         */
+        void addRuns(std::vector<std::vector<record_type>>& partitions, const bool spill);
+
+        /** @brief Starts counting how many writers closed each partition. A partition is final, and its runs no longer
+         * change, once num_writers writers have closed it. Not thread safe
+         * @param _num_writers Number of writers that will close every partition
+         */
+        void expectWriters(const std::size_t _num_writers);
+
+        /** @brief Sets a handler called with every partition as soon as it is final, on the thread of the writer
+         * that closed it last. The handler must not block on other writers. Not thread safe
+         * @param _on_final Handler taking the partition. Set to nullptr to remove it
+         */
+        void setFinalHandler(const std::function<void(std::size_t)>& _on_final) { on_final = _on_final; }
+
+        /** @brief Sorts the last records of a writer for a partition into an in-memory run and counts the partition
+         * as closed by the writer. Thread safe
+         * @param partition Partition to close
+         * @param records Records to sort. Moved into the run
+         */
+        void closePartition(const std::size_t partition, std::vector<record_type>& records);
+
+        /** @brief Returns the partition a closing writer should start with, so that writers close partitions in
+         * different orders and the first partitions become final early. Thread safe
+         */
+        std::size_t firstToClose() { return next_closer++ % num_partitions; }
+
+        /** @brief Adds a run sorted elsewhere to a partition, e.g. one taken from a ChunkCache. Unlike a spill file, its
+         * file is never removed by the sorter. Thread safe
+         * @param partition Partition receiving the run
+         * @param run Run to add. Empty runs are dropped
+         */
+        void addRun(const std::size_t partition, run_type&& run);
+
+        /** @brief Returns the runs produced so far for a partition */
+        std::vector<run_type>& getRuns(const std::size_t partition = 0) { return runs[partition]; }
+
+        /** @brief Picks up to num_ranges - 1 distinct ascending keys that cut the runs of a partition into ranges of
+         * roughly equal size. Keys are sampled every RUN_INDEX_INTERVAL records of every run, through the sparse index
+         * of a spilled run, so nothing is read from disk
+         */
+        std::vector<key> pickSplitters(const std::size_t partition, const std::size_t num_ranges) const;
+
+        /** @brief Merges every run of a partition into a single file sorted by key
+         * @param output_filename File to write the merged records to
+         * @param num_threads Number of threads merging disjoint key ranges in parallel
+         * @param partition Partition to merge. Set to 0 by default
+         * @param output_format Encoding of the output file. Set to Format::TEXT by default
+         */
+        void merge(
+            const std::string& output_filename,
+            const int num_threads,
+            const std::size_t partition = 0,
+            const Format output_format = Format::TEXT
+        );
+
+        /** @brief Drops every run and removes the spill files */
+        void clear();
+    };
+
+    /** @brief Per-worker front end of an ExternalSorter. Collects records per partition and turns them into runs
+     * whenever they outgrow the sorter's buffer budget. Not thread safe; every worker owns its own SortBuffer
+     */
+    template<typename key, typename value>
+    class SortBuffer {
+    public:
+
+        using record_type = std::pair<key, value>; // A single record
+
+    private:
+
+        ExternalSorter<key, value>& sorter; // Sorter receiving the runs
+        std::vector<std::vector<record_type>> partitions; // Records collected since the last spill, per partition
+        std::size_t bytes; // Approximate memory held by partitions
+        std::size_t reserved; // Bytes reserved from the sorter's memory budget
+
+        /** @brief Spills the collected records to disk and gives their memory back */
+        void spill();
+
+    public:
+
+        /** @brief Constructor for the SortBuffer
+         * @param _sorter Sorter receiving the runs
+         */
+        explicit SortBuffer(ExternalSorter<key, value>& _sorter):
+            sorter(_sorter),
+            partitions(_sorter.partitionCount()),
+            bytes(0),
+            reserved(0) {}
+
+        /** @brief Adds a record, spilling the collected records to disk once they outgrow the budget, or the sorter's
+         * memory budget runs short
+         * @param partition Partition the record belongs to
+         * @param record Record to add
+         */
+        void push(const std::size_t partition, record_type&& record);
+
+        /** @brief Hands the remaining records to the sorter as in-memory runs and closes every partition */
+        void close();
+    };
+
+    // ----- Definitions ------
+
+    template<typename key, typename value>
+    ExternalSorter<key, value>::ExternalSorter(
+        const std::string& _spill_prefix,
+        const std::size_t _buffer_budget,
+        const std::size_t _num_partitions,
+        const Format _spill_format,
+        const IoBackend _io_backend
+    ):  spill_prefix(_spill_prefix),
+        buffer_budget(_buffer_budget),
+        num_partitions(_num_partitions > 0 ? _num_partitions : 1),
+        spill_format(_spill_format),
+        io_backend(_io_backend),
+        runs(num_partitions),
+        num_spills(0),
+        spilled_bytes(0),
+        closed_writers(num_partitions, 0),
+        num_writers(0),
+        next_closer(0),
+        held_bytes(0) {}
+
+    template<typename key, typename value>
+    ExternalSorter<key, value>::~ExternalSorter() {
+        clear();
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::addRuns(std::vector<std::vector<record_type>>& partitions, const bool spill) {
+        // Sort outside of the lock. Only the keys take part in the ordering
+        for(auto &records: partitions)
+            std::sort(records.begin(), records.end(), [](const record_type& a, const record_type& b) { return a.first < b.first; });
+
+        // Spilled partitions are written one after the other into a single file
+        std::vector<std::pair<std::size_t, run_type>> new_runs;
+        std::string spill_filename;
+        if (spill) {
+            spill_filename = spill_prefix + ".run" + std::to_string(num_spills++);
+            // Filled blocks are written in the background while the next runs are serialized
+            std::optional<FileWriteBuffer> spill_buffer;
+            try {
+                spill_buffer.emplace(spill_filename, io_backend);
+            } catch (const std::runtime_error&) {
+                throw std::runtime_error("Cannot open spill file: " + spill_filename);
+            }
+            std::ostream output(&*spill_buffer);
+            RecordWriter<key, value> writer(output, spill_format);
+            for(std::size_t partition = 0; partition < partitions.size(); partition++)
+                if (!partitions[partition].empty())
+                    new_runs.emplace_back(partition, spillRun(partitions[partition], writer, spill_filename, spill_format));
+            writer.flush();
+            if (!output)
+                throw std::runtime_error("Cannot write spill file: " + spill_filename);
+            spill_buffer->close();
+            spilled_bytes += static_cast<std::size_t>(writer.offset());
+        } else {
+            for(std::size_t partition = 0; partition < partitions.size(); partition++) {
+                if (partitions[partition].empty())
+                    continue;
+                run_type run;
+                run.size = partitions[partition].size();
+                run.records = std::move(partitions[partition]);
+                partitions[partition].clear();
+                new_runs.emplace_back(partition, std::move(run));
+            }
+        }
+
+        std::scoped_lock runs_lock{runs_mutex};
+        if (spill)
+            spill_files.push_back(spill_filename);
+        for(auto &[partition, run]: new_runs)
+            runs[partition].push_back(std::move(run));
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::expectWriters(const std::size_t _num_writers) {
+        num_writers = _num_writers;
+        std::fill(closed_writers.begin(), closed_writers.end(), 0);
+
+        // Without writers every partition is final right away
+        if (num_writers == 0 && on_final)
+            for(std::size_t partition = 0; partition < num_partitions; partition++)
+                on_final(partition);
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::closePartition(const std::size_t partition, std::vector<record_type>& records) {
+        std::sort(records.begin(), records.end(), [](const record_type& a, const record_type& b) { return a.first < b.first; });
+        run_type run;
+        run.size = records.size();
+        run.records = std::move(records);
+        records.clear();
+
+        bool is_final;
+        {
+            std::scoped_lock runs_lock{runs_mutex};
+            if (run.size > 0)
+                runs[partition].push_back(std::move(run));
+            is_final = ++closed_writers[partition] == num_writers;
+        }
+        if (is_final && on_final)
+            on_final(partition);
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::holdReserved(const std::size_t bytes) {
+        std::scoped_lock runs_lock{runs_mutex};
+        held_bytes += bytes;
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::addRun(const std::size_t partition, run_type&& run) {
+        std::scoped_lock runs_lock{runs_mutex};
+        if (run.size > 0)
+            runs[partition].push_back(std::move(run));
+    }
+
+    template<typename key, typename value>
+    std::vector<key> ExternalSorter<key, value>::pickSplitters(const std::size_t partition, const std::size_t num_ranges) const {
+        // Sample keys evenly from every run. Spilled runs are sampled through their sparse index
+        std::vector<key> samples;
+        for(auto &run: runs[partition]) {
+            if (run.onDisk())
+                for(auto &entry: run.index)
+                    samples.push_back(entry.first);
+            else
+                for(std::size_t i = 0; i < run.records.size(); i += RUN_INDEX_INTERVAL)
+                    samples.push_back(run.records[i].first);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        // Take evenly spaced samples as splitters, dropping duplicates so that no range is empty by construction
+        std::vector<key> splitters;
+        for(std::size_t i = 1; i < num_ranges && !samples.empty(); i++) {
+            const key& splitter = samples[samples.size() * i / num_ranges];
+            if ((splitters.empty() || splitters.back() < splitter) && samples.front() < splitter)
+                splitters.push_back(splitter);
+        }
+        return splitters;
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::merge(
+        const std::string& output_filename,
+        const int num_threads,
+        const std::size_t partition,
+        const Format output_format
+    ) {
+        // Every thread merges a disjoint key range into its own segment
+        auto splitters = pickSplitters(partition, num_threads > 0 ? num_threads : 1);
+        const std::size_t num_ranges = splitters.size() + 1;
+        auto mergeRange = [&](std::size_t range, const std::string& filename) {
+            std::optional<FileWriteBuffer> merge_buffer;
+            try {
+                merge_buffer.emplace(filename, io_backend);
+            } catch (const std::runtime_error&) {
+                throw std::runtime_error("Cannot open merge output file: " + filename);
+            }
+            std::ostream output(&*merge_buffer);
+            RecordWriter<key, value> writer(output, output_format);
+            std::optional<key> lower, upper;
+            if (range > 0)
+                lower = splitters[range - 1];
+            if (range < splitters.size())
+                upper = splitters[range];
+            mergeRuns(runs[partition], lower, upper, [&](const record_type& record) { writer.write(record); });
+            writer.flush();
+            if (!output)
+                throw std::runtime_error("Cannot write merge output file: " + filename);
+            merge_buffer->close();
+        };
+
+        if (num_ranges == 1) {
+            mergeRange(0, output_filename);
+            return;
+        }
+
+        std::vector<std::thread> merge_threads;
+        for(std::size_t range = 0; range < num_ranges; range++)
+            merge_threads.emplace_back(mergeRange, range, spill_prefix + ".segment" + std::to_string(partition) + "_" + std::to_string(range));
+        for(auto &merge_thread: merge_threads)
+            merge_thread.join();
+
+        // Concatenate the segments in key order
+        std::ofstream output(output_filename, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open merge output file: " + output_filename);
+        for(std::size_t range = 0; range < num_ranges; range++) {
+            std::string segment_filename = spill_prefix + ".segment" + std::to_string(partition) + "_" + std::to_string(range);
+            {
+                std::ifstream segment(segment_filename, std::ios::in | std::ios::binary);
+                if (segment.peek() != std::ifstream::traits_type::eof())
+                    output << segment.rdbuf();
+            }
+            std::remove(segment_filename.c_str());
+        }
+        if (!output)
+            throw std::runtime_error("Cannot write merge output file: " + output_filename);
+    }
+
+    template<typename key, typename value>
+    void ExternalSorter<key, value>::clear() {
+        std::scoped_lock runs_lock{runs_mutex};
+        for(auto &spill_filename: spill_files)
+            std::remove(spill_filename.c_str());
+        spill_files.clear();
+        for(auto &partition_runs: runs)
+            partition_runs.clear();
+        if (memory_budget)
+            memory_budget->release(held_bytes);
+        held_bytes = 0;
+    }
+
+    template<typename key, typename value>
+    void SortBuffer<key, value>::push(const std::size_t partition, record_type&& record) {
+        const std::size_t footprint = memoryFootprint(record);
+        bytes += footprint;
+        partitions[partition].push_back(std::move(record));
+        if (bytes >= sorter.bufferBudget()) {
+            spill();
+            return;
+        }
+
+        // Memory is reserved from the job budget in steps, so the budget is not locked for every record. Steps are small
+        // against the buffer budget, so a buffer only spills early while other parts of the job hold memory
+        if (MemoryBudget* budget = sorter.memoryBudget(); budget && bytes > reserved) {
+            const std::size_t step = std::max(bytes - reserved, std::min(MEMORY_RESERVE_STEP, sorter.bufferBudget() / 4));
+            if (!budget->tryAcquire(step))
+                spill();
+            else
+                reserved += step;
+        }
+    }
+
+    template<typename key, typename value>
+    void SortBuffer<key, value>::spill() {
+        sorter.addRuns(partitions, true);
+        bytes = 0;
+        if (sorter.memoryBudget())
+            sorter.memoryBudget()->release(reserved);
+        reserved = 0;
+    }
+
+    template<typename key, typename value>
+    void SortBuffer<key, value>::close() {
+        // Close the partitions one at a time, so that each becomes final as soon as possible
+        const std::size_t first = sorter.firstToClose();
+        for(std::size_t i = 0; i < partitions.size(); i++)
+            sorter.closePartition((first + i) % partitions.size(), partitions[(first + i) % partitions.size()]);
+        sorter.holdReserved(reserved);
+        bytes = 0;
+        reserved = 0;
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <ctime>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+
+namespace reduse {
+
+    /** @brief Statistics of a single phase of a job. Counters that do not apply to a phase stay 0 */
+    struct PhaseStats {
+        double wall_seconds = 0; // Wall time of the phase
+        double cpu_seconds = 0; // CPU time of the whole process during the phase
+        std::size_t records_in = 0; // Map: input lines. Reduce: map output pairs
+        std::size_t bytes_in = 0; // Map: bytes of the input file. Reduce: bytes of the input file, if reading one
+        std::size_t records_out = 0; // Map: pairs handed to the shuffle, after the combiner. Reduce: results written
+        std::size_t bytes_out = 0; // Map: bytes spilled to disk. Reduce: bytes written to the output file
+        double producer_wait_seconds = 0; // Time the producer spent blocked on the hand-off buffer, or on Options::memory_budget
+        double consumer_wait_seconds = 0; // Time all workers together spent blocked on the hand-off buffer
+        std::size_t spill_files = 0; // Map: spill files written
+        std::size_t key_groups = 0; // Reduce: distinct key groups
+        std::size_t largest_group = 0; // Reduce: number of values of the largest key group
+        std::size_t hot_keys = 0; // Reduce: hot keys whose groups were spread over every partition
+        std::size_t steals = 0; // Map: input ranges taken over by an idle worker in the memory mapped input mode
+        std::size_t cached_chunks = 0; // Map: input chunks whose map output was taken from the cache of an incremental job
+        std::size_t peak_memory = 0; // Most bytes held under Options::memory_budget at once. 0 without a memory budget
+    };
+
+    /** @brief Statistics of a whole job, as returned by reduse::reduse */
+    struct JobStats {
+        PhaseStats map; // Map phase, including the shuffle
+        PhaseStats reduce; // Reduce phase, including the merge
+        double wall_seconds = 0; // Wall time of the whole job
+    };
+
+    /** @brief Prints the statistics of a phase on a single line */
+    inline std::ostream& operator<<(std::ostream& out, const PhaseStats& stats) {
+        return out << "wall " << stats.wall_seconds << "s, cpu " << stats.cpu_seconds << "s, "
+            << stats.records_in << " records (" << stats.bytes_in << " bytes) in, "
+            << stats.records_out << " records (" << stats.bytes_out << " bytes) out, "
+            << "waited " << stats.producer_wait_seconds << "s producing and " << stats.consumer_wait_seconds << "s consuming, "
+            << stats.spill_files << " spill files, " << stats.key_groups << " key groups (largest " << stats.largest_group << "), "
+            << stats.hot_keys << " hot keys, " << stats.steals << " steals, " << stats.cached_chunks << " cached chunks, " << stats.peak_memory << " bytes peak memory";
+    }
+
+    /** @brief Adds the counters of another run of the same phase. Times add up too, and the largest group and the peak
+     * memory are the larger ones
+     */
+    inline PhaseStats& operator+=(PhaseStats& stats, const PhaseStats& other) {
+        stats.wall_seconds += other.wall_seconds;
+        stats.cpu_seconds += other.cpu_seconds;
+        stats.records_in += other.records_in;
+        stats.bytes_in += other.bytes_in;
+        stats.records_out += other.records_out;
+        stats.bytes_out += other.bytes_out;
+        stats.producer_wait_seconds += other.producer_wait_seconds;
+        stats.consumer_wait_seconds += other.consumer_wait_seconds;
+        stats.spill_files += other.spill_files;
+        stats.key_groups += other.key_groups;
+        stats.largest_group = std::max(stats.largest_group, other.largest_group);
+        stats.hot_keys += other.hot_keys;
+        stats.steals += other.steals;
+        stats.cached_chunks += other.cached_chunks;
+        stats.peak_memory = std::max(stats.peak_memory, other.peak_memory);
+        return stats;
+    }
+
+    /** @brief Measures the wall and CPU time of a phase */
+    class PhaseTimer {
+    private:
+
+        const std::chrono::steady_clock::time_point wall_start; // Wall clock at construction
+        const std::clock_t cpu_start; // Process CPU clock at construction
+
+    public:
+
+        PhaseTimer(): wall_start(std::chrono::steady_clock::now()), cpu_start(std::clock()) {}
+
+        /** @brief Writes the time elapsed since construction into stats */
+        void stop(PhaseStats& stats) const {
+            stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+            stats.cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        }
+    };
+
+    /** @brief Collects a per-thread timeline of named spans and writes it in the Chrome trace event format,
+     * viewable in chrome://tracing or Perfetto. Thread safe
+     */
+    class TraceRecorder {
+    private:
+
+        /** @brief A finished span */
+        struct Event {
+            std::string name; // Span name
+            std::size_t thread; // Small id of the recording thread
+            std::int64_t start; // Start, in microseconds since the recorder was created
+            std::int64_t duration; // Duration, in microseconds
+        };
+
+        const std::chrono::steady_clock::time_point origin; // Time 0 of the trace
+        std::vector<Event> events; // Finished spans
+        std::map<std::thread::id, std::size_t> threads; // Small id of every recording thread
+        std::mutex events_mutex; // Mutex over events and threads
+
+    public:
+
+        TraceRecorder(): origin(std::chrono::steady_clock::now()) {}
+
+        /** @brief Returns the microseconds elapsed since the recorder was created */
+        std::int64_t now() const {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+        }
+
+        /** @brief Records a finished span of the calling thread
+         * @param name Span name
+         * @param start Start of the span, as returned by now()
+         */
+        void record(const std::string& name, const std::int64_t start);
+
+        /** @brief Writes every recorded span to a Chrome trace JSON file */
+        void write(const std::string& filename);
+    };
+
+    /** @brief Records the lifetime of a scope as a span of a TraceRecorder. Does nothing without a recorder */
+    class TraceSpan {
+    private:
+
+        TraceRecorder* const trace; // Recorder receiving the span. May be null
+        const char* const name; // Span name
+        const std::int64_t start; // Start of the span
+
+    public:
+
+        /** @brief Starts a span
+         * @param _trace Recorder receiving the span. May be null
+         * @param _name Span name. Must outlive the span
+         */
+        TraceSpan(TraceRecorder* _trace, const char* _name): trace(_trace), name(_name), start(_trace ? _trace->now() : 0) {}
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        ~TraceSpan() {
+            if (trace)
+                trace->record(name, start);
+        }
+    };
+
+    // ----- Definitions ------
+
+    inline void TraceRecorder::record(const std::string& name, const std::int64_t start) {
+        const std::int64_t end = now();
+        std::scoped_lock events_lock{events_mutex};
+        auto thread = threads.emplace(std::this_thread::get_id(), threads.size()).first->second;
+        events.push_back({name, thread, start, end - start});
+    }
+
+    inline void TraceRecorder::write(const std::string& filename) {
+        std::ofstream output(filename, std::ios::out | std::ios::trunc);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open trace file: " + filename);
+        std::scoped_lock events_lock{events_mutex};
+        output << "{\"traceEvents\":[";
+        for(std::size_t i = 0; i < events.size(); i++) {
+            auto &event = events[i];
+            output << (i > 0 ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+        }
+        output << "\n]}\n";
+        if (!output)
+            throw std::runtime_error("Cannot write trace file: " + filename);
+    }
+}
@@ -0,0 +1,630 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <reduse/options.hpp>
+#include <reduse/ring_buffer.hpp>
+#include <reduse/records.hpp>
+#include <reduse/emitter.hpp>
+#include <reduse/combiner.hpp>
+#include <reduse/values.hpp>
+#include <reduse/mapper.hpp>
+#include <reduse/reducer.hpp>
+#include <reduse/stats.hpp>
+
+namespace reduse {
+
+    const std::size_t STREAM_READ_SIZE = 1 << 16; // Bytes read from a streamed input at once
+    const int STREAM_POLL_MILLISECONDS = 10; // Longest time the reader waits for input before it checks the clock and stop()
+    const std::size_t STREAM_SHARDS = 16; // Independently locked shards of the key state of a pane
+
+    /** @brief What the size and slide of a Window count */
+    enum class WindowUnit {
+        RECORDS, // Input records, in the order they were read
+        MILLISECONDS // Wall time since the stream started, by the time a record was read
+    };
+
+    /** @brief Windows a StreamJob reduces over. Windows are cut into panes of slide units each, and a window covers the
+     * size / slide panes up to and including the one it ends with
+     */
+    struct Window {
+        WindowUnit unit = WindowUnit::RECORDS; // What size and slide count
+        std::size_t size = 0; // Length of every window. Must be non-zero
+        std::size_t slide = 0; // Distance between the ends of consecutive windows. Tumbling windows if 0 or equal to size. Must divide size
+    };
+
+    /** @brief Long-running job over an unbounded input: stdin, a pipe or a file that keeps growing. Every record is
+     * mapped as soon as it is read and its pairs are kept, per key, in the pane it fell into. Once a pane closes and
+     * all of its records are mapped, REDUCE runs over every key of the window ending with it, and the results are
+     * written as "end key result" lines and flushed right away. end is the window's exclusive end, in records or
+     * milliseconds since the start. With Options::associative_reduce the values of a key are folded by REDUCE as they
+     * arrive, so a pane holds a single partial result per key
+     * @param map_key Data type of the key emitted by the MAP method
+     * @param map_value Data type of the value emitted by the MAP method
+     * @param reduce_value Data type of the value produced by the REDUCE method
+     */
+    template<typename map_key, typename map_value, typename reduce_value>
+    class StreamJob {
+    private:
+
+        using value_table = std::conditional_t<
+            is_hashable_v<map_key>,
+            std::unordered_map<map_key, std::vector<map_value>>,
+            std::map<map_key, std::vector<map_value>>
+        >;
+
+        /** @brief Independently locked part of the key state of a pane */
+        struct Shard {
+            value_table values; // Values, or partial results, of every key of the shard
+            std::mutex shard_mutex; // Mutex over values
+        };
+
+        /** @brief Key state of the records read during one slide */
+        struct Pane {
+            std::size_t dispatched = 0; // Records handed to the mappers
+            std::size_t mapped = 0; // Records mapped so far
+            bool closed = false; // No more records will be handed to the mappers
+            std::vector<std::unique_ptr<Shard>> shards; // Key state, sharded by key
+        };
+
+        /** @brief A record on its way to the mappers */
+        struct Record {
+            std::size_t pane; // Pane the record fell into
+            std::string text; // Contents of the record
+        };
+
+        /** @brief Emitter collecting the pairs of a batch, so they reach the shared panes a key at a time */
+        class BatchEmitter final: public Emitter<map_key, map_value> {
+        private:
+
+            StreamJob& job; // Job owning the mapper
+            value_table& table; // Values of every key of the batch
+
+        protected:
+
+            void push(std::pair<map_key, map_value>&& new_pair) override {
+                auto &values = table[new_pair.first];
+                values.push_back(std::move(new_pair.second));
+                job.fold(new_pair.first, values);
+            }
+
+        public:
+
+            /** @brief Constructor for the BatchEmitter
+             * @param _job Job owning the mapper
+             * @param _table Values of every key of the batch
+             */
+            BatchEmitter(StreamJob& _job, value_table& _table): job(_job), table(_table) {}
+        };
+
+        const std::string input_filename; // Input to stream. "-" for stdin
+        const std::string output_filename; // File receiving the results of every window
+        const std::function<void(std::string_view, Emitter<map_key, map_value>&)> MAP; // Mapper function, in its emitting form
+        const std::function<reduce_value(const map_key&, std::vector<map_value>&)> REDUCE; // Reducer function, taking the values of a key
+        std::function<map_value(const map_key&, std::vector<map_value>&)> COMBINE; // REDUCE as a combiner, with Options::associative_reduce. Unset otherwise
+        const WindowUnit unit; // What size and slide count
+        const std::size_t slide; // Length of a pane
+        const std::size_t panes_per_window; // Number of panes a window covers
+        const bool follow; // Keeps waiting for more input at the end of the file
+        const int num_mappers; // Number of mapper workers
+        const bool verbose; // Verbose output to console
+        const Options options; // Tuning options
+
+        RingBuffer<Record> buff; // Buffer of record batches
+        std::map<std::size_t, Pane> panes; // Panes still needed by a window. Guarded by pane_mutex
+        std::size_t next_window; // Pane the next window to be written ends with. Guarded by pane_mutex
+        bool finished; // Every record has been mapped. Guarded by pane_mutex
+        std::mutex pane_mutex; // Mutex over the panes' bookkeeping
+        std::condition_variable pane_done; // Signals that a pane was closed or had records mapped
+        std::atomic<bool> stopping; // Set by stop(), and once the run failed
+        std::exception_ptr failure; // First exception thrown by the producer, a mapper or the writer. Guarded by pane_mutex
+        PhaseStats stats; // Statistics of the current run
+        std::mutex stats_mutex; // Mutex over stats
+
+        /** @brief Reads the input, cuts it into records and hands them to the mappers in batches of a single pane */
+        void producer();
+
+        /** @brief Mapper worker routine. Maps a batch and folds its pairs into the pane of the batch */
+        void consumer();
+
+        /** @brief Writes every window as soon as the pane it ends with is complete */
+        void writer(std::ofstream& output);
+
+        /** @brief Keeps the first error of the run for run() to rethrow, and winds the run down: stops the producer,
+         * closes the buffer and lets the writer return
+         */
+        void fail(std::exception_ptr error);
+
+        /** @brief Folds the values of a key into its partial result, if REDUCE is associative and enough values piled up */
+        void fold(const map_key& item, std::vector<map_value>& values) {
+            if (COMBINE && values.size() >= COMBINE_BATCH_SIZE) {
+                map_value combined = COMBINE(item, values);
+                values.clear();
+                values.push_back(std::move(combined));
+            }
+        }
+
+        /** @brief Returns MAP in its emitting form. MAP is called directly, so it can be inlined */
+        template<typename MapFn>
+        static std::function<void(std::string_view, Emitter<map_key, map_value>&)> emittingMap(MapFn&& _MAP);
+
+        /** @brief Returns REDUCE in the form taking every value of a key. REDUCE is called directly, so it can be inlined */
+        template<typename ReduceFn>
+        static std::function<reduce_value(const map_key&, std::vector<map_value>&)> vectorReduce(ReduceFn&& _REDUCE);
+
+        /** @brief Delegated constructor storing MAP and REDUCE in their general forms. Takes the window ahead of them, so it is never mistaken for the public constructor */
+        StreamJob(
+            const std::string& _input_filename,
+            const std::string& _output_filename,
+            const Window& _window,
+            const std::function<void(std::string_view, Emitter<map_key, map_value>&)>& _MAP,
+            const std::function<reduce_value(const map_key&, std::vector<map_value>&)>& _REDUCE,
+            const bool _follow,
+            const int _num_mappers,
+            const bool _verbose,
+            const Options& _options
+        );
+
+    public:
+
+        /** @brief Constructor for the StreamJob
+         * @param _input_filename Input to stream: a file, a named pipe, or "-" for stdin
+         * @param _output_filename File receiving an "end key result" line per key of every window
+         * @param _MAP The mapper function, in any form a Mapper takes. See reduse::Mapper
+         * @param _REDUCE The reducer function, in any form a Reducer takes. See reduse::Reducer
+         * @param _window Windows to reduce over. See reduse::Window
+         * @param _follow Set true to keep reading a file as it grows, like tail -f. The job then only ends on stop()
+         * @param _num_mappers Number of mappers to run concurrently
+         * @param _verbose Set true if you want the a verbose output. Useful for debugging
+         * @param _options Tuning options. See reduse::Options
+         */
+        template<
+            typename MapFn,
+            typename ReduceFn,
+            typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+        >
+        StreamJob(
+            const std::string& _input_filename,
+            const std::string& _output_filename,
+            MapFn&& _MAP,
+            ReduceFn&& _REDUCE,
+            const Window& _window,
+            const bool _follow = false,
+            const int _num_mappers = DEFAULT_NUM_MAPPERS,
+            const bool _verbose = false,
+            const Options& _options = Options()
+        );
+
+        /** @brief Runs the job until the input ends, or until stop() once following a file. Writes the windows ending
+         * with the last pane, partial or not, before returning. Returns the statistics of the run. An exception thrown
+         * while reading, by MAP or REDUCE, or while writing stops the run and is rethrown
+         */
+        PhaseStats run();
+
+        /** @brief Makes run() return after the windows of the records read so far are written. Thread safe */
+        void stop() { stopping = true; }
+    };
+
+    /** @brief Runs a StreamJob till its input ends. See reduse::StreamJob */
+    template<
+        typename map_key,
+        typename map_value,
+        typename reduce_value,
+        typename MapFn,
+        typename ReduceFn,
+        typename = std::enable_if_t<is_map_v<MapFn, map_key, map_value> && is_reduce_v<ReduceFn, map_key, map_value, reduce_value>>
+    >
+    PhaseStats stream(
+        const std::string& input_filename,
+        const std::string& output_filename,
+        MapFn&& MAP,
+        ReduceFn&& REDUCE,
+        const Window& window,
+        const int num_mappers = DEFAULT_NUM_MAPPERS,
+        const bool verbose = false,
+        const Options& options = Options()
+    ) {
+        StreamJob<map_key, map_value, reduce_value> job(
+            input_filename, output_filename, std::forward<MapFn>(MAP), std::forward<ReduceFn>(REDUCE), window, false,
+            num_mappers, verbose, options
+        );
+        return job.run();
+    }
+
+    // ----- Definitions ------
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename MapFn, typename ReduceFn, typename>
+    StreamJob<map_key, map_value, reduce_value>::StreamJob(
+        const std::string& _input_filename,
+        const std::string& _output_filename,
+        MapFn&& _MAP,
+        ReduceFn&& _REDUCE,
+        const Window& _window,
+        const bool _follow,
+        const int _num_mappers,
+        const bool _verbose,
+        const Options& _options
+    ):  StreamJob(
+            _input_filename,
+            _output_filename,
+            _window,
+            emittingMap(std::forward<MapFn>(_MAP)),
+            vectorReduce(std::forward<ReduceFn>(_REDUCE)),
+            _follow,
+            _num_mappers,
+            _verbose,
+            _options
+        ) {}
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename MapFn>
+    std::function<void(std::string_view, Emitter<map_key, map_value>&)> StreamJob<map_key, map_value, reduce_value>::emittingMap(MapFn&& _MAP) {
+        return [MAP = std::decay_t<MapFn>(std::forward<MapFn>(_MAP))](std::string_view record, Emitter<map_key, map_value>& output) mutable {
+            if constexpr (is_emit_map_v<std::decay_t<MapFn>, map_key, map_value>) {
+                MAP(record, output);
+            } else if constexpr (std::is_invocable_r_v<std::pair<map_key, map_value>, std::decay_t<MapFn>&, std::string_view>) {
+                output.emplace(MAP(record));
+            } else {
+                thread_local std::string scratch;
+                scratch.assign(record);
+                output.emplace(MAP(scratch));
+            }
+        };
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    template<typename ReduceFn>
+    std::function<reduce_value(const map_key&, std::vector<map_value>&)> StreamJob<map_key, map_value, reduce_value>::vectorReduce(ReduceFn&& _REDUCE) {
+        return [REDUCE = std::decay_t<ReduceFn>(std::forward<ReduceFn>(_REDUCE))](const map_key& item, std::vector<map_value>& values) mutable -> reduce_value {
+            if constexpr (std::is_invocable_r_v<reduce_value, std::decay_t<ReduceFn>&, map_key, std::vector<map_value>&>) {
+                return REDUCE(item, values);
+            } else {
+                VectorValueStream<map_value> stream_values(values);
+                return REDUCE(item, stream_values);
+            }
+        };
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    StreamJob<map_key, map_value, reduce_value>::StreamJob(
+        const std::string& _input_filename,
+        const std::string& _output_filename,
+        const Window& _window,
+        const std::function<void(std::string_view, Emitter<map_key, map_value>&)>& _MAP,
+        const std::function<reduce_value(const map_key&, std::vector<map_value>&)>& _REDUCE,
+        const bool _follow,
+        const int _num_mappers,
+        const bool _verbose,
+        const Options& _options
+    ):  input_filename(_input_filename),
+        output_filename(_output_filename),
+        MAP(_MAP),
+        REDUCE(_REDUCE),
+        unit(_window.unit),
+        slide(_window.slide > 0 ? _window.slide : _window.size),
+        panes_per_window(slide > 0 ? _window.size / slide : 0),
+        follow(_follow),
+        num_mappers(_num_mappers > 0 ? _num_mappers : 1),
+        verbose(_verbose),
+        options(_options),
+        buff(_options.buffer_depth),
+        next_window(0),
+        finished(false),
+        stopping(false) {
+        if (_window.size == 0 || _window.size % slide != 0)
+            throw std::invalid_argument("A Window needs a non-zero size that is a multiple of its slide");
+        if (options.associative_reduce) {
+            if constexpr (std::is_same_v<reduce_value, map_value>)
+                COMBINE = REDUCE;
+            else
+                throw std::invalid_argument("Options::associative_reduce requires reduce_value to be the same type as map_value");
+        }
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    PhaseStats StreamJob<map_key, map_value, reduce_value>::run() {
+        if (verbose) std::cout << "Starting stream..." << std::endl;
+
+        // Initialize variables
+        PhaseTimer timer;
+        stats = PhaseStats();
+        buff.reset();
+        panes.clear();
+        next_window = 0;
+        finished = false;
+        stopping = false;
+        failure = nullptr;
+        std::ofstream output(output_filename, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open reduse output file: " + output_filename);
+
+        // The mappers and the writer run on threads of their own, and the calling thread reads. An error on any of
+        // them stops the others and is rethrown once they are all joined
+        std::vector<std::thread> mp_threads;
+        for(auto i = 0; i < num_mappers; i++)
+            mp_threads.emplace_back([this]() {
+                try {
+                    consumer();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            });
+        std::thread writer_thread([this, &output]() {
+            try {
+                writer(output);
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        });
+        if (verbose) std::cout << "Streaming from " << input_filename << "..." << std::endl;
+        try {
+            producer();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+
+        // Wait for the last records to be mapped and their windows written
+        for(auto &consumer_thread: mp_threads)
+            consumer_thread.join();
+        {
+            std::scoped_lock pane_lock{pane_mutex};
+            finished = true;
+        }
+        pane_done.notify_all();
+        writer_thread.join();
+        if (failure)
+            std::rethrow_exception(failure);
+        stats.producer_wait_seconds = buff.producerWaitSeconds();
+        stats.consumer_wait_seconds = buff.consumerWaitSeconds();
+
+        timer.stop(stats);
+        if (verbose) std::cout << "Stream ended: " << stats << std::endl;
+        return stats;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void StreamJob<map_key, map_value, reduce_value>::fail(std::exception_ptr error) {
+        {
+            std::scoped_lock pane_lock{pane_mutex};
+            if (!failure)
+                failure = error;
+            finished = true;
+        }
+        stopping = true;
+        buff.close();
+        pane_done.notify_all();
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void StreamJob<map_key, map_value, reduce_value>::producer() {
+        const int input_fd = input_filename == "-" ? STDIN_FILENO : ::open(input_filename.c_str(), O_RDONLY);
+        if (input_fd < 0)
+            throw std::runtime_error("Unable to open stream input: " + input_filename);
+        struct InputCloser {
+            int fd; // Descriptor to close. Never stdin
+            ~InputCloser() { if (fd != STDIN_FILENO) ::close(fd); }
+        } closer{input_fd};
+
+        // Panes open one after the other. A batch never spans two panes, so it is handed off whenever its pane closes
+        const auto start = std::chrono::steady_clock::now();
+        const std::size_t batch_size = options.batch_size > 0 ? options.batch_size : 1;
+        std::vector<Record> batch;
+        std::size_t batch_count = 0;
+        std::size_t open_pane = 0;
+        std::size_t records = 0;
+        auto openPane = [&](const std::size_t pane) {
+            std::scoped_lock pane_lock{pane_mutex};
+            auto &shards = panes[pane].shards;
+            for(std::size_t i = 0; i < STREAM_SHARDS; i++)
+                shards.push_back(std::make_unique<Shard>());
+        };
+        auto handOff = [&]() {
+            if (batch_count == 0)
+                return;
+            {
+                std::scoped_lock pane_lock{pane_mutex};
+                panes[open_pane].dispatched += batch_count;
+            }
+            batch.resize(batch_count);
+            if (!buff.put(batch)) {
+                // A closed buffer maps nothing more, so the records never count against their pane and reading stops
+                std::scoped_lock pane_lock{pane_mutex};
+                panes[open_pane].dispatched -= batch_count;
+                stopping = true;
+            }
+            batch_count = 0;
+        };
+        auto closePane = [&]() {
+            handOff();
+            {
+                std::scoped_lock pane_lock{pane_mutex};
+                panes[open_pane].closed = true;
+            }
+            pane_done.notify_all();
+        };
+        auto advanceTo = [&](const std::size_t pane) {
+            while(open_pane < pane) {
+                closePane();
+                openPane(++open_pane);
+            }
+        };
+        auto putRecord = [&](std::string_view record) {
+            if (unit == WindowUnit::RECORDS)
+                advanceTo(records / slide);
+            if (batch_count == batch.size())
+                batch.emplace_back();
+            batch[batch_count].pane = open_pane;
+            batch[batch_count].text.assign(record);
+            records++;
+            if (++batch_count == batch_size)
+                handOff();
+        };
+        openPane(0);
+
+        // Reads whatever is available, and wakes up regularly to close time panes and notice stop()
+        RecordScanner scanner(options);
+        std::vector<char> block(STREAM_READ_SIZE);
+        std::size_t filled = 0;
+        std::size_t bytes_read = 0;
+        while(!stopping) {
+            if (unit == WindowUnit::MILLISECONDS) {
+                const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                advanceTo(static_cast<std::size_t>(elapsed.count()) / slide);
+            }
+            pollfd ready{input_fd, POLLIN, 0};
+            if (::poll(&ready, 1, STREAM_POLL_MILLISECONDS) == 0)
+                continue;
+            const ssize_t count = ::read(input_fd, block.data() + filled, block.size() - filled);
+            if (count < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if (count < 0)
+                throw std::runtime_error("Cannot read stream input: " + input_filename + ": " + std::strerror(errno));
+            if (count == 0) {
+                // The end of a followed file is only the end of what has been written so far
+                if (!follow)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(STREAM_POLL_MILLISECONDS));
+                continue;
+            }
+            bytes_read += static_cast<std::size_t>(count);
+            filled += static_cast<std::size_t>(count);
+
+            // Complete records are handed off right away, so a slow input never holds back a partial batch
+            const char* rest = scanner.scan(std::string_view(block.data(), filled), false, putRecord);
+            handOff();
+            const std::size_t carried = static_cast<std::size_t>(block.data() + filled - rest);
+            std::memmove(block.data(), rest, carried);
+            filled = carried;
+            if (filled == block.size())
+                block.resize(block.size() * 2);
+        }
+
+        // The last record may lack its delimiter. The open pane closes with it
+        scanner.scan(std::string_view(block.data(), filled), true, putRecord);
+        closePane();
+        buff.close();
+
+        std::scoped_lock stats_lock{stats_mutex};
+        stats.records_in += records;
+        stats.bytes_in += bytes_read;
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void StreamJob<map_key, map_value, reduce_value>::consumer() {
+        std::vector<Record> batch;
+        value_table table;
+        BatchEmitter emitter(*this, table);
+        HashPartitioner<map_key> partitioner;
+        while(buff.get(batch)) {
+            if (batch.empty())
+                continue;
+            for(auto &record: batch)
+                MAP(record.text, emitter);
+
+            // The pane is not complete before this batch is counted as mapped, so it cannot go away meanwhile
+            Pane* pane;
+            {
+                std::scoped_lock pane_lock{pane_mutex};
+                pane = &panes[batch.front().pane];
+            }
+            for(auto &[item, values]: table) {
+                Shard& shard = *pane->shards[partitioner(item, STREAM_SHARDS)];
+                std::scoped_lock shard_lock{shard.shard_mutex};
+                auto &pane_values = shard.values[item];
+                for(auto &it: values)
+                    pane_values.push_back(std::move(it));
+                fold(item, pane_values);
+            }
+            table.clear();
+            {
+                std::scoped_lock pane_lock{pane_mutex};
+                pane->mapped += batch.size();
+            }
+            pane_done.notify_all();
+        }
+    }
+
+    template<typename map_key, typename map_value, typename reduce_value>
+    void StreamJob<map_key, map_value, reduce_value>::writer(std::ofstream& output) {
+        std::unique_lock pane_lock{pane_mutex};
+        while(true) {
+            // Wait for the pane the next window ends with to be complete. Once the job is finished, a pane that is
+            // missing or never completes means there is no window left to write, as the input ended or the job failed
+            auto complete = [&]() {
+                auto pane = panes.find(next_window);
+                return pane != panes.end() && pane->second.closed && pane->second.mapped == pane->second.dispatched;
+            };
+            pane_done.wait(pane_lock, [&]() { return complete() || finished; });
+            if (!complete())
+                break;
+
+            // Panes of a complete window no longer change, so they are read without holding the lock
+            const std::size_t first = next_window + 1 >= panes_per_window ? next_window + 1 - panes_per_window : 0;
+            std::vector<Pane*> window;
+            for(std::size_t i = first; i <= next_window; i++)
+                window.push_back(&panes[i]);
+            pane_lock.unlock();
+
+            // Gather the values of every key over the panes of the window. Panes only covered by this window give theirs up
+            value_table merged;
+            for(auto pane: window)
+                for(auto &shard: pane->shards)
+                    for(auto &[item, values]: shard->values) {
+                        auto &merged_values = merged[item];
+                        if (panes_per_window == 1)
+                            merged_values.insert(merged_values.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+                        else
+                            merged_values.insert(merged_values.end(), values.begin(), values.end());
+                    }
+            std::ostringstream chunk;
+            std::size_t largest_group = 0;
+            for(auto &[item, values]: merged) {
+                largest_group = std::max(largest_group, values.size());
+                chunk << (next_window + 1) * slide << ' ' << item << ' ' << REDUCE(item, values) << '\n';
+            }
+            const std::string text = chunk.str();
+            output.write(text.data(), static_cast<std::streamsize>(text.size()));
+            output.flush();
+            if (!output)
+                throw std::runtime_error("Cannot write reduse output file: " + output_filename);
+            {
+                std::scoped_lock stats_lock{stats_mutex};
+                stats.records_out += merged.size();
+                stats.bytes_out += text.size();
+                stats.key_groups += merged.size();
+                stats.largest_group = std::max(stats.largest_group, largest_group);
+            }
+
+            // Drop the first pane once no later window covers it
+            pane_lock.lock();
+            if (next_window + 2 > panes_per_window)
+                panes.erase(first);
+            next_window++;
+        }
+    }
+}
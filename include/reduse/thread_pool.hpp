@@ -0,0 +1,155 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <utility>
+#include <cstddef>
+
+namespace reduse {
+
+    class TaskGroup;
+
+    /** @brief Fixed set of long-lived worker threads running the tasks of any number of TaskGroups.
+     * Groups with pending tasks are served round-robin, one task at a time, so concurrent jobs sharing a pool each
+     * get a fair share of the workers no matter how many tasks they queue
+     */
+    class ThreadPool {
+    private:
+
+        friend class TaskGroup;
+
+        std::vector<std::thread> threads; // Worker threads
+        std::deque<TaskGroup*> ready; // Groups with pending tasks, in the order they are served
+        bool stopping; // Indicates that the workers must exit once every queued task is done
+        std::mutex pool_mutex; // Mutex over ready, stopping and the task queues of every group
+        std::condition_variable pool_ready; // Signals that a group has a pending task, or that the pool is stopping
+
+        /** @brief Worker thread routine */
+        void worker();
+
+    public:
+
+        /** @brief Constructor for the ThreadPool. Starts the workers
+         * @param num_threads Number of worker threads. At least one is started
+         */
+        explicit ThreadPool(const int num_threads);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /** @brief Destructor. Runs the queued tasks and joins the workers */
+        ~ThreadPool();
+
+        /** @brief Returns the number of worker threads */
+        int size() const { return static_cast<int>(threads.size()); }
+    };
+
+    /** @brief A batch of tasks submitted to a ThreadPool and waited for together. Tasks may be submitted from any
+     * thread, including the tasks of the pool, but only one thread may wait for them
+     */
+    class TaskGroup {
+    private:
+
+        friend class ThreadPool;
+
+        ThreadPool& pool; // Pool running the tasks
+        std::deque<std::function<void()>> tasks; // Tasks not started yet
+        std::size_t pending; // Number of tasks not finished yet
+        std::exception_ptr error; // First exception thrown by a task
+        std::condition_variable group_done; // Signals that every task has finished
+
+    public:
+
+        /** @brief Constructor for the TaskGroup
+         * @param _pool Pool running the tasks. Must outlive the group
+         */
+        explicit TaskGroup(ThreadPool& _pool): pool(_pool), pending(0) {}
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        /** @brief Destructor. Waits for the submitted tasks, discarding their exceptions */
+        ~TaskGroup();
+
+        /** @brief Queues a task on the pool. Thread safe */
+        void submit(std::function<void()> task);
+
+        /** @brief Blocks until every submitted task has finished, then rethrows the first exception thrown by one */
+        void wait();
+    };
+
+    // ----- Definitions ------
+
+    inline ThreadPool::ThreadPool(const int num_threads): stopping(false) {
+        for(auto i = 0; i < (num_threads > 0 ? num_threads : 1); i++)
+            threads.emplace_back(&ThreadPool::worker, this);
+    }
+
+    inline ThreadPool::~ThreadPool() {
+        {
+            std::scoped_lock pool_lock{pool_mutex};
+            stopping = true;
+        }
+        pool_ready.notify_all();
+        for(auto &pool_thread: threads)
+            pool_thread.join();
+    }
+
+    inline void ThreadPool::worker() {
+        std::unique_lock pool_lock{pool_mutex};
+        while(true) {
+            pool_ready.wait(pool_lock, [&]() { return stopping || !ready.empty(); });
+            if (ready.empty())
+                return;
+
+            // Take one task of the group at the front, then let the other groups have their turn
+            TaskGroup* group = ready.front();
+            ready.pop_front();
+            auto task = std::move(group->tasks.front());
+            group->tasks.pop_front();
+            if (!group->tasks.empty())
+                ready.push_back(group);
+
+            pool_lock.unlock();
+            std::exception_ptr error;
+            try {
+                task();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            pool_lock.lock();
+
+            if (error && !group->error)
+                group->error = error;
+            if (--group->pending == 0)
+                group->group_done.notify_all();
+        }
+    }
+
+    inline TaskGroup::~TaskGroup() {
+        std::unique_lock pool_lock{pool.pool_mutex};
+        group_done.wait(pool_lock, [&]() { return pending == 0; });
+    }
+
+    inline void TaskGroup::submit(std::function<void()> task) {
+        {
+            std::scoped_lock pool_lock{pool.pool_mutex};
+            if (tasks.empty())
+                pool.ready.push_back(this);
+            tasks.push_back(std::move(task));
+            pending++;
+        }
+        pool.pool_ready.notify_one();
+    }
+
+    inline void TaskGroup::wait() {
+        std::unique_lock pool_lock{pool.pool_mutex};
+        group_done.wait(pool_lock, [&]() { return pending == 0; });
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
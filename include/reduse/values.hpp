@@ -0,0 +1,147 @@
+#pragma once
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <reduse/run.hpp>
+
+namespace reduse {
+
+    /** @brief Single-pass stream over the values of one key group, handed to a streaming REDUCE callable as
+     * reduce_value(const map_key&, ValueStream<map_value>&). Values are pulled one by one from the sorted map output,
+     * so a key group never has to fit in memory. Values may be moved out while iterating
+     * @param value Data type of a value
+     */
+    template<typename value>
+    class ValueStream {
+    protected:
+
+        value* curr = nullptr; // Current value. nullptr once the stream is exhausted
+        bool started = false; // Indicates that the first value was fetched
+        std::size_t consumed = 0; // Number of values fetched so far
+
+        /** @brief Moves curr to the next value of the group, or to nullptr at its end */
+        virtual void advance() = 0;
+
+        /** @brief Advances, counting the fetched value */
+        void step() {
+            advance();
+            if (curr != nullptr)
+                consumed++;
+        }
+
+        /** @brief Fetches the first value, once */
+        void start() {
+            if (!started) {
+                started = true;
+                step();
+            }
+        }
+
+    public:
+
+        /** @brief Input iterator over a ValueStream. Every iterator of a stream shares its position */
+        class iterator {
+        private:
+
+            ValueStream* stream; // Stream iterated over. nullptr for the end iterator
+
+        public:
+
+            using iterator_category = std::input_iterator_tag;
+            using value_type = value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = value*;
+            using reference = value&;
+
+            explicit iterator(ValueStream* _stream): stream(_stream) {}
+
+            reference operator*() const { return *stream->curr; }
+            pointer operator->() const { return stream->curr; }
+            iterator& operator++() { stream->step(); return *this; }
+            void operator++(int) { stream->step(); }
+
+            /** @brief Returns true if the iterator has reached the end of its stream */
+            bool atEnd() const { return stream == nullptr || stream->curr == nullptr; }
+
+            bool operator==(const iterator& other) const { return atEnd() == other.atEnd(); }
+            bool operator!=(const iterator& other) const { return atEnd() != other.atEnd(); }
+        };
+
+        virtual ~ValueStream() = default;
+
+        /** @brief Returns an iterator at the current value */
+        iterator begin() { start(); return iterator(this); }
+
+        /** @brief Returns the end iterator */
+        iterator end() { return iterator(nullptr); }
+
+        /** @brief Reads the next value into item. Returns false at the end of the group */
+        bool next(value& item) {
+            if (started)
+                step();
+            else
+                start();
+            if (curr == nullptr)
+                return false;
+            item = std::move(*curr);
+            return true;
+        }
+
+        /** @brief Skips every value not read yet */
+        void drain() {
+            start();
+            while (curr != nullptr)
+                step();
+        }
+
+        /** @brief Returns the number of values fetched so far. The size of the group once drained */
+        std::size_t count() const { return consumed; }
+    };
+
+    /** @brief ValueStream over a key group already collected in a vector */
+    template<typename value>
+    class VectorValueStream: public ValueStream<value> {
+    private:
+
+        std::vector<value>& values; // Values of the group
+        std::size_t pos = 0; // Position of the next value
+
+    protected:
+
+        void advance() override { this->curr = pos < values.size() ? &values[pos++] : nullptr; }
+
+    public:
+
+        /** @brief Constructor for the VectorValueStream
+         * @param _values Values of the group
+         */
+        explicit VectorValueStream(std::vector<value>& _values): values(_values) {}
+    };
+
+    /** @brief ValueStream pulling a key group straight out of a RunMerger. The merger must point at the first record
+     * of the group, and points at the first record of the next group once the stream is drained
+     */
+    template<typename key, typename value>
+    class MergedValueStream: public ValueStream<value> {
+    private:
+
+        RunMerger<key, value>& merger; // Merger holding the group
+        const key& group_key; // Key of the group. Must not live inside the merger
+
+    protected:
+
+        void advance() override {
+            if (this->curr != nullptr)
+                merger.next();
+            this->curr = merger.valid() && merger.current().first == group_key ? &merger.current().second : nullptr;
+        }
+
+    public:
+
+        /** @brief Constructor for the MergedValueStream
+         * @param _merger Merger pointing at the first record of the group
+         * @param _group_key Key of the group
+         */
+        MergedValueStream(RunMerger<key, value>& _merger, const key& _group_key): merger(_merger), group_key(_group_key) {}
+    };
+}
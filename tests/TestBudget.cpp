@@ -0,0 +1,66 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <gtest/gtest.h>
+#include <reduse/budget.hpp>
+#include <reduse/memory.hpp>
+
+TEST(TestBudget, TestAcquire) {
+    // Spillable memory stops short of the headroom, memory in flight may use it
+    reduse::MemoryBudget budget(1000);
+    ASSERT_TRUE(budget.tryAcquire(700));
+    ASSERT_FALSE(budget.tryAcquire(100));
+    budget.acquire(250);
+    ASSERT_EQ(budget.bytesUsed(), 950u);
+
+    // A producer blocks till the memory in flight goes back
+    std::atomic<bool> granted = false;
+    std::thread producer([&]() {
+        budget.acquire(200);
+        granted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(granted);
+    budget.releaseInFlight(250);
+    producer.join();
+    ASSERT_TRUE(granted);
+    ASSERT_EQ(budget.bytesUsed(), 900u);
+    ASSERT_EQ(budget.peakBytes(), 950u);
+    ASSERT_GT(budget.waitSeconds(), 0);
+
+    // Spillable memory goes back without touching the memory in flight
+    budget.release(700);
+    ASSERT_EQ(budget.bytesUsed(), 200u);
+    budget.resetPeak();
+    ASSERT_EQ(budget.peakBytes(), 200u);
+    ASSERT_EQ(budget.waitSeconds(), 0);
+}
+
+TEST(TestBudget, TestOversized) {
+    // A batch larger than the whole budget still gets through when nothing else is in flight
+    reduse::MemoryBudget budget(100);
+    ASSERT_TRUE(budget.tryAcquire(50));
+    budget.acquire(500);
+    ASSERT_EQ(budget.bytesUsed(), 550u);
+    ASSERT_FALSE(budget.tryAcquire(1));
+    budget.releaseInFlight(500);
+    budget.release(50);
+    ASSERT_EQ(budget.bytesUsed(), 0u);
+}
+
+TEST(TestBudget, TestFootprint) {
+    // The reducers' batches are vectors of key groups. Every key and value they own must be charged
+    const std::string key(100, 'k');
+    std::vector<std::pair<std::string, std::vector<int>>> batch;
+    batch.reserve(2);
+    batch.emplace_back(key, std::vector<int>(1000, 1));
+    batch.emplace_back(key, std::vector<int>(1000, 2));
+    std::size_t expected = sizeof(batch);
+    for(auto &[group_key, values]: batch)
+        expected += reduse::memoryFootprint(group_key) + reduse::memoryFootprint(values);
+    ASSERT_EQ(reduse::memoryFootprint(batch), expected);
+    ASSERT_GT(reduse::memoryFootprint(batch), 2 * (key.capacity() + 1000 * sizeof(int)));
+}
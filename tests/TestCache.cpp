@@ -0,0 +1,106 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <optional>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/cache.hpp>
+
+TEST(TestCache, TestSplit) {
+    std::string directory = TEST_SOURCE_DIR;
+    directory += "/testcache_split";
+    reduse::Options options;
+    options.cache_chunk_size = 1000;
+    reduse::ChunkCache<std::string, int> cache(directory, options);
+
+    std::string input;
+    for(auto i = 0; i < 1000; i++)
+        input += "line " + std::to_string(i) + "\n";
+    auto chunks = cache.split(input);
+    ASSERT_GT(chunks.size(), 5u);
+    std::size_t next = 0;
+    for(auto &chunk: chunks) {
+        ASSERT_EQ(chunk.offset, next);
+        ASSERT_EQ(input[chunk.offset + chunk.length - 1], '\n');
+        next += chunk.length;
+    }
+    ASSERT_EQ(next, input.size());
+    ASSERT_FALSE(chunks.back().complete);
+
+    // Appending keeps every complete chunk, hash included
+    auto grown = cache.split(input + "more\nlines\n");
+    for(std::size_t i = 0; i + 1 < chunks.size(); i++) {
+        ASSERT_TRUE(chunks[i].complete);
+        ASSERT_EQ(cache.chunkName(grown[i]), cache.chunkName(chunks[i]));
+    }
+
+    // Changing a byte changes the name of its chunk only
+    input[1500] = 'X';
+    auto changed = cache.split(input);
+    ASSERT_EQ(cache.chunkName(changed[0]), cache.chunkName(chunks[0]));
+    ASSERT_NE(cache.chunkName(changed[1]), cache.chunkName(chunks[1]));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(TestCache, TestStore) {
+    std::string directory = TEST_SOURCE_DIR;
+    directory += "/testcache_store";
+    reduse::Options options;
+    reduse::ChunkCache<std::string, int> cache(directory, options, "input");
+    const std::string base_name = cache.baseName(2, 0);
+    const std::string chunk_name = cache.chunkName({0, 1, 0, true});
+    ASSERT_FALSE(cache.load(chunk_name).has_value());
+
+    // Two sorted runs with overlapping keys
+    std::vector<reduse::SortedRun<std::string, int>> runs(2);
+    for(auto i = 0; i < 3000; i++) {
+        runs[0].records.emplace_back("key" + std::to_string(10000 + i), 1);
+        runs[1].records.emplace_back("key" + std::to_string(10000 + i * 2), 2);
+    }
+    runs[0].size = runs[0].records.size();
+    runs[1].size = runs[1].records.size();
+
+    // Folded, every key is left once with the sum of its values
+    auto folded = cache.store(base_name, runs, [](const std::string&, std::vector<int>& values) {
+        auto sum = 0;
+        for(auto it: values)
+            sum += it;
+        return sum;
+    });
+    auto loaded = cache.load(base_name);
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->size, folded.size);
+    ASSERT_EQ(loaded->index.size(), folded.index.size());
+    std::vector<reduse::SortedRun<std::string, int>> loaded_runs{*loaded};
+    std::vector<std::pair<std::string, int>> records;
+    reduse::mergeRuns(loaded_runs, std::optional<std::string>(), std::optional<std::string>(), [&](const std::pair<std::string, int>& record) { records.push_back(record); });
+    ASSERT_EQ(records.size(), 4500u);
+    ASSERT_EQ(records[0], std::make_pair(std::string("key10000"), 3));
+    ASSERT_EQ(records[1], std::make_pair(std::string("key10001"), 1));
+
+    // Unfolded, every value is kept
+    auto kept = cache.store(chunk_name, runs);
+    ASSERT_EQ(kept.size, 6000u);
+
+    // Another input, tag or record format names its runs apart, so it neither reuses nor prunes them
+    reduse::ChunkCache<std::string, int> other_input(directory, options, "other input");
+    options.cache_tag = "v2";
+    reduse::ChunkCache<std::string, int> other_tag(directory, options, "input");
+    options.cache_tag.clear();
+    options.record_format = reduse::RecordFormat::CSV;
+    reduse::ChunkCache<std::string, int> other_format(directory, options, "input");
+    for(auto other: {&other_input, &other_tag, &other_format}) {
+        ASSERT_NE(other->chunkName({0, 1, 0, true}), chunk_name);
+        ASSERT_FALSE(other->load(other->chunkName({0, 1, 0, true})).has_value());
+        other->prune({});
+    }
+    ASSERT_TRUE(cache.load(base_name).has_value());
+
+    // Pruning drops whatever is not live
+    cache.prune({chunk_name});
+    ASSERT_FALSE(cache.load(base_name).has_value());
+    ASSERT_TRUE(cache.load(chunk_name).has_value());
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,134 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <utility>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/chain.hpp>
+
+namespace {
+
+    std::pair<std::string, int> CHAIN_WORD_MAP(std::string_view line) { return {std::string(line), 1}; }
+
+    int CHAIN_SUM(const std::string&, std::vector<int>& values) {
+        auto sum = 0;
+        for(auto it: values)
+            sum += it;
+        return sum;
+    }
+
+    int CHAIN_COUNT_SUM(const int&, std::vector<int>& values) {
+        auto sum = 0;
+        for(auto it: values)
+            sum += it;
+        return sum;
+    }
+
+    // Word i appears i % 50 + 1 times, so 20 words share every count from 1 to 50
+    const int CHAIN_WORDS = 1000;
+
+    // Reads the "key result" lines of an output file
+    template<typename key>
+    std::map<key, int> readOutput(const std::string& output_filename) {
+        std::map<key, int> results;
+        std::ifstream output_file(output_filename);
+        key item;
+        int result;
+        while(output_file >> item >> result)
+            results[item] += result;
+        return results;
+    }
+}
+
+TEST(TestChain, TestStages) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testchain_input.txt";
+    std::string words_filename = TEST_SOURCE_DIR;
+    words_filename += "/testchain_words_output.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testchain_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < CHAIN_WORDS; i++)
+            for(auto j = 0; j <= i % 50; j++)
+                input_file << "word" << i << "\n";
+    }
+
+    reduse::Chain chain(4);
+    for(auto associative: {false, true}) {
+        // A tiny sort buffer spills the shuffles, unless the combiner folds them first
+        reduse::Options options;
+        options.associative_reduce = associative;
+        options.sort_memory_budget = 4096;
+        options.memory_budget = 1 << 18;
+
+        // Word counts, then the number of words per count, then the number of counts per parity
+        auto words = chain.source<std::string, int, int>(input_filename, CHAIN_WORD_MAP, CHAIN_SUM, 3, 3, options);
+        words->materialize(words_filename);
+        auto histogram = chain.then<int, int, int>(
+            words,
+            [](const std::string&, const int& count) { return std::make_pair(count, 1); },
+            CHAIN_COUNT_SUM,
+            2,
+            options
+        );
+        reduse::Options last_options = options;
+        last_options.sorted_output = true;
+        auto parity = chain.then<int, int, int>(
+            histogram,
+            [](const int& count, const int& num_words, reduse::Emitter<int, int>& output) {
+                if (num_words > 0)
+                    output.emplace(count % 2, 1);
+            },
+            CHAIN_COUNT_SUM,
+            2,
+            last_options
+        );
+
+        auto stats = chain.run(parity, output_filename);
+        ASSERT_EQ(stats.size(), 3u);
+        if (!associative) {
+            ASSERT_GT(stats[1].map.spill_files, 0u);
+        }
+        ASSERT_EQ(stats[1].map.records_in, static_cast<std::size_t>(CHAIN_WORDS));
+        ASSERT_EQ(stats[2].map.records_in, 50u);
+
+        // Overlapping stages share the budget of the chain
+        for(auto &stage: stats) {
+            ASSERT_LE(stage.map.peak_memory, options.memory_budget);
+            ASSERT_LE(stage.reduce.peak_memory, options.memory_budget);
+        }
+        ASSERT_GT(stats[1].map.peak_memory, 0u);
+
+        // The materialized stage holds every word count
+        auto counts = readOutput<std::string>(words_filename);
+        ASSERT_EQ(counts.size(), static_cast<std::size_t>(CHAIN_WORDS));
+        for(auto i = 0; i < CHAIN_WORDS; i++)
+            ASSERT_EQ(counts["word" + std::to_string(i)], i % 50 + 1);
+
+        // The last stage writes sorted "key result" lines
+        std::ifstream output_file(output_filename);
+        int parity_key, num_counts;
+        ASSERT_TRUE(output_file >> parity_key >> num_counts);
+        ASSERT_EQ(parity_key, 0);
+        ASSERT_EQ(num_counts, 25);
+        ASSERT_TRUE(output_file >> parity_key >> num_counts);
+        ASSERT_EQ(parity_key, 1);
+        ASSERT_EQ(num_counts, 25);
+        ASSERT_FALSE(output_file >> parity_key >> num_counts);
+
+        // The histogram alone, run as the last stage, writes a result per line
+        chain.run(histogram, output_filename);
+        std::ifstream histogram_file(output_filename);
+        std::vector<int> histogram_counts{std::istream_iterator<int>(histogram_file), std::istream_iterator<int>()};
+        ASSERT_EQ(histogram_counts.size(), 50u);
+        for(auto num_words: histogram_counts)
+            ASSERT_EQ(num_words, CHAIN_WORDS / 50);
+    }
+    remove(input_filename.c_str());
+    remove(words_filename.c_str());
+}
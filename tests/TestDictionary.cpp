@@ -0,0 +1,33 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+#include <reduse/dictionary.hpp>
+#include <reduse/partitioner.hpp>
+
+TEST(TestDictionary, TestEncode) {
+    // Threads interning overlapping key sets must agree on every ID
+    reduse::KeyDictionary<std::string, reduse::HashPartitioner<std::string>> dictionary(5);
+    std::vector<std::vector<reduse::KeyId>> ids(4, std::vector<reduse::KeyId>(10000));
+    std::vector<std::thread> encoders;
+    for(std::size_t t = 0; t < ids.size(); t++)
+        encoders.emplace_back([&, t]() {
+            for(std::size_t i = 0; i < 10000; i++)
+                ids[t][(i + t * 2500) % 10000] = dictionary.encode("key" + std::to_string((i + t * 2500) % 10000));
+        });
+    for(auto &encoder: encoders)
+        encoder.join();
+    ASSERT_EQ(dictionary.size(), 10000u);
+
+    reduse::HashPartitioner<std::string> partitioner;
+    reduse::KeyIdPartitioner id_partitioner;
+    for(std::size_t i = 0; i < 10000; i++) {
+        for(std::size_t t = 1; t < ids.size(); t++)
+            ASSERT_EQ(ids[t][i], ids[0][i]);
+
+        // An ID decodes to its key and lands in the partition of its key
+        const std::string item = "key" + std::to_string(i);
+        ASSERT_EQ(dictionary.decode(ids[0][i]), item);
+        ASSERT_EQ(id_partitioner(ids[0][i], 5), partitioner(item, 5));
+    }
+}
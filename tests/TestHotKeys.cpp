@@ -0,0 +1,33 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+#include <reduse/hot_keys.hpp>
+
+TEST(TestHotKeys, TestDetect) {
+    // A third of the samples go to key 0 and the rest are spread over 10000 keys
+    reduse::HotKeyDetector<int> detector(4, 0.5);
+    std::vector<std::thread> samplers;
+    for(auto t = 0; t < 3; t++)
+        samplers.emplace_back([&detector, t]() {
+            for(auto i = 0; i < 30000; i++)
+                detector.sample(i % 3 == 0 ? 0 : 1 + (i * 7 + t) % 10000);
+        });
+    for(auto &sampler: samplers)
+        sampler.join();
+
+    auto hot = detector.hotKeys();
+    ASSERT_EQ(hot.size(), 1u);
+    ASSERT_EQ(hot.count(0), 1u);
+
+    // Clearing forgets the hot keys and moves the version on
+    auto version = detector.version();
+    detector.clear();
+    ASSERT_NE(detector.version(), version);
+    ASSERT_TRUE(detector.hotKeys().empty());
+
+    // Uniform keys are never hot
+    for(auto i = 0; i < 100000; i++)
+        detector.sample(i % 100);
+    ASSERT_TRUE(detector.hotKeys().empty());
+}
@@ -0,0 +1,77 @@
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdio>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/io.hpp>
+
+// Returns the backends that can run in this environment
+std::vector<reduse::IoBackend> availableBackends() {
+    std::vector<reduse::IoBackend> backends = {reduse::IoBackend::POSIX, reduse::IoBackend::AUTO};
+    try {
+        reduse::makeIoQueue(reduse::IoBackend::IO_URING);
+        backends.push_back(reduse::IoBackend::IO_URING);
+    } catch (const std::runtime_error&) {}
+    return backends;
+}
+
+TEST(TestIo, TestRoundTrip) {
+    std::string filename = TEST_SOURCE_DIR;
+    filename += "/testio_output.bin";
+
+    for(auto backend: availableBackends())
+        for(std::size_t size: {std::size_t(0), std::size_t(1), reduse::IO_MIN_BLOCK_SIZE, 3 * reduse::IO_BLOCK_SIZE + 12345}) {
+            std::string contents(size, '\0');
+            for(std::size_t i = 0; i < size; i++)
+                contents[i] = static_cast<char>(i * 131 + i / 7);
+
+            // Whole buffers through a FileWriter
+            {
+                reduse::FileWriter writer(filename, backend);
+                for(std::size_t offset = 0; offset < size; offset += 100000) {
+                    std::string chunk = contents.substr(offset, 100000);
+                    writer.append(chunk);
+                    ASSERT_TRUE(chunk.empty());
+                }
+                ASSERT_EQ(writer.size(), size);
+                writer.close();
+            }
+
+            // Reads of an odd size must put the file back together
+            std::string read_back;
+            {
+                reduse::FileReader reader(filename, backend);
+                std::vector<char> buffer(77777);
+                std::size_t count;
+                do {
+                    count = reader.read(buffer.data(), buffer.size());
+                    read_back.append(buffer.data(), count);
+                } while(count == buffer.size());
+                ASSERT_EQ(reader.read(buffer.data(), buffer.size()), 0u);
+            }
+            ASSERT_EQ(read_back, contents);
+
+            // Any stream writes through a FileWriteBuffer and knows its position
+            {
+                reduse::FileWriteBuffer stream_buffer(filename, backend);
+                std::ostream output(&stream_buffer);
+                output.write(contents.data(), size / 2);
+                for(std::size_t i = size / 2; i < size; i++)
+                    output.put(contents[i]);
+                ASSERT_EQ(static_cast<std::size_t>(output.tellp()), size);
+                stream_buffer.close();
+            }
+            read_back.clear();
+            {
+                reduse::FileReader reader(filename, backend);
+                std::vector<char> buffer(size + 1);
+                read_back.append(buffer.data(), reader.read(buffer.data(), buffer.size()));
+            }
+            ASSERT_EQ(read_back, contents);
+        }
+    remove(filename.c_str());
+
+    ASSERT_THROW(reduse::FileReader(filename, reduse::IoBackend::AUTO), std::runtime_error);
+}
@@ -3,11 +3,15 @@
 #include <utility>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <stdexcept>
 #include <unordered_map>
 #include <gtest/gtest.h>
 #include <reduse/config.hpp>
 #include <reduse/mapper.hpp>
+#include <reduse/sorter.hpp>
+#include <reduse/thread_pool.hpp>
 
 // Map method for the test TestRun
 std::pair<int, std::string> MAP(const std::string& s) {
@@ -64,3 +68,159 @@ TEST(TestMapper, TestRun) {
         ASSERT_EQ((int)(outfile_map[3].size()), 2);
     }
 }
+
+
+// Map method for the test TestRunMmap. Reads the line through a view
+std::pair<int, std::string> MAP_VIEW(std::string_view s) {
+    auto a = (s[0] - '0');
+    auto b = s.substr(1, s.length() - 1);
+    return {a, std::string(b)};
+}
+
+TEST(TestMapper, TestRunMmap) {
+
+    for(auto test_reps = 1; test_reps <= 500; test_reps++) {
+        // Define the input file
+        std::string input_filename = TEST_SOURCE_DIR;
+        input_filename += "/testmap_input.txt";
+        std::string output_filename = TEST_SOURCE_DIR;
+        output_filename += "/testmap_mmap_output.txt";
+
+        // Memory mapped input, with more mappers than lines every now and then
+        reduse::Options options;
+        options.input_mode = reduse::InputMode::MMAP;
+
+        // Create the mapper and run it
+        try {
+            if (test_reps % 2) {
+                reduse::Mapper<int, std::string> mapper = {input_filename, output_filename, MAP_VIEW, 1 + test_reps % 8, false, options};
+                mapper.run();
+            } else {
+                reduse::Mapper<int, std::string> mapper = {input_filename, output_filename, MAP, 1 + test_reps % 8, false, options};
+                mapper.run();
+            }
+        } catch (const std::exception &e) {
+            std::cout << e.what();
+            std::terminate();
+        }
+
+        // Read the file and test it
+        std::fstream outfile_reader;
+        outfile_reader.open(output_filename, std::ios::in);
+        ASSERT_TRUE(outfile_reader.is_open());
+
+        auto ct = 0;
+        std::unordered_map<int, std::vector<std::string>> outfile_map;
+        int key;
+        std::string value;
+        while(outfile_reader >> key) {
+            ct++;
+            outfile_reader >> value;
+            outfile_map[key].push_back(value);
+        }
+        outfile_reader.close();
+
+        // Assertions
+        ASSERT_EQ(ct, 5);
+        ASSERT_EQ((int)(outfile_map.size()), 3);
+        ASSERT_EQ((int)(outfile_map[1].size()), 2);
+        ASSERT_EQ((int)(outfile_map[2].size()), 1);
+        ASSERT_EQ((int)(outfile_map[3].size()), 2);
+        ASSERT_EQ(outfile_map[2][0], "323");
+    }
+}
+
+TEST(TestMapper, TestShuffleMode) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testmap_shuffle_input.txt";
+    {
+        std::ofstream writer(input_filename);
+        for(auto i = 0; i < 20000; i++)
+            writer << i % 10 << "value" << i << "\n";
+    }
+
+    // A tiny budget spills under AUTO, while MEMORY keeps every run in memory regardless
+    for(auto mode: {reduse::ShuffleMode::AUTO, reduse::ShuffleMode::MEMORY}) {
+        reduse::Options options;
+        options.sort_memory_budget = 4096;
+        options.shuffle_mode = mode;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<int, std::string>>(
+            input_filename, reduse::sortBufferBudget(options, 4), 3
+        );
+        reduse::Mapper<int, std::string> mapper = {input_filename, shuffle, MAP, 4, false, options};
+        mapper.run();
+
+        if (mode == reduse::ShuffleMode::MEMORY)
+            ASSERT_EQ(shuffle->spillCount(), 0u);
+        else
+            ASSERT_GT(shuffle->spillCount(), 0u);
+        std::size_t ct = 0;
+        for(std::size_t partition = 0; partition < shuffle->partitionCount(); partition++)
+            reduse::mergeRuns<int, std::string>(shuffle->getRuns(partition), std::nullopt, std::nullopt,
+                [&](std::pair<int, std::string>&) { ct++; });
+        ASSERT_EQ(ct, 20000u);
+    }
+    remove(input_filename.c_str());
+}
+
+TEST(TestMapper, TestMapThrows) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testmap_throw_input.txt";
+    {
+        std::ofstream writer(input_filename);
+        for(auto i = 0; i < 20000; i++)
+            writer << i % 10 << "value" << i << "\n";
+    }
+
+    // MAP fails on every tenth line, so every consumer dies early. The job must fail instead of leaving the producer
+    // blocked on a full buffer
+    auto pool = std::make_shared<reduse::ThreadPool>(2);
+    for(auto test_reps = 1; test_reps <= 20; test_reps++) {
+        reduse::Options options;
+        options.batch_size = 1;
+        options.buffer_depth = 1;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<int, std::string>>(
+            input_filename, reduse::sortBufferBudget(options, 2), 2
+        );
+        reduse::Mapper<int, std::string> mapper = {input_filename, shuffle, [](const std::string& s) {
+            if (s[0] == '0')
+                throw std::runtime_error("bad record");
+            return MAP(s);
+        }, 2, false, options};
+        mapper.setPool(pool);
+        ASSERT_THROW(mapper.run(), std::runtime_error);
+        shuffle->clear();
+    }
+    remove(input_filename.c_str());
+}
+
+TEST(TestMapper, TestMapThrowsWithBudget) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testmap_throw_budget_input.txt";
+    {
+        std::ofstream writer(input_filename);
+        for(auto i = 0; i < 200000; i++)
+            writer << i % 10 << "value" << i << "\n";
+    }
+
+    // MAP fails on a single record. The producer must stop at the first batch the closed buffer refuses, instead of
+    // reserving memory in flight for every batch of the input until the budget blocks it for good
+    auto pool = std::make_shared<reduse::ThreadPool>(2);
+    for(auto test_reps = 1; test_reps <= 5; test_reps++) {
+        reduse::Options options;
+        options.memory_budget = 1 << 20;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<int, std::string>>(
+            input_filename, reduse::sortBufferBudget(options, 2), 2
+        );
+        reduse::Mapper<int, std::string> mapper = {input_filename, shuffle, [](const std::string& s) {
+            if (s == "0value1000")
+                throw std::runtime_error("bad record");
+            return MAP(s);
+        }, 2, false, options};
+        mapper.setPool(pool);
+        mapper.setMemoryBudget(std::make_shared<reduse::MemoryBudget>(options.memory_budget));
+        ASSERT_THROW(mapper.run(), std::runtime_error);
+        shuffle->clear();
+    }
+    remove(input_filename.c_str());
+}
@@ -0,0 +1,88 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <reduse/records.hpp>
+
+// Scans text in chunks of chunk_size bytes the way the map producer does, carrying incomplete records over
+std::vector<std::string> scanChunked(reduse::RecordScanner& scanner, const std::string& text, const std::size_t chunk_size) {
+    std::vector<std::string> records;
+    std::string pending;
+    for(std::size_t offset = 0; offset < text.size() || offset == 0; offset += chunk_size) {
+        pending.append(text, offset, chunk_size);
+        const bool final = offset + chunk_size >= text.size();
+        auto rest = scanner.scan(pending, final, [&](std::string_view record) { records.emplace_back(record); });
+        pending.erase(0, rest - pending.data());
+    }
+    return records;
+}
+
+// Checks that every chunk size and split count yields the expected records
+void checkFormat(const reduse::Options& options, const std::string& text, const std::vector<std::string>& expected) {
+    reduse::RecordScanner scanner(options);
+    for(std::size_t chunk_size = 1; chunk_size <= text.size() + 1; chunk_size++)
+        ASSERT_EQ(scanChunked(scanner, text, chunk_size), expected);
+
+    for(std::size_t num_splits = 1; num_splits <= 16; num_splits++) {
+        std::vector<std::string> records;
+        for(auto split: scanner.split(text, num_splits))
+            scanner.scan(split, true, [&](std::string_view record) { records.emplace_back(record); });
+        ASSERT_EQ(records, expected);
+    }
+}
+
+TEST(TestRecords, TestFindByte) {
+    // Every position and length must agree with memchr, including the unaligned tails of the vector loops
+    std::string text(300, 'a');
+    for(std::size_t length = 0; length <= 100; length++)
+        for(std::size_t position = 0; position <= length; position++) {
+            std::string copy = text.substr(0, length);
+            if (position < length)
+                copy[position] = '\0';
+            const char* begin = copy.data();
+            const char* end = copy.data() + copy.size();
+            auto expected = static_cast<const char*>(std::memchr(begin, '\0', length));
+            ASSERT_EQ(reduse::findByte(begin, end, '\0'), expected != nullptr ? expected : end);
+        }
+}
+
+TEST(TestRecords, TestFormats) {
+    reduse::Options options;
+
+    // Lines behave like std::getline: no empty trailing record, and the last record needs no newline
+    checkFormat(options, "", {});
+    checkFormat(options, "ab\n\ncd\n", {"ab", "", "cd"});
+    checkFormat(options, "ab\ncd", {"ab", "cd"});
+
+    options.record_format = reduse::RecordFormat::DELIMITED;
+    options.record_delimiter = '\0';
+    checkFormat(options, std::string("one\ntwo\0three\0", 14), {"one\ntwo", "three"});
+
+    options.record_format = reduse::RecordFormat::FIXED_WIDTH;
+    options.record_width = 3;
+    checkFormat(options, "abcdefghi", {"abc", "def", "ghi"});
+    reduse::RecordScanner truncated(options);
+    ASSERT_THROW(truncated.scan("abcd", true, [](std::string_view) {}), std::runtime_error);
+
+    options.record_format = reduse::RecordFormat::LENGTH_PREFIXED;
+    std::string prefixed;
+    std::vector<std::string> expected;
+    for(std::uint32_t length = 0; length < 20; length++) {
+        expected.emplace_back(length, 'a' + length);
+        prefixed.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        prefixed += expected.back();
+    }
+    checkFormat(options, prefixed, expected);
+    reduse::RecordScanner short_prefix(options);
+    ASSERT_THROW(short_prefix.scan(prefixed.substr(0, prefixed.size() - 1), true, [](std::string_view) {}), std::runtime_error);
+
+    // Projected fields are unquoted and joined by the separator. Missing fields are empty
+    options.record_format = reduse::RecordFormat::CSV;
+    options.csv_fields = {2, 0, 5};
+    checkFormat(options, "a,b,c\n\"x,1\",y,\"say \"\"hi\"\"\"\n1,2\n", {"c,a,", "say \"hi\",x,1,", ",1,"});
+    options.csv_fields.clear();
+    checkFormat(options, "a,\"b\"\n", {"a,\"b\""});
+}
@@ -2,11 +2,15 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <memory>
+#include <utility>
+#include <algorithm>
 #include <exception>
 #include <unordered_map>
 #include <gtest/gtest.h>
 #include <reduse/config.hpp>
 #include <reduse/reducer.hpp>
+#include <reduse/partitioner.hpp>
 
 // Reduce method for the Reducer
 int REDUCE(int key, std::vector<int>& values) {
@@ -55,3 +59,151 @@ TEST(TestReducer, TestRun) {
         ASSERT_EQ(output_file_map[15], 1);
     }
 }
+
+
+TEST(TestReducer, TestRunShuffle) {
+
+    for(auto test_reps = 1; test_reps <= 100; test_reps++) {
+        std::string output_filename = TEST_SOURCE_DIR;
+        output_filename += "/testreducer_shuffle_output.txt";
+
+        // Fill a shuffle with the same pairs as testreducer_map_output.txt, routed by the default partitioner
+        const std::size_t num_partitions = 1 + test_reps % 4;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<int, int>>(output_filename, 1 << 20, num_partitions);
+        {
+            reduse::HashPartitioner<int> partitioner;
+            reduse::SortBuffer<int, int> sort_buffer(*shuffle);
+            for(auto &[key, value]: std::vector<std::pair<int, int>>{{3, 4}, {1, 2}, {2, 323}, {1, 321}, {3, 11}})
+                sort_buffer.push(partitioner(key, num_partitions), {key, value});
+            sort_buffer.close();
+        }
+
+        // Create a Reducer over the shuffle and run it
+        try {
+            reduse::Reducer<int, int, int> reducer = {shuffle, output_filename, REDUCE, 4};
+            reducer.run();
+        } catch (const std::exception &e) {
+            std::cout << e.what();
+            std::terminate();
+        }
+
+        // Open the output file produced by the reducer
+        std::fstream output_file;
+        output_file.open(output_filename, std::ios::in);
+
+        auto ct = 0;
+        std::unordered_map<int, int> output_file_map;
+        int item;
+        while(output_file >> item) {
+            output_file_map[item]++;
+            ct++;
+        }
+
+        // Assertions
+        ASSERT_EQ(ct, 3);
+        ASSERT_EQ((int)(output_file_map.size()), 2);
+        ASSERT_EQ(output_file_map[323], 2);
+        ASSERT_EQ(output_file_map[15], 1);
+    }
+}
+
+TEST(TestReducer, TestChunkedOutput) {
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreducer_chunked_output.txt";
+
+    // Many key groups over many reducers, committed in chunks far smaller than the output
+    const int num_keys = 20000;
+    const std::size_t num_partitions = 8;
+    auto shuffle = std::make_shared<reduse::ExternalSorter<int, int>>(output_filename, 1 << 20, num_partitions);
+    reduse::HashPartitioner<int> partitioner;
+    {
+        reduse::SortBuffer<int, int> sort_buffer(*shuffle);
+        for(auto key = 0; key < num_keys; key++) {
+            sort_buffer.push(partitioner(key, num_partitions), {key, key});
+            sort_buffer.push(partitioner(key, num_partitions), {key, 1000000});
+        }
+        sort_buffer.close();
+    }
+    reduse::Options options;
+    options.output_chunk_size = 100;
+    reduse::Reducer<int, int, int> reducer = {shuffle, output_filename, REDUCE, 6, false, options};
+    reducer.run();
+
+    // Every line holds exactly one whole result
+    std::fstream output_file;
+    output_file.open(output_filename, std::ios::in);
+    std::vector<bool> seen(num_keys, false);
+    std::string line;
+    auto ct = 0;
+    while(std::getline(output_file, line)) {
+        int key = std::stoi(line) - 1000000;
+        ASSERT_EQ(std::to_string(key + 1000000), line);
+        ASSERT_FALSE(seen[key]);
+        seen[key] = true;
+        ct++;
+    }
+    ASSERT_EQ(ct, num_keys);
+}
+
+// Streaming reduce method. Sums the values of a key group one by one
+long long STREAM_REDUCE(const int& key, reduse::ValueStream<int>& values) {
+    long long sum = 0;
+    for(auto &it: values)
+        sum += it;
+    return sum;
+}
+
+TEST(TestReducer, TestStreamReduce) {
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreducer_stream_output.txt";
+
+    // A REDUCE reading only the first value leaves the rest of its group to be skipped
+    for(auto read_all: {true, false}) {
+        // One hot key next to many small groups, spilled over many runs
+        const std::size_t num_partitions = 4;
+        auto shuffle = std::make_shared<reduse::ExternalSorter<int, int>>(output_filename, 4096, num_partitions);
+        reduse::HashPartitioner<int> partitioner;
+        {
+            reduse::SortBuffer<int, int> sort_buffer(*shuffle);
+            for(auto i = 0; i < 100000; i++) {
+                sort_buffer.push(partitioner(-1, num_partitions), {-1, 1});
+                sort_buffer.push(partitioner(i % 1000, num_partitions), {i % 1000, 1000000});
+            }
+            sort_buffer.close();
+        }
+        ASSERT_GT(shuffle->spillCount(), 0u);
+
+        auto reduce = [&](const int& key, reduse::ValueStream<int>& values) -> long long {
+            if (read_all)
+                return STREAM_REDUCE(key, values);
+            int first;
+            return values.next(first) ? first : 0;
+        };
+        reduse::Reducer<int, int, long long> reducer = {shuffle, output_filename, reduce, 3};
+        reducer.run();
+
+        std::fstream output_file;
+        output_file.open(output_filename, std::ios::in);
+        std::unordered_map<long long, int> output_file_map;
+        long long item;
+        while(output_file >> item)
+            output_file_map[item]++;
+        ASSERT_EQ((int)output_file_map.size(), 2);
+        ASSERT_EQ(output_file_map[read_all ? 100000 : 1], 1);
+        ASSERT_EQ(output_file_map[read_all ? 100000000 : 1000000], 1000);
+    }
+
+    // A streaming REDUCE also works on an input file, over the collected values
+    std::string map_output_filename = TEST_SOURCE_DIR;
+    map_output_filename += "/testreducer_map_output.txt";
+    reduse::Reducer<int, int, long long> reducer = {map_output_filename, output_filename, STREAM_REDUCE, 2};
+    reducer.run();
+    std::fstream output_file;
+    output_file.open(output_filename, std::ios::in);
+    std::vector<long long> items;
+    long long item;
+    while(output_file >> item)
+        items.push_back(item);
+    std::sort(items.begin(), items.end());
+    ASSERT_EQ(items, std::vector<long long>({15, 323, 323}));
+}
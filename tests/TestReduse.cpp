@@ -3,11 +3,18 @@
 #include <utility>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <exception>
 #include <unordered_map>
+#include <map>
+#include <filesystem>
+#include <algorithm>
+#include <iterator>
+#include <thread>
 #include <gtest/gtest.h>
 #include <reduse/config.hpp>
 #include <reduse/reduse.hpp>
+#include <reduse/session.hpp>
 
 // Map method
 std::pair<int, int> REDUSE_MAP(const std::string& s) {
@@ -61,4 +68,543 @@ TEST(TestReduse, TestRun) {
         ASSERT_EQ(output_file_map[323], 2);
         ASSERT_EQ(output_file_map[15], 1);
     }
-}
\ No newline at end of file
+}
+
+// Map method for the word count test
+std::pair<std::string, int> WORDCOUNT_MAP(const std::string& s) {
+    return {s, 1};
+}
+
+// Reduce method for the word count test. Associative, so it can also be used as the combiner
+int WORDCOUNT_REDUCE(std::string key, std::vector<int>& values) {
+    auto sum = 0;
+    for(auto &it: values)
+        sum += it;
+    return sum;
+}
+
+// Reads the results of an output file holding one result per line, in ascending order
+std::vector<int> readCounts(const std::string& output_filename) {
+    std::ifstream output_file(output_filename);
+    std::vector<int> counts{std::istream_iterator<int>(output_file), std::istream_iterator<int>()};
+    std::sort(counts.begin(), counts.end());
+    return counts;
+}
+
+TEST(TestReduse, TestCombine) {
+    // Write a skewed input of a few distinct words
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_combine_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_combine_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 100000; i++)
+            input_file << "word" << (i % 7 == 0 ? i % 5 : 0) << "\n";
+    }
+
+    for(auto test_reps = 1; test_reps <= 4; test_reps++) {
+        // A tiny combine budget every now and then forces partial flushes
+        reduse::Options options;
+        options.associative_reduce = true;
+        options.combine_memory_budget = test_reps % 2 ? 512 : options.combine_memory_budget;
+        try {
+            reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, test_reps, 3, false, options);
+        } catch (const std::exception &e) {
+            std::cout << e.what();
+            std::terminate();
+        }
+
+        // Every distinct word must be counted exactly once
+        auto counts = readCounts(output_filename);
+
+        // Assertions
+        ASSERT_EQ(counts, std::vector<int>({2857, 2857, 2857, 2857, 88572}));
+    }
+    remove(input_filename.c_str());
+}
+
+// Emitting map method for the word count test. Emits one pair per word, and none for a blank line
+void WORDCOUNT_EMIT_MAP(std::string_view line, reduse::Emitter<std::string, int>& output) {
+    std::size_t start = 0;
+    while(start < line.size()) {
+        std::size_t end = line.find(' ', start);
+        if (end == std::string_view::npos)
+            end = line.size();
+        if (end > start)
+            output.emplace(std::string(line.substr(start, end - start)), 1);
+        start = end + 1;
+    }
+}
+
+TEST(TestReduse, TestEmit) {
+    // Lines of zero to four words
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_emit_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_emit_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 10000; i++) {
+            for(auto j = 0; j < i % 5; j++)
+                input_file << "word" << j << "  ";
+            input_file << "\n";
+        }
+    }
+
+    for(auto mode: {reduse::InputMode::STREAM, reduse::InputMode::MMAP}) {
+        reduse::Options options;
+        options.input_mode = mode;
+        reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 2, false, options);
+
+        // word<j> is on every line with more than j words
+        auto counts = readCounts(output_filename);
+        ASSERT_EQ(counts, std::vector<int>({2000, 4000, 6000, 8000}));
+    }
+    remove(input_filename.c_str());
+}
+
+// Function objects for the functor test. REDUCE takes its key by const reference
+struct FunctorMap {
+    int offset;
+    std::pair<int, int> operator()(std::string_view s) const { return {s[0] - '0', offset + (int)s.size()}; }
+};
+
+struct FunctorReduce {
+    int operator()(const int& key, std::vector<int>& values) const { return key * 1000 + (int)values.size(); }
+};
+
+TEST(TestReduse, TestFunctors) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_functor_output.txt";
+
+    reduse::reduse<int, int, int>(input_filename, output_filename, FunctorMap{7}, FunctorReduce(), 2, 2);
+
+    // Keys 1 and 3 appear twice, key 2 once
+    auto items = readCounts(output_filename);
+    ASSERT_EQ(items, std::vector<int>({1002, 2001, 3002}));
+}
+
+TEST(TestReduse, TestStats) {
+    // Lines of zero to four words
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_stats_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_stats_output.txt";
+    std::string trace_filename = TEST_SOURCE_DIR;
+    trace_filename += "/testreduse_stats_trace.json";
+    std::size_t input_size = 0;
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 10000; i++) {
+            for(auto j = 0; j < i % 5; j++)
+                input_file << "word" << j << "  ";
+            input_file << "\n";
+        }
+        input_size = input_file.tellp();
+    }
+
+    for(auto mode: {reduse::InputMode::STREAM, reduse::InputMode::MMAP}) {
+        reduse::Options options;
+        options.input_mode = mode;
+        options.trace_filename = trace_filename;
+        auto stats = reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 2, false, options);
+
+        ASSERT_EQ(stats.map.records_in, 10000u);
+        ASSERT_EQ(stats.map.bytes_in, input_size);
+        ASSERT_EQ(stats.map.records_out, 20000u);
+        ASSERT_EQ(stats.map.spill_files, 0u);
+        ASSERT_EQ(stats.reduce.records_in, 20000u);
+        ASSERT_EQ(stats.reduce.key_groups, 4u);
+        ASSERT_EQ(stats.reduce.largest_group, 8000u);
+        ASSERT_EQ(stats.reduce.records_out, 4u);
+        ASSERT_EQ(stats.reduce.bytes_out, 20u);
+        ASSERT_GE(stats.wall_seconds, stats.map.wall_seconds);
+
+        // Every worker leaves a span in the trace
+        std::ifstream trace_file(trace_filename);
+        std::string trace((std::istreambuf_iterator<char>(trace_file)), std::istreambuf_iterator<char>());
+        ASSERT_NE(trace.find("\"traceEvents\""), std::string::npos);
+        ASSERT_NE(trace.find("map worker"), std::string::npos);
+        ASSERT_NE(trace.find("reduce partition"), std::string::npos);
+    }
+    remove(input_filename.c_str());
+    remove(trace_filename.c_str());
+}
+
+TEST(TestReduse, TestSession) {
+    // Fewer pool threads than workers per job, shared by several jobs at once
+    reduse::Session session(2);
+    ASSERT_EQ(session.threadCount(), 2);
+    const int num_jobs = 3;
+
+    std::string source_filename = TEST_SOURCE_DIR;
+    source_filename += "/testreduse_input.txt";
+    std::vector<std::string> input_filenames, output_filenames;
+    for(auto job = 0; job < num_jobs; job++) {
+        input_filenames.push_back(source_filename + "_session" + std::to_string(job));
+        output_filenames.push_back(input_filenames.back() + "_output.txt");
+        std::ifstream source(source_filename);
+        std::ofstream input_file(input_filenames.back());
+        input_file << source.rdbuf();
+    }
+
+    for(auto test_reps = 1; test_reps <= 20; test_reps++) {
+        std::vector<std::thread> clients;
+        for(auto job = 0; job < num_jobs; job++)
+            clients.emplace_back([&, job]() {
+                reduse::Options options;
+                options.input_mode = job % 2 == 0 ? reduse::InputMode::STREAM : reduse::InputMode::MMAP;
+                options.batch_size = 1;
+                options.buffer_depth = 1;
+                session.reduse<int, int, int>(input_filenames[job], output_filenames[job], REDUSE_MAP, REDUSE_REDUCE, 4, 3, false, options);
+            });
+        for(auto &client: clients)
+            client.join();
+
+        for(auto job = 0; job < num_jobs; job++) {
+            auto items = readCounts(output_filenames[job]);
+            ASSERT_EQ(items, std::vector<int>({15, 323, 323}));
+        }
+    }
+    for(auto job = 0; job < num_jobs; job++) {
+        remove(input_filenames[job].c_str());
+        remove(output_filenames[job].c_str());
+    }
+}
+
+TEST(TestReduse, TestSessionSharedInput) {
+    // A thousand words twenty times each
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_shared_input.txt";
+    std::vector<std::string> output_filenames{input_filename + "_words.txt", input_filename + "_digits.txt"};
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 20000; i++)
+            input_file << "word" << i % 1000 << "\n";
+    }
+
+    // Two jobs with different MAPs read the same input at the same time, and both spill
+    reduse::Session session(4);
+    for(auto test_reps = 1; test_reps <= 5; test_reps++) {
+        reduse::Options options;
+        options.sort_memory_budget = 1 << 14;
+        std::thread words([&]() {
+            session.reduse<std::string, int, int>(input_filename, output_filenames[0], WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 3, false, options);
+        });
+        std::thread digits([&]() {
+            auto LAST_DIGIT_MAP = [](const std::string& s) { return std::make_pair(s.substr(s.size() - 1), 1); };
+            session.reduse<std::string, int, int>(input_filename, output_filenames[1], LAST_DIGIT_MAP, WORDCOUNT_REDUCE, 3, 3, false, options);
+        });
+        words.join();
+        digits.join();
+
+        // Each job only counted its own keys
+        for(auto job = 0; job < 2; job++) {
+            auto counts = readCounts(output_filenames[job]);
+            ASSERT_EQ(counts, std::vector<int>(job == 0 ? 1000 : 10, job == 0 ? 20 : 2000));
+        }
+    }
+    remove(input_filename.c_str());
+    for(auto &output_filename: output_filenames)
+        remove(output_filename.c_str());
+}
+
+TEST(TestReduse, TestPipelined) {
+    // Lines of zero to four words
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_pipelined_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_pipelined_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 10000; i++) {
+            for(auto j = 0; j < i % 5; j++)
+                input_file << "word" << j << "  ";
+            input_file << "\n";
+        }
+    }
+
+    // Partitions are reduced while the others are still being closed, with and without a pool, in memory and spilled
+    reduse::Session session(2);
+    for(auto test_reps = 1; test_reps <= 3; test_reps++)
+        for(auto mode: {reduse::InputMode::STREAM, reduse::InputMode::MMAP})
+            for(auto spill: {false, true})
+                for(auto pooled: {false, true}) {
+                    reduse::Options options;
+                    options.input_mode = mode;
+                    options.pipelined = true;
+                    options.sort_memory_budget = spill ? 1 << 16 : options.sort_memory_budget;
+                    auto stats = pooled
+                        ? session.reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 3, false, options)
+                        : reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 3, false, options);
+                    ASSERT_EQ(stats.reduce.records_in, 20000u);
+                    ASSERT_EQ(stats.reduce.key_groups, 4u);
+
+                    auto counts = readCounts(output_filename);
+                    ASSERT_EQ(counts, std::vector<int>({2000, 4000, 6000, 8000}));
+                }
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestHotKeys) {
+    // Half of the lines hold the same word, the other half 1000 words ten times each. Without map-side combining, the
+    // group of the hot word reaches the reducers whole
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_hot_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_hot_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 20000; i++)
+            input_file << (i % 2 == 0 ? std::string("hot") : "key" + std::to_string(i / 2 % 1000)) << "\n";
+    }
+    std::vector<int> expected(1000, 10);
+    expected.push_back(10000);
+
+    reduse::Session session(3);
+    for(auto pipelined: {false, true})
+        for(auto pooled: {false, true}) {
+            reduse::Options options;
+            options.associative_reduce = true;
+            options.combine_memory_budget = 0;
+            options.pipelined = pipelined;
+            auto stats = pooled
+                ? session.reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options)
+                : reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options);
+
+            // The hot word is reduced in parts by every reducer, yet written once
+            ASSERT_EQ(stats.reduce.hot_keys, 1u);
+            ASSERT_EQ(stats.reduce.key_groups, 1001u);
+            auto counts = readCounts(output_filename);
+            ASSERT_EQ(counts, expected);
+        }
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestRecordFormat) {
+    // NUL-delimited records that span several lines. The newlines stay inside the words
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_records_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_records_output.txt";
+    {
+        std::ofstream input_file(input_filename, std::ios::binary);
+        for(auto i = 0; i < 10000; i++)
+            input_file << "a\nb " << (i % 2 == 0 ? "c" : "d\n") << '\0';
+    }
+
+    for(auto mode: {reduse::InputMode::STREAM, reduse::InputMode::MMAP}) {
+        reduse::Options options;
+        options.input_mode = mode;
+        options.record_format = reduse::RecordFormat::DELIMITED;
+        auto stats = reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 2, false, options);
+
+        ASSERT_EQ(stats.map.records_in, 10000u);
+        ASSERT_EQ(stats.reduce.key_groups, 3u);
+        auto counts = readCounts(output_filename);
+        ASSERT_EQ(counts, std::vector<int>({5000, 5000, 10000}));
+    }
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestEncodedKeys) {
+    // 1000 long words, twenty times each
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_encoded_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_encoded_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 20000; i++)
+            input_file << "https://example.com/page/" << i % 1000 << "\n";
+    }
+    auto STREAM_REDUCE = [](const std::string& key, reduse::ValueStream<int>& values) {
+        EXPECT_EQ(key.rfind("https://example.com/page/", 0), 0u);
+        auto sum = 0;
+        for(auto &it: values)
+            sum += it;
+        return sum;
+    };
+
+    reduse::Session session(3);
+    for(auto test_reps = 0; test_reps < 4; test_reps++) {
+        reduse::Options options;
+        options.encode_keys = true;
+        options.associative_reduce = test_reps % 2 == 0;
+        options.pipelined = test_reps >= 2;
+        auto stats = test_reps % 2 == 0
+            ? session.reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options)
+            : reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, STREAM_REDUCE, 3, 4, false, options);
+
+        ASSERT_EQ(stats.reduce.key_groups, 1000u);
+        auto counts = readCounts(output_filename);
+        ASSERT_EQ(counts, std::vector<int>(1000, 20));
+    }
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestSortedOutput) {
+    // 5000 words in scrambled order, ten times each
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_sorted_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_sorted_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 50000; i++)
+            input_file << "word" << (i * 7919) % 5000 << "\n";
+    }
+
+    reduse::Session session(3);
+    for(auto test_reps = 0; test_reps < 4; test_reps++) {
+        reduse::Options options;
+        options.sorted_output = true;
+        options.encode_keys = true;
+        options.associative_reduce = true;
+        options.pipelined = test_reps % 2 == 1;
+        if (test_reps >= 2)
+            options.sort_memory_budget = 1 << 16;
+        auto stats = test_reps % 2 == 0
+            ? session.reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options)
+            : reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options);
+        ASSERT_EQ(stats.reduce.key_groups, 5000u);
+
+        // Every key once, with its count, in ascending key order
+        std::fstream output_file;
+        output_file.open(output_filename, std::ios::in);
+        std::vector<std::string> keys;
+        std::string key;
+        int count;
+        while(output_file >> key >> count) {
+            ASSERT_EQ(count, 10);
+            keys.push_back(key);
+        }
+        ASSERT_EQ(keys.size(), 5000u);
+        ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+        ASSERT_EQ(std::adjacent_find(keys.begin(), keys.end()), keys.end());
+    }
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestIncremental) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_incremental_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_incremental_output.txt";
+    std::string cache_directory = TEST_SOURCE_DIR;
+    cache_directory += "/testreduse_incremental_cache";
+
+    // Reads the "word count" lines of the output
+    auto readWordCounts = [&]() {
+        std::map<std::string, int> counts;
+        std::fstream output_file;
+        output_file.open(output_filename, std::ios::in);
+        std::string key;
+        int count;
+        while(output_file >> key >> count)
+            counts[key] += count;
+        return counts;
+    };
+
+    for(auto associative: {true, false}) {
+        std::filesystem::remove_all(cache_directory);
+        std::map<std::string, int> expected;
+        std::ofstream(input_filename, std::ios::trunc);
+        for(auto rerun = 0; rerun < 4; rerun++) {
+            // The log grows on every rerun but the last
+            if (rerun < 3) {
+                std::ofstream input_file(input_filename, std::ios::app);
+                for(auto i = 0; i < 10000; i++) {
+                    input_file << "word" << (i * 31 + rerun) % 700 << "\n";
+                    expected["word" + std::to_string((i * 31 + rerun) % 700)]++;
+                }
+            }
+
+            reduse::Options options;
+            options.cache_directory = cache_directory;
+            options.cache_chunk_size = 8 << 10;
+            options.sorted_output = true;
+            options.associative_reduce = associative;
+            auto stats = reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options);
+            ASSERT_EQ(readWordCounts(), expected);
+            ASSERT_EQ(stats.reduce.key_groups, 700u);
+
+            // Only the chunks past the old end of the input are mapped again
+            if (rerun == 0) {
+                ASSERT_EQ(stats.map.cached_chunks, 0u);
+            } else {
+                ASSERT_GT(stats.map.cached_chunks, 5u);
+            }
+            if (rerun == 3) {
+                ASSERT_LT(stats.map.records_in, 2000u);
+            }
+        }
+    }
+
+    // A chunk that changed is mapped again
+    {
+        std::fstream input_file(input_filename, std::ios::in | std::ios::out);
+        input_file.seekp(0);
+        input_file << "WORD";
+    }
+    reduse::Options options;
+    options.cache_directory = cache_directory;
+    options.cache_chunk_size = 8 << 10;
+    options.sorted_output = true;
+    reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_MAP, WORDCOUNT_REDUCE, 3, 4, false, options);
+    auto counts = readWordCounts();
+    ASSERT_EQ(counts.size(), 701u);
+    ASSERT_EQ(counts["WORD0"], 1);
+    std::filesystem::remove_all(cache_directory);
+    remove(input_filename.c_str());
+}
+
+TEST(TestReduse, TestMemoryBudget) {
+    // Every line holds a hot key and one of 2000 others
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/testreduse_budget_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testreduse_budget_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 100000; i++)
+            input_file << "hot word" << i % 2000 << "\n";
+    }
+
+    for(auto sorted: {false, true}) {
+        // The hot key group alone outgrows the budget, so it is folded while it is collected
+        reduse::Options options;
+        options.memory_budget = 256 << 10;
+        options.combine_memory_budget = 0;
+        options.associative_reduce = true;
+        options.split_hot_keys = false;
+        options.sorted_output = sorted;
+        auto stats = reduse::reduse<std::string, int, int>(input_filename, output_filename, WORDCOUNT_EMIT_MAP, WORDCOUNT_REDUCE, 3, 2, false, options);
+
+        ASSERT_GT(stats.map.spill_files, 0u);
+        ASSERT_GT(stats.map.peak_memory, 0u);
+        ASSERT_LE(stats.map.peak_memory, options.memory_budget);
+        ASSERT_LE(stats.reduce.peak_memory, options.memory_budget);
+        ASSERT_EQ(stats.reduce.records_in, 200000u);
+        ASSERT_EQ(stats.reduce.key_groups, 2001u);
+        ASSERT_EQ(stats.reduce.largest_group, 100000u);
+
+        if (sorted) {
+            std::ifstream output_file(output_filename);
+            std::string word;
+            int count;
+            while(output_file >> word >> count)
+                ASSERT_EQ(count, word == "hot" ? 100000 : 50);
+        } else {
+            auto counts = readCounts(output_filename);
+            ASSERT_EQ(counts.size(), 2001u);
+            ASSERT_EQ(counts.front(), 50);
+            ASSERT_EQ(counts[1999], 50);
+            ASSERT_EQ(counts.back(), 100000);
+        }
+    }
+    remove(input_filename.c_str());
+}
@@ -0,0 +1,57 @@
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <gtest/gtest.h>
+#include <reduse/ring_buffer.hpp>
+
+TEST(TestRingBuffer, TestRun) {
+
+    for(auto test_reps = 1; test_reps <= 50; test_reps++) {
+        const int num_producers = 3;
+        const int num_consumers = 4;
+        const int items_per_producer = 10000;
+        const std::size_t batch_size = 7;
+
+        reduse::RingBuffer<int> buff(4);
+        std::atomic<long long> sum = 0;
+        std::atomic<int> ct = 0;
+
+        // Each consumer drains batches till the buffer is closed
+        std::vector<std::thread> consumers;
+        for(auto i = 0; i < num_consumers; i++)
+            consumers.emplace_back([&]() {
+                std::vector<int> batch;
+                while(buff.get(batch))
+                    for(auto &it: batch) {
+                        sum += it;
+                        ct++;
+                    }
+            });
+
+        // Each producer puts its items in batches
+        std::vector<std::thread> producers;
+        for(auto i = 0; i < num_producers; i++)
+            producers.emplace_back([&]() {
+                std::vector<int> batch;
+                for(auto item = 1; item <= items_per_producer; item++) {
+                    batch.resize(0);
+                    batch.push_back(item);
+                    while(batch.size() < batch_size && item < items_per_producer)
+                        batch.push_back(++item);
+                    ASSERT_TRUE(buff.put(batch));
+                }
+            });
+
+        for(auto &producer: producers)
+            producer.join();
+        buff.close();
+        for(auto &consumer: consumers)
+            consumer.join();
+
+        // Assertions
+        std::vector<int> batch = {1};
+        ASSERT_FALSE(buff.put(batch));
+        ASSERT_EQ(ct, num_producers * items_per_producer);
+        ASSERT_EQ(sum, (long long)num_producers * items_per_producer * (items_per_producer + 1) / 2);
+    }
+}
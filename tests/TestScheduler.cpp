@@ -0,0 +1,85 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <reduse/scheduler.hpp>
+
+// Runs every worker of a scheduler on its own thread and returns the tasks each one got
+std::vector<std::vector<std::string_view>> runWorkers(reduse::SplitScheduler& scheduler, const std::size_t slow_worker) {
+    std::vector<std::vector<std::string_view>> tasks(scheduler.workerCount());
+    std::vector<std::thread> workers;
+    for(std::size_t i = 0; i < scheduler.workerCount(); i++)
+        workers.emplace_back([&, i]() {
+            std::string_view task;
+            while(scheduler.next(i, task)) {
+                tasks[i].push_back(task);
+                if (i == slow_worker)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+    for(auto &worker: workers)
+        worker.join();
+    return tasks;
+}
+
+// Checks that the tasks cover the input exactly once, in record aligned ranges
+void checkCoverage(std::string_view input, std::vector<std::vector<std::string_view>> tasks, const std::vector<std::size_t>& starts) {
+    std::vector<std::string_view> all;
+    for(auto &worker_tasks: tasks)
+        all.insert(all.end(), worker_tasks.begin(), worker_tasks.end());
+    std::sort(all.begin(), all.end(), [](std::string_view a, std::string_view b) { return a.data() < b.data(); });
+    const char* next = input.data();
+    for(auto task: all) {
+        ASSERT_EQ(task.data(), next);
+        ASSERT_FALSE(task.empty());
+        ASSERT_TRUE(std::binary_search(starts.begin(), starts.end(), static_cast<std::size_t>(task.data() - input.data())));
+        next = task.data() + task.size();
+    }
+    ASSERT_EQ(next, input.data() + input.size());
+}
+
+TEST(TestScheduler, TestStealing) {
+    // Lines of varying lengths
+    std::string input;
+    std::vector<std::size_t> starts;
+    for(auto i = 0; i < 200000; i++) {
+        starts.push_back(input.size());
+        input += std::string(i % 13, 'a' + i % 26) + "\n";
+    }
+
+    // The slow worker is left behind, so the others steal its input
+    reduse::Options options;
+    reduse::SplitScheduler scheduler(input, 4, options);
+    auto tasks = runWorkers(scheduler, 0);
+    checkCoverage(input, tasks, starts);
+    ASSERT_GT(scheduler.stealCount(), 0u);
+    std::size_t slow_bytes = 0;
+    for(auto task: tasks[0])
+        slow_bytes += task.size();
+    ASSERT_LT(slow_bytes, input.size() / 4);
+
+    // An empty input hands out nothing
+    reduse::SplitScheduler empty("", 3, options);
+    std::string_view task;
+    ASSERT_FALSE(empty.next(2, task));
+}
+
+TEST(TestScheduler, TestLengthPrefixed) {
+    std::string input;
+    std::vector<std::size_t> starts;
+    for(std::uint32_t i = 0; i < 50000; i++) {
+        starts.push_back(input.size());
+        const std::uint32_t length = i % 29;
+        input.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        input.append(length, 'x');
+    }
+
+    reduse::Options options;
+    options.record_format = reduse::RecordFormat::LENGTH_PREFIXED;
+    reduse::SplitScheduler scheduler(input, 3, options);
+    checkCoverage(input, runWorkers(scheduler, 1), starts);
+}
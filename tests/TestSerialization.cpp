@@ -0,0 +1,76 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <utility>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/serialization.hpp>
+#include <reduse/sorter.hpp>
+
+// A type without a Serializer specialization, which falls back to its stream operators
+struct Point {
+    int x, y;
+    bool operator==(const Point& other) const { return x == other.x && y == other.y; }
+};
+
+std::ostream& operator<<(std::ostream& out, const Point& p) { return out << p.x << ',' << p.y; }
+std::istream& operator>>(std::istream& in, Point& p) { char comma; return in >> p.x >> comma >> p.y; }
+
+TEST(TestSerialization, TestRoundTrip) {
+    std::stringstream strings(std::ios::in | std::ios::out | std::ios::binary);
+    std::stringstream points(std::ios::in | std::ios::out | std::ios::binary);
+    {
+        reduse::RecordWriter<std::string, double> string_writer(strings, reduse::Format::BINARY);
+        reduse::RecordWriter<Point, long long> point_writer(points, reduse::Format::BINARY);
+        for(auto i = 0; i < 100000; i++) {
+            string_writer.write({"key " + std::to_string(i), i * 0.5});
+            point_writer.write({{i, -i}, (long long)i << 32});
+        }
+    }
+
+    reduse::RecordReader<std::string, double> string_reader(strings, reduse::Format::BINARY);
+    reduse::RecordReader<Point, long long> point_reader(points, reduse::Format::BINARY);
+    std::pair<std::string, double> string_record;
+    std::pair<Point, long long> point_record;
+    for(auto i = 0; i < 100000; i++) {
+        ASSERT_TRUE(string_reader.read(string_record));
+        ASSERT_EQ(string_record.first, "key " + std::to_string(i));
+        ASSERT_EQ(string_record.second, i * 0.5);
+        ASSERT_TRUE(point_reader.read(point_record));
+        ASSERT_EQ(point_record.first, (Point{i, -i}));
+        ASSERT_EQ(point_record.second, (long long)i << 32);
+    }
+    ASSERT_FALSE(string_reader.read(string_record));
+    ASSERT_FALSE(point_reader.read(point_record));
+}
+
+TEST(TestSerialization, TestBinarySpill) {
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testserialization_output.bin";
+
+    // Keys with whitespace only survive the binary format
+    reduse::ExternalSorter<std::string, int> sorter(output_filename, 4096, 1, reduse::Format::BINARY);
+    {
+        reduse::SortBuffer<std::string, int> sort_buffer(sorter);
+        for(auto i = 0; i < 20000; i++)
+            sort_buffer.push(0, {"word " + std::to_string(i % 997), i});
+        sort_buffer.close();
+    }
+    ASSERT_GT(sorter.spillCount(), 0u);
+    sorter.merge(output_filename, 4, 0, reduse::Format::BINARY);
+
+    std::ifstream output_file(output_filename, std::ios::in | std::ios::binary);
+    ASSERT_TRUE(output_file.is_open());
+    reduse::RecordReader<std::string, int> reader(output_file, reduse::Format::BINARY);
+    std::vector<std::string> keys;
+    std::pair<std::string, int> record;
+    while(reader.read(record)) {
+        ASSERT_EQ(record.first, "word " + std::to_string(record.second % 997));
+        keys.push_back(record.first);
+    }
+    ASSERT_EQ(keys.size(), 20000u);
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+}
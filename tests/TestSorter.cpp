@@ -0,0 +1,127 @@
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/sorter.hpp>
+
+TEST(TestSorter, TestMerge) {
+
+    for(auto test_reps = 1; test_reps <= 20; test_reps++) {
+        std::string output_filename = TEST_SOURCE_DIR;
+        output_filename += "/testsorter_output.txt";
+
+        // A tiny budget forces many spilled runs next to the in-memory ones
+        const int num_workers = 1 + test_reps % 4;
+        const int records_per_worker = 20000;
+        reduse::ExternalSorter<int, std::string> sorter(output_filename, 4096 * test_reps);
+        std::vector<std::thread> workers;
+        for(auto worker = 0; worker < num_workers; worker++)
+            workers.emplace_back([&, worker]() {
+                reduse::SortBuffer<int, std::string> sort_buffer(sorter);
+                for(auto i = 0; i < records_per_worker; i++) {
+                    int key = (i * 7919 + worker * 104729) % 5003;
+                    sort_buffer.push(0, {key, "v" + std::to_string(key)});
+                }
+                sort_buffer.close();
+            });
+        for(auto &worker: workers)
+            worker.join();
+        ASSERT_GT(sorter.spillCount(), 0u);
+
+        sorter.merge(output_filename, 1 + test_reps % 5);
+
+        // Read the merged file back
+        std::fstream output_file;
+        output_file.open(output_filename, std::ios::in);
+        ASSERT_TRUE(output_file.is_open());
+        std::vector<int> keys;
+        int key;
+        std::string value;
+        while(output_file >> key >> value) {
+            ASSERT_EQ(value, "v" + std::to_string(key));
+            keys.push_back(key);
+        }
+        output_file.close();
+
+        // Assertions
+        ASSERT_EQ((int)keys.size(), num_workers * records_per_worker);
+        ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    }
+}
+
+TEST(TestSorter, TestPartitions) {
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testsorter_partition_output.txt";
+
+    // Spill often, so that every spill file holds runs of several partitions
+    const std::size_t num_partitions = 5;
+    reduse::ExternalSorter<int, int> sorter(output_filename, 2048, num_partitions);
+    {
+        reduse::SortBuffer<int, int> sort_buffer(sorter);
+        for(auto i = 0; i < 50000; i++)
+            sort_buffer.push(i % num_partitions, {(i * 31) % 10007, i});
+        sort_buffer.close();
+    }
+    ASSERT_GT(sorter.spillCount(), 1u);
+
+    // Every partition merges into its own key ordered sequence
+    std::size_t ct = 0;
+    for(std::size_t partition = 0; partition < num_partitions; partition++) {
+        std::vector<int> keys;
+        reduse::mergeRuns<int, int>(sorter.getRuns(partition), std::nullopt, std::nullopt, [&](std::pair<int, int>& record) {
+            ASSERT_EQ(record.second % (int)num_partitions, (int)partition);
+            keys.push_back(record.first);
+        });
+        ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+        ct += keys.size();
+    }
+    ASSERT_EQ(ct, 50000u);
+
+    sorter.clear();
+    ASSERT_EQ(sorter.getRuns(0).size(), 0u);
+}
+
+TEST(TestSorter, TestFinalPartitions) {
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/testsorter_final_output.txt";
+
+    for(auto test_reps = 1; test_reps <= 20; test_reps++) {
+        const std::size_t num_partitions = 4;
+        const int num_writers = 3;
+        reduse::ExternalSorter<int, int> sorter(output_filename, 4096, num_partitions);
+
+        // Every partition is reported exactly once, after the last writer closed it, with all of its records
+        std::mutex final_mutex;
+        std::vector<std::size_t> final_sizes(num_partitions, 0);
+        std::vector<int> final_counts(num_partitions, 0);
+        sorter.setFinalHandler([&](std::size_t partition) {
+            std::size_t size = 0;
+            for(auto &run: sorter.getRuns(partition))
+                size += run.size;
+            std::scoped_lock final_lock{final_mutex};
+            final_sizes[partition] = size;
+            final_counts[partition]++;
+        });
+        sorter.expectWriters(num_writers);
+
+        std::vector<std::thread> writers;
+        for(auto w = 0; w < num_writers; w++)
+            writers.emplace_back([&]() {
+                reduse::SortBuffer<int, int> sort_buffer(sorter);
+                for(auto i = 0; i < 10000; i++)
+                    sort_buffer.push(i % num_partitions, {i, i});
+                sort_buffer.close();
+            });
+        for(auto &writer: writers)
+            writer.join();
+
+        ASSERT_EQ(final_counts, std::vector<int>(num_partitions, 1));
+        ASSERT_EQ(final_sizes, std::vector<std::size_t>(num_partitions, 7500u));
+    }
+}
@@ -0,0 +1,175 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <utility>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <reduse/config.hpp>
+#include <reduse/stream.hpp>
+
+namespace {
+
+    std::pair<std::string, int> STREAM_MAP(std::string_view line) { return {std::string(line), 1}; }
+
+    int STREAM_REDUCE(std::string, std::vector<int>& values) {
+        auto sum = 0;
+        for(auto it: values)
+            sum += it;
+        return sum;
+    }
+
+    // Reads the "end key result" lines of a stream's output, per window end
+    std::map<std::size_t, std::map<std::string, int>> readWindows(const std::string& output_filename) {
+        std::map<std::size_t, std::map<std::string, int>> windows;
+        std::ifstream output_file(output_filename);
+        std::size_t end;
+        std::string key;
+        int count;
+        while(output_file >> end >> key >> count)
+            windows[end][key] += count;
+        return windows;
+    }
+}
+
+TEST(TestStream, TestRecordWindows) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/teststream_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/teststream_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 1000; i++)
+            input_file << "word" << i % 10 << "\n";
+    }
+
+    for(auto associative: {false, true}) {
+        reduse::Options options;
+        options.associative_reduce = associative;
+        options.batch_size = 7;
+
+        // Tumbling windows of 100 records hold every word ten times
+        auto stats = reduse::stream<std::string, int, int>(input_filename, output_filename, STREAM_MAP, STREAM_REDUCE, {reduse::WindowUnit::RECORDS, 100, 0}, 3, false, options);
+        ASSERT_EQ(stats.records_in, 1000u);
+        auto windows = readWindows(output_filename);
+        ASSERT_EQ(windows.size(), 10u);
+        for(auto &[end, counts]: windows) {
+            ASSERT_EQ(end % 100, 0u);
+            ASSERT_EQ(counts.size(), 10u);
+            for(auto &[key, count]: counts)
+                ASSERT_EQ(count, 10);
+        }
+
+        // Sliding windows of 200 records every 100 hold them twenty times, except the first one
+        reduse::stream<std::string, int, int>(input_filename, output_filename, STREAM_MAP, STREAM_REDUCE, {reduse::WindowUnit::RECORDS, 200, 100}, 2, false, options);
+        windows = readWindows(output_filename);
+        ASSERT_EQ(windows.size(), 10u);
+        for(auto &[end, counts]: windows)
+            for(auto &[key, count]: counts)
+                ASSERT_EQ(count, end == 100 ? 10 : 20);
+    }
+
+    // The slide must divide the size
+    reduse::Window uneven{reduse::WindowUnit::RECORDS, 100, 30};
+    auto makeJob = [&]() { reduse::StreamJob<std::string, int, int> job(input_filename, output_filename, STREAM_MAP, STREAM_REDUCE, uneven); };
+    ASSERT_THROW(makeJob(), std::invalid_argument);
+    remove(input_filename.c_str());
+}
+
+TEST(TestStream, TestFollow) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/teststream_follow_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/teststream_follow_output.txt";
+    std::ofstream input_file(input_filename, std::ios::trunc);
+
+    // The file grows while it is streamed, in bursts spread over several time windows
+    reduse::StreamJob<std::string, int, int> job(input_filename, output_filename, STREAM_MAP, STREAM_REDUCE, {reduse::WindowUnit::MILLISECONDS, 20, 0}, true, 2);
+    std::thread streamer([&]() { job.run(); });
+    for(auto burst = 0; burst < 5; burst++) {
+        for(auto i = 0; i < 200; i++)
+            input_file << "word" << i % 4 << "\n";
+        input_file.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+
+    // Results of the windows already closed show up without the job ending
+    auto windows = readWindows(output_filename);
+    ASSERT_GT(windows.size(), 0u);
+    input_file << "last";
+    input_file.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    job.stop();
+    streamer.join();
+
+    // Every record counts once, the last one without its newline included
+    std::map<std::string, int> totals;
+    for(auto &[end, counts]: readWindows(output_filename))
+        for(auto &[key, count]: counts)
+            totals[key] += count;
+    ASSERT_EQ(totals, (std::map<std::string, int>{{"last", 1}, {"word0", 250}, {"word1", 250}, {"word2", 250}, {"word3", 250}}));
+    remove(input_filename.c_str());
+}
+
+TEST(TestStream, TestTruncatedInput) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/teststream_truncated_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/teststream_truncated_output.txt";
+    {
+        std::ofstream input_file(input_filename, std::ios::binary);
+        input_file << "abcdefgh12";
+    }
+
+    // The last record is two bytes short. The error reaches the caller instead of leaving the open pane waiting
+    reduse::Options options;
+    options.record_format = reduse::RecordFormat::FIXED_WIDTH;
+    options.record_width = 4;
+    ASSERT_THROW(
+        (reduse::stream<std::string, int, int>(input_filename, output_filename, STREAM_MAP, STREAM_REDUCE, {reduse::WindowUnit::RECORDS, 100, 0}, 2, false, options)),
+        std::runtime_error
+    );
+    remove(input_filename.c_str());
+    remove(output_filename.c_str());
+}
+
+TEST(TestStream, TestWorkerErrors) {
+    std::string input_filename = TEST_SOURCE_DIR;
+    input_filename += "/teststream_errors_input.txt";
+    std::string output_filename = TEST_SOURCE_DIR;
+    output_filename += "/teststream_errors_output.txt";
+    {
+        std::ofstream input_file(input_filename);
+        for(auto i = 0; i < 1000; i++)
+            input_file << "word" << i % 10 << "\n";
+    }
+    reduse::Window window{reduse::WindowUnit::RECORDS, 100, 0};
+
+    // A MAP failing on a mapper thread stops the stream and reaches the caller
+    auto THROWING_MAP = [](std::string_view line) {
+        if (line == "word7")
+            throw std::runtime_error("bad record");
+        return STREAM_MAP(line);
+    };
+    ASSERT_THROW(
+        (reduse::stream<std::string, int, int>(input_filename, output_filename, THROWING_MAP, STREAM_REDUCE, window, 3)),
+        std::runtime_error
+    );
+
+    // So does a REDUCE failing on the writer thread
+    auto THROWING_REDUCE = [](const std::string& key, std::vector<int>& values) -> int {
+        if (key == "word3")
+            throw std::runtime_error("bad group");
+        return STREAM_REDUCE(key, values);
+    };
+    ASSERT_THROW(
+        (reduse::stream<std::string, int, int>(input_filename, output_filename, STREAM_MAP, THROWING_REDUCE, window, 3)),
+        std::runtime_error
+    );
+    remove(input_filename.c_str());
+    remove(output_filename.c_str());
+}
@@ -0,0 +1,65 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <reduse/thread_pool.hpp>
+
+TEST(TestThreadPool, TestRun) {
+    reduse::ThreadPool pool(3);
+    ASSERT_EQ(pool.size(), 3);
+
+    for(auto test_reps = 1; test_reps <= 100; test_reps++) {
+        std::atomic<long long> sum = 0;
+        reduse::TaskGroup group(pool);
+        for(auto i = 1; i <= 100; i++)
+            group.submit([&sum, i]() { sum += i; });
+        group.wait();
+        ASSERT_EQ(sum, 5050);
+    }
+
+    // The first exception of a group is rethrown by wait, after every task has finished
+    std::atomic<int> ct = 0;
+    reduse::TaskGroup group(pool);
+    for(auto i = 0; i < 10; i++)
+        group.submit([&ct, i]() {
+            ct++;
+            if (i % 3 == 0)
+                throw std::runtime_error("task failed");
+        });
+    ASSERT_THROW(group.wait(), std::runtime_error);
+    ASSERT_EQ(ct, 10);
+    group.wait();
+}
+
+TEST(TestThreadPool, TestFairShare) {
+    // A single worker serves the groups round-robin, so a late group is not stuck behind a long queue
+    reduse::ThreadPool pool(1);
+    std::vector<std::string> order;
+    std::mutex order_mutex;
+    auto task = [&](const std::string& name) {
+        return [&, name]() {
+            std::scoped_lock order_lock{order_mutex};
+            order.push_back(name);
+        };
+    };
+
+    // Hold the worker until both groups are queued
+    std::mutex gate;
+    gate.lock();
+    reduse::TaskGroup blocker(pool);
+    blocker.submit([&]() { std::scoped_lock gate_lock{gate}; });
+
+    reduse::TaskGroup first(pool), second(pool);
+    for(auto i = 0; i < 3; i++)
+        first.submit(task("a"));
+    for(auto i = 0; i < 3; i++)
+        second.submit(task("b"));
+    gate.unlock();
+    first.wait();
+    second.wait();
+    blocker.wait();
+    ASSERT_EQ(order, std::vector<std::string>({"a", "b", "a", "b", "a", "b"}));
+}